@@ -125,6 +125,7 @@ bool CActiveMasternode::SendMasternodePing(std::string& errorMessage)
 
     // Update lastPing for our masternode in Masternode list
     pmn->lastPing = mnp;
+    mnodeman.UpdatedMasternodePing(pmn);
     mnodeman.mapSeenMasternodePing.insert(std::make_pair(mnp.GetHash(), mnp));
 
     //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
@@ -0,0 +1,80 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "main.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+// Fill block templates from a full mempool of 50k transactions, a fifth of
+// them spending an output of another mempool transaction, on an unchanged
+// tip: the staker's case of asking for a new template every time slot.
+static const int MEMPOOL_TXS = 50000;
+static const int TIP_HEIGHT = 100;
+
+static CMutableTransaction MakeSpend(const COutPoint& prevout, CAmount nValue)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(nValue, CScript() << OP_TRUE);
+    return tx;
+}
+
+static void AssembleTemplates(benchmark::State& state, unsigned int nBlockPrioritySize)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache viewBase(&viewDummy);
+    CTxMemPool pool(CFeeRate(0));
+    const uint256 hashTip = GetRandHash();
+    viewBase.SetBestBlock(hashTip);
+
+    CBlockIndex indexTip;
+    indexTip.nHeight = TIP_HEIGHT;
+    {
+        LOCK(cs_main);
+        indexTip.phashBlock = &mapBlockIndex.emplace(hashTip, &indexTip).first->first;
+    }
+
+    std::vector<uint256> vParents;
+    for (int i = 0; i < MEMPOOL_TXS; i++) {
+        const CAmount nFee = 10000 + i;
+        CAmount nValueIn = 10 * COIN;
+        COutPoint prevout;
+        bool fChild = i % 5 == 4;
+        if (fChild) {
+            prevout = COutPoint(vParents[i / 5], 0);
+            nValueIn = pool.mapTx.find(prevout.hash)->GetTx().vout[0].nValue;
+        } else {
+            prevout = COutPoint(GetRandHash(), 0);
+            viewBase.AddCoin(prevout, Coin(CTxOut(nValueIn, CScript() << OP_TRUE), 1, false, false), false);
+        }
+        const CTransactionRef tx = MakeTransactionRef(MakeSpend(prevout, nValueIn - nFee));
+        const double dPriority = fChild ? 0 : tx->ComputePriority((double) nValueIn * (TIP_HEIGHT - 1));
+        pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, nFee, 0, dPriority, TIP_HEIGHT, !fChild, fChild ? 0 : nValueIn, false, 0));
+        if (!fChild)
+            vParents.push_back(tx->GetHash());
+    }
+
+    {
+        LOCK2(cs_main, pool.cs);
+        while (state.KeepRunning()) {
+            CBlockTemplate blocktemplate;
+            AddMempoolTransactions(blocktemplate, pool, &viewBase, hashTip, TIP_HEIGHT + 1,
+                                   DEFAULT_BLOCK_MAX_SIZE, nBlockPrioritySize, DEFAULT_BLOCK_MIN_SIZE);
+            assert(blocktemplate.block.vtx.size() > 0);
+        }
+        mapBlockIndex.erase(hashTip);
+    }
+}
+
+static void AssembleBlockByFee(benchmark::State& state) { AssembleTemplates(state, 0); }
+static void AssembleBlockWithPriority(benchmark::State& state) { AssembleTemplates(state, DEFAULT_BLOCK_PRIORITY_SIZE); }
+
+BENCHMARK(AssembleBlockByFee);
+BENCHMARK(AssembleBlockWithPriority);
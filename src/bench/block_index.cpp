@@ -0,0 +1,142 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "memusage.h"
+#include "optional.h"
+#include "random.h"
+
+#include <iostream>
+
+// Build a chain of block index entries with their stake modifiers and money
+// supply, the way the node does at startup, then walk it with GetAncestor.
+// The heap variant allocates every entry, with the layout it had before the
+// rarely read fields moved to the arena side slots, on its own. Both report
+// their bytes per entry on stderr, out of the way of the results on stdout.
+static const int CHAIN_LENGTH = 100000;
+static const int LOOKUPS = 100000;
+
+/** The block index entry as it was laid out before CBlockIndexCold */
+struct CBlockIndexBaseline
+{
+    const uint256* phashBlock{nullptr};
+    CBlockIndexBaseline* pprev{nullptr};
+    CBlockIndexBaseline* pskip{nullptr};
+    int nHeight{0};
+    int nFile{0};
+    unsigned int nDataPos{0};
+    unsigned int nUndoPos{0};
+    uint256 nChainWork{};
+    unsigned int nTx{0};
+    unsigned int nChainTx{0};
+    unsigned int nStatus{0};
+    std::vector<unsigned char> vStakeModifier{};
+    unsigned int nFlags{0};
+    Optional<CAmount> nMoneySupply{0};
+    uint160 hashPaidPayee{};
+    int nVersion{0};
+    uint256 hashMerkleRoot{};
+    unsigned int nTime{0};
+    unsigned int nBits{0};
+    unsigned int nNonce{0};
+    uint256 nAccumulatorCheckpoint{};
+    uint32_t nSequenceId{0};
+
+    // the skip list of CBlockIndex
+    static int GetSkipHeight(int height)
+    {
+        if (height < 2)
+            return 0;
+        const auto InvertLowestOne = [](int n) { return n & (n - 1); };
+        return (height & 1) ? InvertLowestOne(InvertLowestOne(height - 1)) + 1 : InvertLowestOne(height);
+    }
+
+    CBlockIndexBaseline* GetAncestor(int height)
+    {
+        if (height > nHeight || height < 0)
+            return nullptr;
+
+        CBlockIndexBaseline* pindexWalk = this;
+        int heightWalk = nHeight;
+        while (heightWalk > height) {
+            int heightSkip = GetSkipHeight(heightWalk);
+            int heightSkipPrev = GetSkipHeight(heightWalk - 1);
+            if (heightSkip == height ||
+                (heightSkip > height && !(heightSkipPrev < heightSkip - 2 && heightSkipPrev >= height))) {
+                pindexWalk = pindexWalk->pskip;
+                heightWalk = heightSkip;
+            } else {
+                pindexWalk = pindexWalk->pprev;
+                heightWalk--;
+            }
+        }
+        return pindexWalk;
+    }
+
+    void BuildSkip()
+    {
+        if (pprev)
+            pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+    }
+
+    void SetStakeModifierBytes(const unsigned char* pbegin, const unsigned char* pend) { vStakeModifier.assign(pbegin, pend); }
+    void SetMoneySupply(CAmount nSupply) { nMoneySupply = nSupply; }
+};
+
+template <typename Index>
+static void BuildAndWalk(std::vector<Index*>& vIndex)
+{
+    const uint256 nModifier = GetRandHash();
+    for (int i = 0; i < CHAIN_LENGTH; i++) {
+        Index* pindex = vIndex[i];
+        pindex->nHeight = i;
+        pindex->pprev = i ? vIndex[i - 1] : nullptr;
+        pindex->BuildSkip();
+        pindex->SetStakeModifierBytes(nModifier.begin(), nModifier.end());
+        pindex->SetMoneySupply(i);
+    }
+
+    FastRandomContext ctx(true);
+    int64_t nSum = 0;
+    for (int i = 0; i < LOOKUPS; i++) {
+        Index* pindex = vIndex[ctx.randrange(CHAIN_LENGTH)];
+        nSum += pindex->GetAncestor(ctx.randrange(pindex->nHeight + 1))->nHeight;
+    }
+    assert(nSum >= 0);
+}
+
+static void BlockIndexHeap(benchmark::State& state)
+{
+    std::vector<CBlockIndexBaseline*> vIndex(CHAIN_LENGTH);
+    size_t nUsage = 0;
+    while (state.KeepRunning()) {
+        for (CBlockIndexBaseline*& pindex : vIndex)
+            pindex = new CBlockIndexBaseline();
+        BuildAndWalk(vIndex);
+        nUsage = 0;
+        for (CBlockIndexBaseline* pindex : vIndex) {
+            nUsage += memusage::MallocUsage(sizeof(CBlockIndexBaseline)) + memusage::DynamicUsage(pindex->vStakeModifier);
+            delete pindex;
+        }
+    }
+    std::cerr << "BlockIndexHeap: " << nUsage / CHAIN_LENGTH << " bytes per entry" << std::endl;
+}
+
+static void BlockIndexArena(benchmark::State& state)
+{
+    std::vector<CBlockIndex*> vIndex(CHAIN_LENGTH);
+    size_t nUsage = 0;
+    while (state.KeepRunning()) {
+        CBlockIndexArena arena;
+        for (CBlockIndex*& pindex : vIndex)
+            pindex = arena.Allocate();
+        BuildAndWalk(vIndex);
+        nUsage = arena.DynamicMemoryUsage();
+    }
+    std::cerr << "BlockIndexArena: " << nUsage / CHAIN_LENGTH << " bytes per entry" << std::endl;
+}
+
+BENCHMARK(BlockIndexHeap);
+BENCHMARK(BlockIndexArena);
@@ -0,0 +1,62 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "key.h"
+#include "main.h"
+#include "masternodeman.h"
+#include "messagesigner.h"
+#include "util.h"
+
+#include <boost/thread/thread.hpp>
+
+// The signature checks of a burst of pings, like the ones received after a
+// restart or a masternode list sync, one by one and on the check queue.
+static const int MIN_CORES = 2;
+static const int PINGS = MAX_MASTERNODE_SIG_BATCH;
+
+static std::vector<std::shared_ptr<const CSignedMessage>> MakePings()
+{
+    std::vector<std::shared_ptr<const CSignedMessage>> vPings;
+    for (int i = 0; i < PINGS; i++) {
+        CKey key;
+        key.MakeNewKey(true);
+        auto pping = std::make_shared<CMasternodePing>();
+        pping->vin = CTxIn(GetRandHash(), 0);
+        pping->blockHash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        CHashSigner::SignHash(pping->GetSignatureHash(), key, vchSig);
+        pping->SetVchSig(vchSig);
+        vPings.push_back(pping);
+    }
+    return vPings;
+}
+
+static void CheckPings(benchmark::State& state, int nThreads)
+{
+    const auto vPings = MakePings();
+    const int nScriptCheckThreadsOld = nScriptCheckThreads;
+    nScriptCheckThreads = nThreads;
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads - 1; i++)
+        tg.create_thread(&ThreadMasternodeSigCheck);
+
+    while (state.KeepRunning()) {
+        std::vector<CMasternodeSigCheck> vChecks;
+        vChecks.reserve(vPings.size());
+        for (const auto& pping : vPings)
+            vChecks.emplace_back(pping);
+        CheckMasternodeSignatures(vChecks);
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+}
+
+static void MasternodeSyncSerial(benchmark::State& state) { CheckPings(state, 0); }
+static void MasternodeSyncBatch(benchmark::State& state) { CheckPings(state, std::max(MIN_CORES, GetNumCores())); }
+
+BENCHMARK(MasternodeSyncSerial);
+BENCHMARK(MasternodeSyncBatch);
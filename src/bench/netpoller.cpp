@@ -0,0 +1,127 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "compat.h"
+
+#ifndef WIN32
+
+#include <sys/select.h>
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+// Waiting on many mostly idle connections, like the socket handler does:
+// one peer out of nConnections sends a byte per round, which is then read.
+// select() stays below FD_SETSIZE, socketpairs take two descriptors each.
+static const int SMALL_CONNECTIONS = 32;
+static const int LARGE_CONNECTIONS = 400;
+
+static bool OpenConnections(int nConnections, std::vector<int>& vLocal, std::vector<int>& vRemote)
+{
+    for (int i = 0; i < nConnections; i++) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+            return false;
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        vLocal.push_back(fds[0]);
+        vRemote.push_back(fds[1]);
+    }
+    return true;
+}
+
+static void CloseConnections(std::vector<int>& vLocal, std::vector<int>& vRemote)
+{
+    for (int fd : vLocal)
+        close(fd);
+    for (int fd : vRemote)
+        close(fd);
+}
+
+static void NetPollerSelect(benchmark::State& state, int nConnections)
+{
+    std::vector<int> vLocal, vRemote;
+    if (!OpenConnections(nConnections, vLocal, vRemote)) {
+        CloseConnections(vLocal, vRemote);
+        return;
+    }
+
+    char ch = 0;
+    size_t nRound = 0;
+    while (state.KeepRunning()) {
+        if (write(vRemote[nRound++ % vRemote.size()], &ch, 1) != 1)
+            break;
+
+        fd_set fdsetRecv;
+        FD_ZERO(&fdsetRecv);
+        int nMax = 0;
+        for (int fd : vLocal) {
+            FD_SET(fd, &fdsetRecv);
+            nMax = std::max(nMax, fd);
+        }
+        struct timeval timeout = {0, 50000};
+        if (select(nMax + 1, &fdsetRecv, nullptr, nullptr, &timeout) <= 0)
+            break;
+        for (int fd : vLocal) {
+            if (FD_ISSET(fd, &fdsetRecv) && read(fd, &ch, 1) != 1)
+                break;
+        }
+    }
+    CloseConnections(vLocal, vRemote);
+}
+
+#ifdef USE_EPOLL
+static void NetPollerEpoll(benchmark::State& state, int nConnections)
+{
+    std::vector<int> vLocal, vRemote;
+    int epollfd = epoll_create1(0);
+    if (epollfd == -1 || !OpenConnections(nConnections, vLocal, vRemote)) {
+        CloseConnections(vLocal, vRemote);
+        if (epollfd != -1)
+            close(epollfd);
+        return;
+    }
+    for (int fd : vLocal) {
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = fd;
+        epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    char ch = 0;
+    size_t nRound = 0;
+    epoll_event events[64];
+    while (state.KeepRunning()) {
+        if (write(vRemote[nRound++ % vRemote.size()], &ch, 1) != 1)
+            break;
+
+        int nEvents = epoll_wait(epollfd, events, 64, 50);
+        if (nEvents <= 0)
+            break;
+        for (int i = 0; i < nEvents; i++) {
+            if (read(events[i].data.fd, &ch, 1) != 1)
+                break;
+        }
+    }
+    CloseConnections(vLocal, vRemote);
+    close(epollfd);
+}
+#endif
+
+static void NetPollerSelect_32(benchmark::State& state) { NetPollerSelect(state, SMALL_CONNECTIONS); }
+static void NetPollerSelect_400(benchmark::State& state) { NetPollerSelect(state, LARGE_CONNECTIONS); }
+BENCHMARK(NetPollerSelect_32);
+BENCHMARK(NetPollerSelect_400);
+
+#ifdef USE_EPOLL
+static void NetPollerEpoll_32(benchmark::State& state) { NetPollerEpoll(state, SMALL_CONNECTIONS); }
+static void NetPollerEpoll_400(benchmark::State& state) { NetPollerEpoll(state, LARGE_CONNECTIONS); }
+BENCHMARK(NetPollerEpoll_32);
+BENCHMARK(NetPollerEpoll_400);
+#endif
+
+#endif // WIN32
@@ -0,0 +1,57 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "hash.h"
+#include "primitives/block.h"
+
+#include <vector>
+
+static void QuarkHash(benchmark::State& state)
+{
+    uint256 hashes[QUARK_BATCH_LANES];
+    std::vector<uint8_t> in(80 * QUARK_BATCH_LANES, 0);
+    while (state.KeepRunning()) {
+        for (size_t n = 0; n < QUARK_BATCH_LANES; n++)
+            hashes[n] = HashQuark(in.begin() + n * 80, in.begin() + (n + 1) * 80);
+    }
+}
+
+static void QuarkHashBatch(benchmark::State& state)
+{
+    uint256 hashes[QUARK_BATCH_LANES];
+    std::vector<uint8_t> in(80 * QUARK_BATCH_LANES, 0);
+    while (state.KeepRunning())
+        HashQuarkBatch(in.data(), 80, QUARK_BATCH_LANES, hashes);
+}
+
+// the miner loop, one header at a time and a nonce range at once
+static void QuarkBlockHeader(benchmark::State& state)
+{
+    uint256 hashes[QUARK_BATCH_LANES];
+    CBlockHeader header;
+    header.nVersion = 3;
+    while (state.KeepRunning()) {
+        for (size_t n = 0; n < QUARK_BATCH_LANES; n++) {
+            hashes[n] = header.GetHash();
+            header.nNonce++;
+        }
+    }
+}
+
+static void QuarkBlockHeaderNonces(benchmark::State& state)
+{
+    uint256 hashes[QUARK_BATCH_LANES];
+    CBlockHeader header;
+    header.nVersion = 3;
+    while (state.KeepRunning()) {
+        header.GetNonceHashes(header.nNonce, QUARK_BATCH_LANES, hashes);
+        header.nNonce += QUARK_BATCH_LANES;
+    }
+}
+
+BENCHMARK(QuarkHash);
+BENCHMARK(QuarkHashBatch);
+BENCHMARK(QuarkBlockHeader);
+BENCHMARK(QuarkBlockHeaderNonces);
@@ -19,7 +19,7 @@ bool SignBlock(CBlock& block, const CKeyStore& keystore)
     CKeyID keyID;
     if (block.IsProofOfWork()) {
         bool fFoundID = false;
-        for (const CTxOut& txout :block.vtx[0].vout) {
+        for (const CTxOut& txout :block.vtx[0]->vout) {
             if (!txout.GetKeyIDFromUTXO(keyID))
                 continue;
             fFoundID = true;
@@ -28,7 +28,7 @@ bool SignBlock(CBlock& block, const CKeyStore& keystore)
         if (!fFoundID)
             return error("%s: failed to find key for PoW", __func__);
     } else {
-        if (!block.vtx[1].vout[1].GetKeyIDFromUTXO(keyID))
+        if (!block.vtx[1]->vout[1].GetKeyIDFromUTXO(keyID))
             return error("%s: failed to find key for PoS", __func__);
     }
 
@@ -59,7 +59,7 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
 
     txnouttype whichType;
     std::vector<valtype> vSolutions;
-    const CTxOut& txout = block.vtx[1].vout[1];
+    const CTxOut& txout = block.vtx[1]->vout[1];
     if (!Solver(txout.scriptPubKey, whichType, vSolutions))
         return false;
 
@@ -70,11 +70,15 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
         }
     }
 
+    // verified before, e.g. by the block import workers
+    if (block.fSigChecked)
+        return true;
+
     if (whichType == TX_PUBKEY) {
         valtype& vchPubKey = vSolutions[0];
         pubkey = CPubKey(vchPubKey);
     } else if (whichType == TX_PUBKEYHASH) {
-        const CTxIn& txin = block.vtx[1].vin[0];
+        const CTxIn& txin = block.vtx[1]->vin[0];
         // Check if the scriptSig is for a p2pk or a p2pkh
         if (txin.scriptSig.size() == 73) { // Sig size + DER signature size.
             // If the input is for a p2pk and the output is a p2pkh.
@@ -90,5 +94,9 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
     if (!pubkey.IsValid())
         return error("%s: invalid pubkey %s", __func__, HexStr(pubkey));
 
-    return pubkey.Verify(block.GetHash(), block.vchBlockSig);
+    if (!pubkey.Verify(block.GetHash(), block.vchBlockSig))
+        return false;
+
+    block.fSigChecked = true;
+    return true;
 }
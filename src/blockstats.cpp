@@ -0,0 +1,141 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+CBlockStats& CBlockStats::operator+=(const CBlockStats& other)
+{
+    if (other.nTxCount > 0) {
+        nMinFeeRate = nTxCount > 0 ? std::min(nMinFeeRate, other.nMinFeeRate) : other.nMinFeeRate;
+        nMaxFeeRate = nTxCount > 0 ? std::max(nMaxFeeRate, other.nMaxFeeRate) : other.nMaxFeeRate;
+    }
+    nTxCount += other.nTxCount;
+    nTxCountAll += other.nTxCountAll;
+    nInputs += other.nInputs;
+    nOutputs += other.nOutputs;
+    nTxBytes += other.nTxBytes;
+    nFees += other.nFees;
+    nMint += other.nMint;
+    return *this;
+}
+
+void ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats)
+{
+    stats = CBlockStats();
+    stats.nTxCountAll = block.vtx.size();
+
+    CAmount nValueIn = 0;
+    CAmount nValueOut = 0;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        nValueOut += tx.GetValueOut();
+        if (tx.IsCoinBase())
+            continue;
+
+        CAmount nTxValueIn = 0;
+        for (const Coin& coin : blockundo.vtxundo[i - 1].vprevout)
+            nTxValueIn += coin.out.nValue;
+        nValueIn += nTxValueIn;
+        if (tx.IsCoinStake())
+            continue;
+
+        const CAmount nFee = nTxValueIn - tx.GetValueOut();
+        const size_t nSize = ::GetSerializeSize(tx, SER_NETWORK, CLIENT_VERSION);
+        const CAmount nFeeRate = CFeeRate(nFee, nSize).GetFeePerK();
+        stats.nMinFeeRate = stats.nTxCount > 0 ? std::min(stats.nMinFeeRate, nFeeRate) : nFeeRate;
+        stats.nMaxFeeRate = stats.nTxCount > 0 ? std::max(stats.nMaxFeeRate, nFeeRate) : nFeeRate;
+        stats.nTxCount++;
+        stats.nInputs += tx.vin.size();
+        stats.nOutputs += tx.vout.size();
+        stats.nTxBytes += nSize;
+        stats.nFees += nFee;
+    }
+    stats.nMint = nValueOut - nValueIn + stats.nFees;
+}
+
+static bool ReadBlockStats(const CBlockIndex* pindex, CBlockStats& stats)
+{
+    if (pblocktree->ReadBlockStats(pindex->GetBlockHash(), stats))
+        return true;
+
+    // Connected before the statistics were stored
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().GetHex());
+    CBlockUndo blockundo;
+    if (pindex->pprev && !UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().GetHex());
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data of block %s doesn't match it", __func__, pindex->GetBlockHash().GetHex());
+
+    ComputeBlockStats(block, blockundo, stats);
+    pblocktree->WriteBlockStats(pindex->GetBlockHash(), stats);
+    return true;
+}
+
+bool GetBlockStats(int nHeightStart, int nHeightEnd, CBlockStats& stats)
+{
+    const int64_t nStart = GetTimeMillis();
+
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nHeightStart; nHeight <= nHeightEnd; nHeight++) {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!pindex)
+                return false;
+            vIndex.push_back(pindex);
+        }
+    }
+
+    // Runs of consecutive blocks, each summed by whichever worker takes it
+    static const size_t CHUNK_SIZE = 256;
+    const size_t nChunks = (vIndex.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::vector<CBlockStats> vStats(nChunks);
+    std::atomic<size_t> nNextChunk{0};
+    std::atomic<bool> fOk{true};
+    auto sum = [&]() {
+        for (size_t nChunk = nNextChunk++; nChunk < nChunks && fOk; nChunk = nNextChunk++) {
+            const size_t nEnd = std::min(vIndex.size(), (nChunk + 1) * CHUNK_SIZE);
+            for (size_t i = nChunk * CHUNK_SIZE; i < nEnd; i++) {
+                CBlockStats blockstats;
+                if (!ReadBlockStats(vIndex[i], blockstats)) {
+                    fOk = false;
+                    break;
+                }
+                vStats[nChunk] += blockstats;
+            }
+        }
+    };
+    const int nThreads = std::max(1, std::min(GetNumCores(), (int)nChunks));
+    std::vector<std::thread> vWorkers;
+    for (int i = 1; i < nThreads; i++)
+        vWorkers.emplace_back(sum);
+    sum();
+    for (std::thread& worker : vWorkers)
+        worker.join();
+
+    if (!fOk)
+        return false;
+
+    stats = CBlockStats();
+    for (const CBlockStats& chunkstats : vStats)
+        stats += chunkstats;
+    LogPrint(BCLog::BENCH, "%s: %u blocks in %dms\n", __func__, vIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
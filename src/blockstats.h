@@ -0,0 +1,69 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTATS_H
+#define BITCOIN_BLOCKSTATS_H
+
+#include "amount.h"
+#include "serialize.h"
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+/**
+ * Fee and size statistics of a block, or of a range of blocks. Except for
+ * nTxCountAll and nMint, they are of the transactions other than the
+ * coinbase and coinstake.
+ */
+class CBlockStats
+{
+public:
+    int64_t nTxCount;
+    int64_t nTxCountAll;
+    int64_t nInputs;
+    int64_t nOutputs;
+    int64_t nTxBytes;
+    CAmount nFees;
+    //! lowest and highest fee per kB paid by a transaction, 0 without any
+    CAmount nMinFeeRate;
+    CAmount nMaxFeeRate;
+    //! value created by the coinbase and coinstake, fees included
+    CAmount nMint;
+
+    CBlockStats() : nTxCount(0), nTxCountAll(0), nInputs(0), nOutputs(0), nTxBytes(0), nFees(0), nMinFeeRate(0), nMaxFeeRate(0), nMint(0) {}
+
+    CBlockStats& operator+=(const CBlockStats& other);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nTxCount);
+        READWRITE(nTxCountAll);
+        READWRITE(nInputs);
+        READWRITE(nOutputs);
+        READWRITE(nTxBytes);
+        READWRITE(nFees);
+        READWRITE(nMinFeeRate);
+        READWRITE(nMaxFeeRate);
+        READWRITE(nMint);
+    }
+};
+
+/** Statistics of a block from the coins it spends, as recorded in its undo data */
+void ComputeBlockStats(const CBlock& block, const CBlockUndo& blockundo, CBlockStats& stats);
+
+/**
+ * Sum the statistics of the active chain blocks in [nHeightStart, nHeightEnd]
+ * on all cores. ConnectBlock stores them in the block tree database; those of
+ * blocks connected by an older version are computed from the block and undo
+ * files on first use, and stored as well.
+ */
+bool GetBlockStats(int nHeightStart, int nHeightEnd, CBlockStats& stats);
+
+#endif // BITCOIN_BLOCKSTATS_H
@@ -6,6 +6,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "hash.h"
+#include "memusage.h"
 #include "masternode.h"
 #include "masternodeman.h"
 #include "legacy/stakemodifier.h"  // for ComputeNextStakeModifier
@@ -77,7 +79,7 @@ CBlockIndex::CBlockIndex(const CBlock& block):
         nNonce{block.nNonce}
 {
     if(block.nVersion > 3 && block.nVersion < 7)
-        nAccumulatorCheckpoint = block.nAccumulatorCheckpoint;
+        SetAccumulatorCheckpoint(block.nAccumulatorCheckpoint);
     if (block.IsProofOfStake())
         SetProofOfStake();
 }
@@ -119,7 +121,7 @@ CBlockHeader CBlockIndex::GetBlockHeader() const
     block.nTime = nTime;
     block.nBits = nBits;
     block.nNonce = nNonce;
-    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+    if (nVersion > 3 && nVersion < 7) block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
     return block;
 }
 
@@ -181,10 +183,8 @@ bool CBlockIndex::SetStakeEntropyBit(unsigned int nEntropyBit)
 // Sets V1 stake modifier (uint64_t)
 void CBlockIndex::SetStakeModifier(const uint64_t nStakeModifier, bool fGeneratedStakeModifier)
 {
-    vStakeModifier.clear();
-    const size_t modSize = sizeof(nStakeModifier);
-    vStakeModifier.resize(modSize);
-    std::memcpy(vStakeModifier.data(), &nStakeModifier, modSize);
+    const unsigned char* pbegin = (const unsigned char*) &nStakeModifier;
+    SetStakeModifierBytes(pbegin, pbegin + sizeof(nStakeModifier));
     if (fGeneratedStakeModifier)
         nFlags |= BLOCK_STAKE_MODIFIER;
 
@@ -206,8 +206,7 @@ void CBlockIndex::SetNewStakeModifier()
 // Sets V2 stake modifiers (uint256)
 void CBlockIndex::SetStakeModifier(const uint256& nStakeModifier)
 {
-    vStakeModifier.clear();
-    vStakeModifier.insert(vStakeModifier.begin(), nStakeModifier.begin(), nStakeModifier.end());
+    SetStakeModifierBytes(nStakeModifier.begin(), nStakeModifier.end());
 }
 
 // Generates and sets new V2 stake modifier
@@ -227,23 +226,56 @@ void CBlockIndex::SetNewStakeModifier(const uint256& prevoutId)
 // Returns V1 stake modifier (uint64_t)
 uint64_t CBlockIndex::GetStakeModifierV1() const
 {
-    if (vStakeModifier.empty() || Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MODIFIER_V2))
+    const CBlockIndexCold& c = cold.Get();
+    if (c.nStakeModifierSize == 0 || Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MODIFIER_V2))
         return 0;
-    uint64_t nStakeModifier;
-    std::memcpy(&nStakeModifier, vStakeModifier.data(), vStakeModifier.size());
+    uint64_t nStakeModifier = 0;
+    std::memcpy(&nStakeModifier, c.vchStakeModifier, std::min((size_t) c.nStakeModifierSize, sizeof(nStakeModifier)));
     return nStakeModifier;
 }
 
 // Returns V2 stake modifier (uint256)
 uint256 CBlockIndex::GetStakeModifierV2() const
 {
-    if (vStakeModifier.empty() || !Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MODIFIER_V2))
+    const CBlockIndexCold& c = cold.Get();
+    if (c.nStakeModifierSize == 0 || !Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MODIFIER_V2))
         return UINT256_ZERO;
     uint256 nStakeModifier;
-    std::memcpy(nStakeModifier.begin(), vStakeModifier.data(), vStakeModifier.size());
+    std::memcpy(nStakeModifier.begin(), c.vchStakeModifier, c.nStakeModifierSize);
     return nStakeModifier;
 }
 
+std::vector<unsigned char> CBlockIndex::GetStakeModifierBytes() const
+{
+    const CBlockIndexCold& c = cold.Get();
+    return std::vector<unsigned char>(c.vchStakeModifier, c.vchStakeModifier + c.nStakeModifierSize);
+}
+
+void CBlockIndex::SetStakeModifierBytes(const unsigned char* pbegin, const unsigned char* pend)
+{
+    CBlockIndexCold& c = cold.Get();
+    assert(pend >= pbegin && (size_t) (pend - pbegin) <= sizeof(c.vchStakeModifier));
+    std::memset(c.vchStakeModifier, 0, sizeof(c.vchStakeModifier));
+    if (pend > pbegin)
+        std::memcpy(c.vchStakeModifier, pbegin, pend - pbegin);
+    c.nStakeModifierSize = pend - pbegin;
+}
+
+Optional<CAmount> CBlockIndex::GetMoneySupply() const
+{
+    const CBlockIndexCold& c = cold.Get();
+    if (!c.fHaveMoneySupply)
+        return nullopt;
+    return c.nMoneySupply;
+}
+
+void CBlockIndex::SetMoneySupply(const Optional<CAmount>& nMoneySupplyIn)
+{
+    CBlockIndexCold& c = cold.Get();
+    c.fHaveMoneySupply = (bool) nMoneySupplyIn;
+    c.nMoneySupply = nMoneySupplyIn ? *nMoneySupplyIn : 0;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
 CScript CBlockIndex::GetPaidPayee() const
@@ -258,6 +290,12 @@ CScript CBlockIndex::GetPaidPayee() const
     return CScript();
 }
 
+void CBlockIndex::SetPaidPayee(const CScript& paidPayee)
+{
+    hashPaidPayee = Hash160(paidPayee.begin(), paidPayee.end());
+    nFlags |= BLOCK_PAID_PAYEE;
+}
+
 //! Check whether this block index entry is valid up to the passed validity level.
 bool CBlockIndex::IsValid(enum BlockStatus nUpTo) const
 {
@@ -283,3 +321,55 @@ bool CBlockIndex::RaiseValidity(enum BlockStatus nUpTo)
 
 
 
+
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    if (!vFree.empty()) {
+        CBlockIndex* pindex = vFree.back();
+        vFree.pop_back();
+        return pindex;
+    }
+    if (nChunkLeft == 0)
+        Reserve(CHUNK_SIZE);
+    nChunkLeft--;
+    return pChunkNext++;
+}
+
+void CBlockIndexArena::Free(CBlockIndex* pindex)
+{
+    *pindex = CBlockIndex();
+    vFree.push_back(pindex);
+}
+
+void CBlockIndexArena::Clear()
+{
+    vFree.clear();
+    vChunks.clear();
+    pChunkNext = nullptr;
+    nChunkLeft = 0;
+}
+
+void CBlockIndexArena::Reserve(size_t n)
+{
+    if (nChunkLeft >= n)
+        return;
+    // the rest of the current chunk is not worth tracking
+    const size_t nSize = std::max(n, CHUNK_SIZE);
+    Chunk chunk;
+    chunk.nSize = nSize;
+    chunk.entries.reset(new CBlockIndex[nSize]);
+    chunk.cold.reset(new CBlockIndexCold[nSize]);
+    for (size_t i = 0; i < nSize; i++)
+        chunk.entries[i].cold.Bind(&chunk.cold[i]);
+    pChunkNext = chunk.entries.get();
+    nChunkLeft = nSize;
+    vChunks.push_back(std::move(chunk));
+}
+
+size_t CBlockIndexArena::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vFree);
+    for (const Chunk& chunk : vChunks)
+        nUsage += memusage::MallocUsage(chunk.nSize * sizeof(CBlockIndex)) + memusage::MallocUsage(chunk.nSize * sizeof(CBlockIndexCold));
+    return nUsage;
+}
@@ -14,11 +14,13 @@
 #include "chainparams.h"
 #include "pow.h"
 #include "primitives/block.h"
+#include "streams.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <memory>
 #include <vector>
 
 class CBlockFileInfo
@@ -165,6 +167,84 @@ enum {
     BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
     BLOCK_STAKE_ENTROPY = (1 << 1),  // entropy bit for stake modifier
     BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
+    BLOCK_PAID_PAYEE = (1 << 3),     // hashPaidPayee is set
+};
+
+/**
+ * Block index fields that are only read when staking, computing rewards or
+ * writing the entry to disk. They are kept out of CBlockIndex, so that the
+ * entries walked by the chain traversals stay small.
+ */
+struct CBlockIndexCold
+{
+    uint256 nAccumulatorCheckpoint{};
+    //! stake modifier bytes: 8 for modifier V1, 32 for V2, none for PoW blocks
+    unsigned char vchStakeModifier[32] = {};
+    unsigned char nStakeModifierSize{0};
+    bool fHaveMoneySupply{true};
+    CAmount nMoneySupply{0};
+};
+
+/**
+ * Handle to the cold fields of a block index entry. Entries handed out by
+ * CBlockIndexArena point to a slot of the arena. Any other instance (disk
+ * entries, temporaries) allocates its own on the first write. Copies copy
+ * the fields, never the slot.
+ */
+class CBlockIndexColdRef
+{
+private:
+    friend class CBlockIndexArena;
+
+    CBlockIndexCold* pcold{nullptr};
+    bool fOwned{false};
+
+    void Bind(CBlockIndexCold* pslot)
+    {
+        if (fOwned)
+            delete pcold;
+        pcold = pslot;
+        fOwned = false;
+    }
+
+public:
+    CBlockIndexColdRef() {}
+    CBlockIndexColdRef(const CBlockIndexColdRef& other)
+    {
+        if (other.pcold) {
+            pcold = new CBlockIndexCold(*other.pcold);
+            fOwned = true;
+        }
+    }
+    CBlockIndexColdRef& operator=(const CBlockIndexColdRef& other)
+    {
+        if (this != &other) {
+            if (other.pcold)
+                Get() = *other.pcold;
+            else if (pcold)
+                *pcold = CBlockIndexCold();
+        }
+        return *this;
+    }
+    ~CBlockIndexColdRef()
+    {
+        if (fOwned)
+            delete pcold;
+    }
+
+    const CBlockIndexCold& Get() const
+    {
+        static const CBlockIndexCold empty;
+        return pcold ? *pcold : empty;
+    }
+    CBlockIndexCold& Get()
+    {
+        if (!pcold) {
+            pcold = new CBlockIndexCold();
+            fOwned = true;
+        }
+        return *pcold;
+    }
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -212,13 +292,10 @@ public:
     unsigned int nStatus{0};
 
     // proof-of-stake specific fields
-    // char vector holding the stake modifier bytes. It is empty for PoW blocks.
-    // Modifier V1 is 64 bit while modifier V2 is 256 bit.
-    std::vector<unsigned char> vStakeModifier{};
     unsigned int nFlags{0};
 
-    //! Money supply at this block.
-    Optional<CAmount> nMoneySupply{0};
+    //! Hash160 of the script paid as masternode reward in this block, when BLOCK_PAID_PAYEE is set
+    uint160 hashPaidPayee{};
 
     //! block header
     int nVersion{0};
@@ -226,11 +303,13 @@ public:
     unsigned int nTime{0};
     unsigned int nBits{0};
     unsigned int nNonce{0};
-    uint256 nAccumulatorCheckpoint{};
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     uint32_t nSequenceId{0};
 
+    //! stake modifier, money supply and accumulator checkpoint
+    CBlockIndexColdRef cold{};
+
     CBlockIndex() {}
     CBlockIndex(const CBlock& block);
 
@@ -260,7 +339,19 @@ public:
     void SetNewStakeModifier(const uint256& prevoutId);     // generates and sets new v2 modifier
     uint64_t GetStakeModifierV1() const;
     uint256 GetStakeModifierV2() const;
+    //! Raw stake modifier bytes. Modifier V1 is 64 bit while modifier V2 is 256 bit.
+    std::vector<unsigned char> GetStakeModifierBytes() const;
+    void SetStakeModifierBytes(const unsigned char* pbegin, const unsigned char* pend);
+
+    //! Money supply at this block.
+    Optional<CAmount> GetMoneySupply() const;
+    void SetMoneySupply(const Optional<CAmount>& nMoneySupplyIn);
+
+    uint256 GetAccumulatorCheckpoint() const { return cold.Get().nAccumulatorCheckpoint; }
+    void SetAccumulatorCheckpoint(const uint256& nCheckpoint) { cold.Get().nAccumulatorCheckpoint = nCheckpoint; }
     CScript GetPaidPayee() const;
+    bool HasPaidPayee() const { return (nFlags & BLOCK_PAID_PAYEE); }
+    void SetPaidPayee(const CScript& paidPayee);
 
     //! Check whether this block index entry is valid up to the passed validity level.
     bool IsValid(enum BlockStatus nUpTo = BLOCK_VALID_TRANSACTIONS) const;
@@ -274,6 +365,41 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/**
+ * Owner of the block index entries. They are handed out from large chunks
+ * instead of being allocated one by one, and freed entries are reused.
+ * The cold fields of the entries live in a parallel array of each chunk.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 4096;
+
+    struct Chunk {
+        size_t nSize;
+        std::unique_ptr<CBlockIndex[]> entries;
+        std::unique_ptr<CBlockIndexCold[]> cold;
+    };
+
+    std::vector<Chunk> vChunks;
+    //! next entry of the last chunk not handed out yet, and how many are left
+    CBlockIndex* pChunkNext{nullptr};
+    size_t nChunkLeft{0};
+    std::vector<CBlockIndex*> vFree;
+
+public:
+    //! Return a default constructed entry
+    CBlockIndex* Allocate();
+    //! Reset an entry and keep it for reuse
+    void Free(CBlockIndex* pindex);
+    //! Release every entry at once
+    void Clear();
+    //! Make room for n more entries in one chunk
+    void Reserve(size_t n);
+
+    size_t DynamicMemoryUsage() const;
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 
 // New serialization introduced on PIVX
@@ -281,6 +407,16 @@ static const int DBI_SER_VERSION_NO_MS = 1004000;   // removes nMoneySupply from
 // New serialization introduced on DSW
 static const int DBI_SER_VERSION_MS = 1050200;   // reintroduces the nMoneySupply to the persisted block index
 
+// Fields appended to the persisted block index, versioned on their own. Older
+// versions ignore them when reading and drop them when rewriting an entry.
+static const int DBI_EXT_VERSION_PAID_PAYEE = 1;   // adds hashPaidPayee
+static const int DBI_EXT_VERSION = DBI_EXT_VERSION_PAID_PAYEE;
+
+//! Whether a stream being read has data left, i.e. fields appended by a newer version
+template <typename Stream>
+inline bool StreamHasMoreData(const Stream& s) { return false; }
+inline bool StreamHasMoreData(const CDataStream& s) { return !s.empty(); }
+
 class CDiskBlockIndex : public CBlockIndex
 {
 public:
@@ -315,11 +451,21 @@ public:
         if (nStatus & BLOCK_HAVE_UNDO)
             READWRITE(VARINT(nUndoPos));
 
+        // the cold fields go through copies
+        std::vector<unsigned char> vStakeModifier = GetStakeModifierBytes();
+        Optional<CAmount> nMoneySupply = GetMoneySupply();
+        uint256 nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
+
         if (nSerVersion >= DBI_SER_VERSION_NO_MS) {
             // Serialization with CLIENT_VERSION >= DBI_SER_VERSION_NO_MS
             READWRITE(nFlags);
             READWRITE(this->nVersion);
             READWRITE(vStakeModifier);
+            if (ser_action.ForRead()) {
+                if (vStakeModifier.size() > sizeof(CBlockIndexCold::vchStakeModifier))
+                    throw std::ios_base::failure("CDiskBlockIndex: stake modifier too large");
+                SetStakeModifierBytes(vStakeModifier.data(), vStakeModifier.data() + vStakeModifier.size());
+            }
             READWRITE(hashPrev);
             READWRITE(hashMerkleRoot);
             READWRITE(nTime);
@@ -328,10 +474,27 @@ public:
 
             if(this->nVersion > 3 && this->nVersion < 7) {
                 READWRITE(nAccumulatorCheckpoint);
+                if (ser_action.ForRead())
+                    SetAccumulatorCheckpoint(nAccumulatorCheckpoint);
             }
 
             if (this->nVersion >= 7 && nSerVersion >= DBI_SER_VERSION_MS) {
                 READWRITE(nMoneySupply);
+                if (ser_action.ForRead())
+                    SetMoneySupply(nMoneySupply);
+            }
+
+            int nExtVersion = DBI_EXT_VERSION;
+            if (ser_action.ForRead() && !StreamHasMoreData(s))
+                nExtVersion = 0;
+            else
+                READWRITE(VARINT(nExtVersion));
+            if (nExtVersion >= DBI_EXT_VERSION_PAID_PAYEE) {
+                READWRITE(hashPaidPayee);
+            } else if (ser_action.ForRead()) {
+                // older versions keep the flag bit but drop the hash
+                nFlags &= ~BLOCK_PAID_PAYEE;
+                hashPaidPayee.SetNull();
             }
 
         } else if (ser_action.ForRead()) {
@@ -340,6 +503,7 @@ public:
             uint256 hashNext{};
             READWRITE(nMint);
             READWRITE(nMoneySupply);
+            SetMoneySupply(nMoneySupply);
             READWRITE(nFlags);
             if (!Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MODIFIER_V2)) {
                 uint64_t nStakeModifier = 0;
@@ -365,6 +529,7 @@ public:
             READWRITE(nNonce);
             if(this->nVersion > 3) {
                 READWRITE(nAccumulatorCheckpoint);
+                SetAccumulatorCheckpoint(nAccumulatorCheckpoint);
             }
         }
     }
@@ -380,7 +545,7 @@ public:
         block.nBits = nBits;
         block.nNonce = nNonce;
         if (nVersion > 3 && nVersion < 7)
-            block.nAccumulatorCheckpoint = nAccumulatorCheckpoint;
+            block.nAccumulatorCheckpoint = GetAccumulatorCheckpoint();
         return block.GetHash();
     }
 
@@ -0,0 +1,357 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinstats.h"
+
+#include "base58.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "hash.h"
+#include "init.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// All guarded by cs_main
+static CCoinsViewDB* pcoinsdbStats = nullptr;
+//! Statistics of the coins at hashUTXOStatsBlock. While fUTXOStatsComplete is
+//! unset, only of the coins created and spent since the snapshot of a scan.
+static CUTXOStats utxostats;
+static uint256 hashUTXOStatsBlock;
+static bool fUTXOStatsFollowing = false;
+static bool fUTXOStatsComplete = false;
+//! Bumped whenever the statistics are reset, so a scan can tell its snapshot is no longer followed
+static uint64_t nUTXOStatsEpoch = 0;
+
+static std::string GetBurnAddress(const CScript& scriptPubKey)
+{
+    const auto& mBurnAddresses = Params().GetConsensus().mBurnAddresses;
+    if (mBurnAddresses.empty())
+        return "";
+
+    CTxDestination dest;
+    if (!ExtractDestination(scriptPubKey, dest))
+        return "";
+    const std::string addr = EncodeDestination(dest);
+    return mBurnAddresses.count(addr) ? addr : "";
+}
+
+static void UpdateBucket(CCoinsStatsBucket& bucket, const COutPoint& outpoint, const Coin& coin, int nSign)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << (uint32_t)(coin.nHeight * 4 + (coin.fCoinBase ? 2 : 0) + (coin.fCoinStake ? 1 : 0));
+    ss << coin.out;
+    if (nSign > 0)
+        bucket.muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    else
+        bucket.muhash.Remove((const unsigned char*)&ss[0], ss.size());
+
+    bucket.nTxOuts += nSign;
+    bucket.nTotalAmount += nSign * coin.out.nValue;
+    // txid, output index, height and flags, amount, script length and script
+    bucket.nBogoSize += nSign * (int64_t)(32 + 4 + 4 + 8 + 2 + coin.out.scriptPubKey.size());
+}
+
+void CCoinsStatsBucket::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    UpdateBucket(*this, outpoint, coin, 1);
+}
+
+void CCoinsStatsBucket::SpendCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    UpdateBucket(*this, outpoint, coin, -1);
+}
+
+CCoinsStatsBucket& CCoinsStatsBucket::operator+=(const CCoinsStatsBucket& other)
+{
+    nTxOuts += other.nTxOuts;
+    nTotalAmount += other.nTotalAmount;
+    nBogoSize += other.nBogoSize;
+    muhash *= other.muhash;
+    return *this;
+}
+
+CCoinsStatsBucket& CCoinsStatsBucket::operator-=(const CCoinsStatsBucket& other)
+{
+    nTxOuts -= other.nTxOuts;
+    nTotalAmount -= other.nTotalAmount;
+    nBogoSize -= other.nBogoSize;
+    muhash /= other.muhash;
+    return *this;
+}
+
+void CUTXOStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    const std::string addr = GetBurnAddress(coin.out.scriptPubKey);
+    (addr.empty() ? spendable : mapBurned[addr]).AddCoin(outpoint, coin);
+}
+
+void CUTXOStats::SpendCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    const std::string addr = GetBurnAddress(coin.out.scriptPubKey);
+    (addr.empty() ? spendable : mapBurned[addr]).SpendCoin(outpoint, coin);
+}
+
+CUTXOStats& CUTXOStats::operator+=(const CUTXOStats& other)
+{
+    spendable += other.spendable;
+    for (const auto& it : other.mapBurned)
+        mapBurned[it.first] += it.second;
+    return *this;
+}
+
+CCoinsStatsBucket CUTXOStats::Get(int nHeight) const
+{
+    const auto& mBurnAddresses = Params().GetConsensus().mBurnAddresses;
+
+    CCoinsStatsBucket bucket = spendable;
+    for (const auto& it : mapBurned) {
+        auto burn = mBurnAddresses.find(it.first);
+        if (burn == mBurnAddresses.end() || burn->second >= nHeight)
+            bucket += it.second;
+    }
+    return bucket;
+}
+
+static void ResetUTXOStats(const uint256& hashBlock, bool fFollowing, bool fComplete)
+{
+    AssertLockHeld(cs_main);
+    utxostats = CUTXOStats();
+    hashUTXOStatsBlock = hashBlock;
+    fUTXOStatsFollowing = fFollowing;
+    fUTXOStatsComplete = fComplete;
+    nUTXOStatsEpoch++;
+}
+
+void SetUTXOStatsDB(CCoinsViewDB* pcoinsdbviewIn)
+{
+    LOCK(cs_main);
+    pcoinsdbStats = pcoinsdbviewIn;
+    ResetUTXOStats(UINT256_ZERO, false, false);
+    if (!pcoinsdbStats)
+        return;
+
+    const uint256 hashBestBlock = pcoinsdbStats->GetBestBlock();
+    if (hashBestBlock.IsNull()) {
+        // no coins yet, follow them from the start
+        ResetUTXOStats(hashBestBlock, true, true);
+        return;
+    }
+
+    uint256 hashBlock;
+    CUTXOStats stats;
+    if (pcoinsdbStats->ReadUTXOStats(hashBlock, stats) && hashBlock == hashBestBlock) {
+        ResetUTXOStats(hashBestBlock, true, true);
+        utxostats = stats;
+    } else {
+        LogPrintf("%s: no UTXO set statistics stored at block %s, they will be computed on first use\n", __func__, hashBestBlock.GetHex());
+    }
+}
+
+static bool UpdateUTXOStats(const uint256& hashFrom, const uint256& hashTo, const CUTXOStats& delta)
+{
+    AssertLockHeld(cs_main);
+    if (!pcoinsdbStats || !fUTXOStatsFollowing)
+        return true;
+
+    if (hashUTXOStatsBlock != hashFrom) {
+        ResetUTXOStats(UINT256_ZERO, false, false);
+        return false;
+    }
+
+    utxostats += delta;
+    hashUTXOStatsBlock = hashTo;
+    if (fUTXOStatsComplete)
+        pcoinsdbStats->WriteUTXOStats(hashUTXOStatsBlock, utxostats);
+    return true;
+}
+
+bool ConnectUTXOStats(const CBlockIndex* pindex, const CUTXOStats& delta)
+{
+    return UpdateUTXOStats(pindex->pprev ? pindex->pprev->GetBlockHash() : UINT256_ZERO, pindex->GetBlockHash(), delta);
+}
+
+bool DisconnectUTXOStats(const CBlockIndex* pindex, const CUTXOStats& delta)
+{
+    return UpdateUTXOStats(pindex->GetBlockHash(), pindex->pprev ? pindex->pprev->GetBlockHash() : UINT256_ZERO, delta);
+}
+
+bool GetUTXOStats(CUTXOStats& stats, uint256& hashBlock)
+{
+    {
+        LOCK(cs_main);
+        if (!pcoinsdbStats)
+            return false;
+        if (fUTXOStatsComplete) {
+            stats = utxostats;
+            hashBlock = hashUTXOStatsBlock;
+            return true;
+        }
+    }
+
+    return ScanUTXOStats(stats, hashBlock);
+}
+
+static void ApplySerializedStats(CUTXOSerializedStats& serialized, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    const Coin& coin = outputs.begin()->second;
+    ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2 : 0) + (coin.fCoinStake ? 1 : 0));
+    serialized.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << *(const CScriptBase*)(&output.second.out.scriptPubKey);
+        ss << VARINT(output.second.out.nValue);
+    }
+    ss << VARINT(0);
+}
+
+//! Hash the coins of the snapshot one transaction at a time, in key order, without those burned before nHeight
+static bool ScanSerializedStats(CCoinsViewDB* pcoinsdb, const CDBSnapshot& snapshot, const uint256& hashBlock, int nHeight, CUTXOSerializedStats& serialized)
+{
+    const auto& mBurnAddresses = Params().GetConsensus().mBurnAddresses;
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdb->Cursor(snapshot, UINT256_ZERO));
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    serialized = CUTXOSerializedStats();
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    for (size_t nCoins = 0; pcursor->Valid(); pcursor->Next(), nCoins++) {
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin) || (nCoins % 1000 == 0 && ShutdownRequested()))
+            return false;
+        const std::string addr = GetBurnAddress(coin.out.scriptPubKey);
+        if (!addr.empty() && mBurnAddresses.at(addr) < nHeight)
+            continue;
+        if (!outputs.empty() && key.hash != prevkey) {
+            ApplySerializedStats(serialized, ss, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = std::move(coin);
+    }
+    if (!outputs.empty())
+        ApplySerializedStats(serialized, ss, prevkey, outputs);
+    serialized.hashSerialized = ss.GetHash();
+    return true;
+}
+
+bool ScanUTXOStats(CUTXOStats& stats, uint256& hashBlock, CUTXOSerializedStats* pserialized, CUTXOStats* pcached, bool* pfCached)
+{
+    const int64_t nStart = GetTimeMillis();
+
+    CCoinsViewDB* pcoinsdb;
+    std::unique_ptr<CDBSnapshot> psnapshot;
+    bool fSeed;
+    uint64_t nEpoch;
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        if (!pcoinsdbStats)
+            return false;
+        // the snapshot has to hold the coins tip, for the followed changes to start from it
+        FlushStateToDisk();
+        pcoinsdb = pcoinsdbStats;
+        psnapshot = pcoinsdb->GetSnapshot();
+        hashBlock = pcoinsdb->GetBestBlock(*psnapshot);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it != mapBlockIndex.end())
+            nHeight = it->second->nHeight;
+
+        const bool fCached = fUTXOStatsComplete && hashUTXOStatsBlock == hashBlock;
+        if (pfCached)
+            *pfCached = fCached;
+        if (pcached && fCached)
+            *pcached = utxostats;
+
+        fSeed = !fUTXOStatsComplete;
+        if (fSeed)
+            ResetUTXOStats(hashBlock, true, false);
+        nEpoch = nUTXOStatsEpoch;
+    }
+
+    // Shards of the txid space by first byte, so that no transaction straddles two of them
+    static const int SHARDS = 64;
+    std::vector<CUTXOStats> vStats(SHARDS);
+    std::vector<uint64_t> vTransactions(SHARDS, 0);
+    std::atomic<int> nNextShard{0};
+    std::atomic<bool> fOk{true};
+    auto scan = [&]() {
+        for (int nShard = nNextShard++; nShard < SHARDS && fOk; nShard = nNextShard++) {
+            uint256 hashBegin;
+            hashBegin.begin()[0] = nShard * 256 / SHARDS;
+            const int nEnd = (nShard + 1) * 256 / SHARDS;
+
+            std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdb->Cursor(*psnapshot, hashBegin));
+            uint256 hashPrev;
+            for (size_t nCoins = 0; pcursor->Valid(); pcursor->Next(), nCoins++) {
+                COutPoint key;
+                Coin coin;
+                if (!pcursor->GetKey(key) || key.hash.begin()[0] >= nEnd)
+                    break;
+                if (!pcursor->GetValue(coin) || (nCoins % 1000 == 0 && ShutdownRequested())) {
+                    fOk = false;
+                    break;
+                }
+                vStats[nShard].AddCoin(key, coin);
+                if (vTransactions[nShard] == 0 || key.hash != hashPrev)
+                    vTransactions[nShard]++;
+                hashPrev = key.hash;
+            }
+        }
+    };
+    const int nThreads = std::max(1, std::min(GetNumCores(), SHARDS));
+    std::vector<std::thread> vWorkers;
+    if (pserialized) {
+        // the legacy hash can't be split, it walks the whole set next to the shards
+        vWorkers.emplace_back([&]() {
+            if (!ScanSerializedStats(pcoinsdb, *psnapshot, hashBlock, nHeight, *pserialized))
+                fOk = false;
+        });
+    }
+    for (int i = 1; i < nThreads; i++)
+        vWorkers.emplace_back(scan);
+    scan();
+    for (std::thread& worker : vWorkers)
+        worker.join();
+    psnapshot.reset();
+
+    if (!fOk)
+        return error("%s: unable to read the coins database", __func__);
+
+    stats = CUTXOStats();
+    uint64_t nTransactions = 0;
+    for (int i = 0; i < SHARDS; i++) {
+        stats += vStats[i];
+        nTransactions += vTransactions[i];
+    }
+    LogPrint(BCLog::COINDB, "%s: scanned %u transactions at block %s in %dms\n", __func__, nTransactions, hashBlock.GetHex(), GetTimeMillis() - nStart);
+
+    if (fSeed) {
+        LOCK(cs_main);
+        if (nEpoch == nUTXOStatsEpoch) {
+            // the coins of the snapshot, plus those created and spent since
+            const CUTXOStats delta = utxostats;
+            utxostats = stats;
+            utxostats += delta;
+            fUTXOStatsComplete = true;
+            pcoinsdbStats->WriteUTXOStats(hashUTXOStatsBlock, utxostats);
+            LogPrintf("%s: UTXO set statistics computed at block %s\n", __func__, hashBlock.GetHex());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include "amount.h"
+#include "coins.h"
+#include "crypto/muhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+class CBlockIndex;
+class CCoinsViewDB;
+
+/** Count, value, size and set hash of some unspent coins. Spending a coin undoes adding it. */
+class CCoinsStatsBucket
+{
+public:
+    int64_t nTxOuts;
+    CAmount nTotalAmount;
+    //! a size of the coins that doesn't depend on the database encoding
+    int64_t nBogoSize;
+    MuHash3072 muhash;
+
+    CCoinsStatsBucket() : nTxOuts(0), nTotalAmount(0), nBogoSize(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void SpendCoin(const COutPoint& outpoint, const Coin& coin);
+
+    CCoinsStatsBucket& operator+=(const CCoinsStatsBucket& other);
+    CCoinsStatsBucket& operator-=(const CCoinsStatsBucket& other);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nTxOuts);
+        READWRITE(nTotalAmount);
+        READWRITE(nBogoSize);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * Statistics of the unspent coins, or of the coins created and spent by some
+ * blocks. Coins paying to a burn address are kept apart by address, since
+ * they leave the statistics once the address is past its burn height.
+ */
+class CUTXOStats
+{
+public:
+    CCoinsStatsBucket spendable;
+    std::map<std::string, CCoinsStatsBucket> mapBurned;
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void SpendCoin(const COutPoint& outpoint, const Coin& coin);
+
+    CUTXOStats& operator+=(const CUTXOStats& other);
+
+    //! The coins counted at nHeight: without those of the addresses burned before it
+    CCoinsStatsBucket Get(int nHeight) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(spendable);
+        READWRITE(mapBurned);
+    }
+};
+
+/**
+ * Follow the statistics of the coins tip block by block, staging them in the
+ * chainstate database so that they are committed together with the coins.
+ * Reading them is then a copy. When they don't match the coins on disk (first
+ * run, or a chainstate written by an older version) the first reader scans
+ * the database once.
+ */
+void SetUTXOStatsDB(CCoinsViewDB* pcoinsdbviewIn);
+bool ConnectUTXOStats(const CBlockIndex* pindex, const CUTXOStats& delta);
+bool DisconnectUTXOStats(const CBlockIndex* pindex, const CUTXOStats& delta);
+bool GetUTXOStats(CUTXOStats& stats, uint256& hashBlock);
+
+/** The transaction count and serialized hash of the set, as gettxoutsetinfo reported them before MuHash */
+struct CUTXOSerializedStats
+{
+    uint64_t nTransactions{0};
+    uint256 hashSerialized{};
+};
+
+/**
+ * Recompute the statistics from a snapshot of the coins database, scanning
+ * ranges of txids on all cores. pserialized, if set, receives the legacy
+ * statistics, which need one more walk of the whole set in order. pcached,
+ * if set, receives the followed statistics at the same block, and fCached
+ * whether they were known.
+ */
+bool ScanUTXOStats(CUTXOStats& stats, uint256& hashBlock, CUTXOSerializedStats* pserialized = nullptr, CUTXOStats* pcached = nullptr, bool* pfCached = nullptr);
+
+#endif // BITCOIN_COINSTATS_H
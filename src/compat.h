@@ -47,6 +47,11 @@
 #include <unistd.h>
 #endif
 
+// Linux edge-triggered socket events for the network thread (-netpoller=epoll)
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_EPOLL 1
+#endif
+
 #ifdef WIN32
 #define MSG_DONTWAIT 0
 #else
@@ -0,0 +1,188 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <limits>
+#include <string.h>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+const int LIMB_SIZE = Num3072::LIMB_SIZE;
+const int LIMB_BYTES = LIMB_SIZE / 8;
+/** 2^3072 - MAX_PRIME_DIFF is the modulus, so 2^3072 is congruent to MAX_PRIME_DIFF */
+const limb_t MAX_PRIME_DIFF = 1103717;
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = 0;
+        for (int j = LIMB_BYTES - 1; j >= 0; --j)
+            limb = (limb << 8) | data[i * LIMB_BYTES + j];
+        limbs[i] = limb;
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = limbs[i];
+        for (int j = 0; j < LIMB_BYTES; ++j) {
+            out[i * LIMB_BYTES + j] = limb & 0xff;
+            limb >>= 8;
+        }
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i)
+        limbs[i] = 0;
+}
+
+/** Whether the number is at least the modulus (it is always below 2^3072). */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] < std::numeric_limits<limb_t>::max() - MAX_PRIME_DIFF + 1)
+        return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != std::numeric_limits<limb_t>::max())
+            return false;
+    }
+    return true;
+}
+
+/** Subtract the modulus from a number in [p, 2^3072): add 2^3072 - p and drop the carry. */
+void Num3072::FullReduce()
+{
+    AddMultipleOfOverflow(1);
+}
+
+/** Add n * 2^3072 mod p, i.e. n * MAX_PRIME_DIFF, and return the carry out of the top limb. */
+Num3072::limb_t Num3072::AddMultipleOfOverflow(limb_t n)
+{
+    double_limb_t t = (double_limb_t)n * MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && t != 0; ++i) {
+        t += limbs[i];
+        limbs[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+    return (limb_t)t;
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t product[2 * LIMBS];
+    for (int i = 0; i < LIMBS; ++i)
+        product[i] = 0;
+
+    // Schoolbook product; a limb times a limb plus two limbs fits a double limb
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            carry += (double_limb_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)carry;
+    }
+
+    // low + high * 2^3072 == low + high * MAX_PRIME_DIFF, leaving a carry below 2^22
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (double_limb_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+
+    // Fold the carry back in; a second carry leaves the low limbs small, so it can't recur
+    limb_t n = (limb_t)carry;
+    while (n != 0)
+        n = AddMultipleOfOverflow(n);
+
+    // Products are kept below the modulus so that ToBytes is canonical
+    if (IsOverflow())
+        FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // a^(p - 2) by left to right square and multiply. The exponent's limbs
+    // are all ones but the lowest, which is 2^LIMB_SIZE - MAX_PRIME_DIFF - 2.
+    Num3072 out;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const limb_t exp = i == 0 ? (limb_t)(0 - MAX_PRIME_DIFF - 2) : std::numeric_limits<limb_t>::max();
+        for (int bit = LIMB_SIZE - 1; bit >= 0; --bit) {
+            out.Multiply(out);
+            if ((exp >> bit) & 1)
+                out.Multiply(*this);
+        }
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char tmp[Num3072::BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(tmp, sizeof(tmp));
+    return Num3072(tmp);
+}
+
+MuHash3072::MuHash3072(const unsigned char* data, size_t len)
+{
+    numerator = ToNum3072(data, len);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(uint256& out)
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** Number modulo the prime 2^3072 - 1103717, the largest 3072 bit safe prime. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    //! Interpret BYTE_SIZE bytes as a little endian number
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+    Num3072() { SetToOne(); }
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[BYTE_SIZE];
+        ToBytes(data);
+        s.write((const char*)data, BYTE_SIZE);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[BYTE_SIZE];
+        s.read((char*)data, BYTE_SIZE);
+        *this = Num3072(data);
+    }
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+    limb_t AddMultipleOfOverflow(limb_t n);
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a set of byte strings that doesn't depend on their order, and
+ * that can be updated when an element is added or removed. Each element is
+ * mapped to a number modulo a 3072 bit prime (SHA256, then 384 bytes of
+ * ChaCha20 keystream under that key) and the set hash is the SHA256 of the
+ * product of the numbers of its elements. Removals are kept in a separate
+ * denominator so that the expensive modular inverse is taken only in
+ * Finalize. Sets can be combined with *= and /=.
+ *
+ * See https://cseweb.ucsd.edu/~mihir/papers/inchash.pdf and
+ * https://lists.linuxfoundation.org/pipermail/bitcoin-dev/2017-May/014337.html
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    //! The hash of the empty set
+    MuHash3072() {}
+    //! The hash of the set with a single element
+    MuHash3072(const unsigned char* data, size_t len);
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Union of the two sets
+    MuHash3072& operator*=(const MuHash3072& mul);
+    //! Difference of the two sets
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    void Finalize(uint256& out);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
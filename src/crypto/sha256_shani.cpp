@@ -0,0 +1,155 @@
+// Copyright (c) 2018-2019 The Bitcoin Core developers
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Based on https://github.com/noloader/SHA-Intrinsics/blob/master/sha256-x86.c,
+// Written and place in public domain by Jeffrey Walton.
+// Based on code from Intel, and by Sean Gulley for the miTLS project.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/pivx-config.h"
+#endif
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace
+{
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Four rounds, using the schedule words in msg. */
+void inline QuadRound(__m128i& state0, __m128i& state1, __m128i msg, int group)
+{
+    msg = _mm_add_epi32(msg, _mm_load_si128((const __m128i*)&K[4 * group]));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** Compute the next 4 schedule words in place; m holds the previous 16 as a ring of 4 vectors. */
+void inline ShiftMessage(__m128i* m, int group)
+{
+    __m128i& cur = m[group & 3];
+    const __m128i next = m[(group + 1) & 3];
+    const __m128i prev2 = m[(group + 2) & 3];
+    const __m128i prev1 = m[(group + 3) & 3];
+    cur = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(cur, next), _mm_alignr_epi8(prev1, prev2, 4)), prev1);
+}
+
+/** Run the 64 rounds over the message words in m, adding the result into the state. */
+void inline Rounds(__m128i& state0, __m128i& state1, __m128i* m)
+{
+    const __m128i save0 = state0, save1 = state1;
+    for (int group = 0; group < 16; group++) {
+        if (group >= 4) ShiftMessage(m, group);
+        QuadRound(state0, state1, m[group & 3], group);
+    }
+    state0 = _mm_add_epi32(state0, save0);
+    state1 = _mm_add_epi32(state1, save1);
+}
+
+/** Convert a..h into the ABEF/CDGH layout the SHA instructions operate on. */
+void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Convert the ABEF/CDGH layout back into a..h. */
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+__m128i inline Load(const unsigned char* in)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), MASK);
+}
+
+void inline Save(unsigned char* out, __m128i s)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(s, MASK));
+}
+
+/** Process the fixed padding block of a message whose length is a multiple of 64 bytes, given as bits. */
+void inline PaddingRounds(__m128i& state0, __m128i& state1, uint32_t bits)
+{
+    __m128i m[4];
+    m[0] = _mm_set_epi32(0, 0, 0, 0x80000000);
+    m[1] = _mm_setzero_si128();
+    m[2] = _mm_setzero_si128();
+    m[3] = _mm_set_epi32(bits, 0, 0, 0);
+    Rounds(state0, state1, m);
+}
+} // namespace
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state0 = _mm_loadu_si128((const __m128i*)s);
+    __m128i state1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(state0, state1);
+
+    while (blocks--) {
+        __m128i m[4] = {Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48)};
+        Rounds(state0, state1, m);
+        chunk += 64;
+    }
+
+    Unshuffle(state0, state1);
+    _mm_storeu_si128((__m128i*)s, state0);
+    _mm_storeu_si128((__m128i*)(s + 4), state1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    const __m128i INIT0 = _mm_set_epi32(0x6a09e667ul, 0xbb67ae85ul, 0x510e527ful, 0x9b05688cul);
+    const __m128i INIT1 = _mm_set_epi32(0x3c6ef372ul, 0xa54ff53aul, 0x1f83d9abul, 0x5be0cd19ul);
+
+    // The two lanes are independent; keeping them in one loop lets their
+    // instruction latencies overlap.
+    for (int lane = 0; lane < 2; lane++) {
+        const unsigned char* input = in + 64 * lane;
+        __m128i state0 = INIT0, state1 = INIT1;
+
+        // First and second transform: the 64-byte input and its padding.
+        __m128i m[4] = {Load(input), Load(input + 16), Load(input + 32), Load(input + 48)};
+        Rounds(state0, state1, m);
+        PaddingRounds(state0, state1, 0x200);
+
+        // Third transform: the intermediate hash, padded to a 64-byte block.
+        Unshuffle(state0, state1);
+        __m128i m2[4] = {state0, state1, _mm_set_epi32(0, 0, 0, 0x80000000), _mm_set_epi32(0x100, 0, 0, 0)};
+        state0 = INIT0;
+        state1 = INIT1;
+        Rounds(state0, state1, m2);
+
+        Unshuffle(state0, state1);
+        Save(out + 32 * lane, state0);
+        Save(out + 32 * lane + 16, state1);
+    }
+}
+} // namespace sha256d64_shani
+
+#endif // ENABLE_SHANI
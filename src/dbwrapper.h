@@ -175,6 +175,8 @@ public:
 
 class CDBWrapper
 {
+    friend class CDBSnapshot;
+
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -310,4 +312,29 @@ public:
 
 };
 
+/** Read-only view of a database as it was when the snapshot was taken */
+class CDBSnapshot
+{
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+    leveldb::ReadOptions iteroptions;
+
+public:
+    explicit CDBSnapshot(CDBWrapper& db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot()), iteroptions(db.iteroptions)
+    {
+        iteroptions.snapshot = psnapshot;
+    }
+    ~CDBSnapshot() { pdb->ReleaseSnapshot(psnapshot); }
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+    //! Iterators of the snapshot may be used concurrently, one per thread
+    CDBIterator* NewIterator() const
+    {
+        return new CDBIterator(pdb->NewIterator(iteroptions));
+    }
+};
+
 #endif // BITCOIN_DBWRAPPER_H
@@ -9,11 +9,100 @@
 #include "crypto/hmac_sha512.h"
 #include "crypto/scrypt.h"
 
+#include <algorithm>
+
 inline uint32_t ROTL32(uint32_t x, int8_t r)
 {
     return (x << r) | (x >> (32 - r));
 }
 
+namespace
+{
+struct QuarkStage {
+    void (*init)(void*);
+    void (*update)(void*, const void*, size_t);
+    void (*close)(void*, void*);
+};
+
+const QuarkStage QUARK_BLAKE = {sph_blake512_init, sph_blake512, sph_blake512_close};
+const QuarkStage QUARK_BMW = {sph_bmw512_init, sph_bmw512, sph_bmw512_close};
+const QuarkStage QUARK_GROESTL = {sph_groestl512_init, sph_groestl512, sph_groestl512_close};
+const QuarkStage QUARK_JH = {sph_jh512_init, sph_jh512, sph_jh512_close};
+const QuarkStage QUARK_KECCAK = {sph_keccak512_init, sph_keccak512, sph_keccak512_close};
+const QuarkStage QUARK_SKEIN = {sph_skein512_init, sph_skein512, sph_skein512_close};
+
+/** Big enough for any of the quark contexts */
+union QuarkContext {
+    sph_blake512_context blake;
+    sph_bmw512_context bmw;
+    sph_groestl512_context groestl;
+    sph_jh512_context jh;
+    sph_keccak512_context keccak;
+    sph_skein512_context skein;
+};
+
+/** Run one 64-byte stage on the selected lanes */
+void RunQuarkStage(const QuarkStage& stage, QuarkContext& ctx, const uint512* pin, uint512* pout, const size_t* pLanes, size_t nLanes)
+{
+    for (size_t i = 0; i < nLanes; i++) {
+        const size_t n = pLanes[i];
+        stage.init(&ctx);
+        stage.update(&ctx, pin[n].begin(), 64);
+        stage.close(&ctx, pout[n].begin());
+    }
+}
+
+/** Run stageSet on the lanes with the mask bit set, stageUnset on the others */
+void RunQuarkBranch(const QuarkStage& stageSet, const QuarkStage& stageUnset, QuarkContext& ctx, const uint512* pin, uint512* pout, size_t nLanes, size_t* pLanes)
+{
+    static const uint512 mask = 8;
+    static const uint512 zero = 0;
+
+    // lanes taking the first branch at the front, the others at the back
+    size_t nSet = 0;
+    size_t nUnset = nLanes;
+    for (size_t n = 0; n < nLanes; n++) {
+        if ((pin[n] & mask) != zero)
+            pLanes[nSet++] = n;
+        else
+            pLanes[--nUnset] = n;
+    }
+
+    RunQuarkStage(stageSet, ctx, pin, pout, pLanes, nSet);
+    RunQuarkStage(stageUnset, ctx, pin, pout, pLanes + nSet, nLanes - nSet);
+}
+} // namespace
+
+void HashQuarkBatch(const unsigned char* pinput, size_t nStride, size_t nLanes, uint256* phashes)
+{
+    // the lanes go through in groups of QUARK_BATCH_LANES, on the stack
+    QuarkContext ctx;
+    uint512 a[QUARK_BATCH_LANES];
+    uint512 b[QUARK_BATCH_LANES];
+    size_t lanes[QUARK_BATCH_LANES];
+
+    for (size_t nFirst = 0; nFirst < nLanes; nFirst += QUARK_BATCH_LANES) {
+        const size_t nGroup = std::min(nLanes - nFirst, QUARK_BATCH_LANES);
+        for (size_t n = 0; n < nGroup; n++) {
+            lanes[n] = n;
+            QUARK_BLAKE.init(&ctx);
+            QUARK_BLAKE.update(&ctx, pinput + (nFirst + n) * nStride, 80);
+            QUARK_BLAKE.close(&ctx, a[n].begin());
+        }
+        RunQuarkStage(QUARK_BMW, ctx, a, b, lanes, nGroup);
+        RunQuarkBranch(QUARK_GROESTL, QUARK_SKEIN, ctx, b, a, nGroup, lanes);
+        // the branches leave a permutation of every lane in lanes
+        RunQuarkStage(QUARK_GROESTL, ctx, a, b, lanes, nGroup);
+        RunQuarkStage(QUARK_JH, ctx, b, a, lanes, nGroup);
+        RunQuarkBranch(QUARK_BLAKE, QUARK_BMW, ctx, a, b, nGroup, lanes);
+        RunQuarkStage(QUARK_KECCAK, ctx, b, a, lanes, nGroup);
+        RunQuarkStage(QUARK_SKEIN, ctx, a, b, lanes, nGroup);
+        RunQuarkBranch(QUARK_KECCAK, QUARK_JH, ctx, b, a, nGroup, lanes);
+
+        for (size_t n = 0; n < nGroup; n++) phashes[nFirst + n] = a[n].trim256();
+    }
+}
+
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
 {
     // The following is MurmurHash3 (x86_32), see http://code.google.com/p/smhasher/source/browse/trunk/MurmurHash3.cpp
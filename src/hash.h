@@ -461,6 +461,17 @@ inline uint256 HashQuark(const T1 pbegin, const T1 pend)
     return hash[8].trim256();
 }
 
+/** Number of headers hashed together by the miner with HashQuarkBatch */
+static const size_t QUARK_BATCH_LANES = 8;
+
+/**
+ * Quark hash of nLanes 80-byte inputs, nStride bytes apart, written to phashes.
+ * Each stage runs over every lane before the next stage starts, and the
+ * data-dependent stages run once per group of lanes taking the same branch
+ * instead of branching on every lane. Same results as HashQuark.
+ */
+void HashQuarkBatch(const unsigned char* pinput, size_t nStride, size_t nLanes, uint256* phashes);
+
 /* ----------- Xevan Hash ------------------------------------------------ */
 template <typename T1>
 inline uint256 XEVAN(const T1 pbegin, const T1 pend)
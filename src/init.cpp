@@ -22,8 +22,10 @@
 #include "amount.h"
 #include "bootstrap.h"
 #include "checkpoints.h"
+#include "coinstats.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
+#include "crypto/sha256.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
@@ -63,6 +65,8 @@
 #include <fstream>
 #include <stdint.h>
 #include <stdio.h>
+#include <cstdlib>
+#include <exception>
 #include <memory>
 
 #ifndef WIN32
@@ -248,6 +252,8 @@ void PrepareShutdown()
 
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
+
+            WriteBlockIndexSnapshot();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
@@ -255,14 +261,19 @@ void PrepareShutdown()
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        CRewards::SetCoinsDB(NULL);
+        mnodeman.SetCoinsDB(NULL);
+        SetUTXOStatsDB(NULL);
         delete pblocktree;
         pblocktree = NULL;
         delete pSporkDB;
         pSporkDB = NULL;
     }
 #ifdef ENABLE_WALLET
-    if (pwalletMain)
+    if (pwalletMain) {
+        CloseWalletTxLog(pwalletMain->strWalletFile);
         bitdb.Flush(true);
+    }
 #endif
 
 #if ENABLE_ZMQ
@@ -308,7 +319,12 @@ void Shutdown()
 #endif
     globalVerifyHandle.reset();
     ECC_Stop();
+    uint64_t nLogWritten, nLogDropped;
+    g_logger->GetAsyncStats(nLogWritten, nLogDropped);
+    if (nLogWritten > 0 || nLogDropped > 0)
+        LogPrintf("%s: log writer wrote %u lines, dropped %u\n", __func__, nLogWritten, nLogDropped);
     LogPrintf("%s: done\n", __func__);
+    g_logger->StopAsyncLogging();
 }
 
 /**
@@ -426,6 +442,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-msgworkers=<n>", strprintf(_("Number of threads checking masternode and spork message signatures ahead of processing them (0 to disable, max: %d, default: %d)"), MAX_MESSAGE_WORKERS, DEFAULT_MESSAGE_WORKERS));
+#ifdef USE_EPOLL
+    strUsage += HelpMessageOpt("-netpoller=<mode>", strprintf(_("Wait for socket events with <mode>: select or epoll, epoll lifts the FD_SETSIZE limit on connections (default: %s)"), DEFAULT_NETPOLLER));
+#else
+    strUsage += HelpMessageOpt("-netpoller=<mode>", strprintf(_("Wait for socket events with <mode>: select (default: %s)"), DEFAULT_NETPOLLER));
+#endif
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -484,13 +506,14 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-nodebug", "Turn off debugging messages, same as -debug=0");
 
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-logasync", strprintf(_("Write the debug log from a separate thread, dropping lines when it falls behind (default: %u)"), DEFAULT_LOGASYNC));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -631,13 +654,11 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
         int nFile = 0;
         while (true) {
             CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
+            const fs::path path = GetBlockPosFilename(pos, "blk");
+            if (!fs::exists(path))
                 break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
+            LoadExternalBlockFile(path, &pos);
             nFile++;
         }
         pblocktree->WriteReindexing(false);
@@ -650,25 +671,19 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
     // hardcoded $DATADIR/bootstrap.dat
     fs::path pathBootstrap = GetDataDir() / "bootstrap.dat";
     if (fs::exists(pathBootstrap)) {
-        FILE* file = fsbridge::fopen(pathBootstrap, "rb");
-        if (file) {
-            CImportingNow imp;
-            fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
-            LogPrintf("Importing bootstrap.dat...\n");
-            LoadExternalBlockFile(file);
-            RenameOver(pathBootstrap, pathBootstrapOld);
-        } else {
-            LogPrintf("Warning: Could not open bootstrap file %s\n", pathBootstrap.string());
-        }
+        CImportingNow imp;
+        fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
+        LogPrintf("Importing bootstrap.dat...\n");
+        LoadExternalBlockFile(pathBootstrap);
+        RenameOver(pathBootstrap, pathBootstrapOld);
     }
 
     // -loadblock=
     for (fs::path& path : vImportFiles) {
-        FILE* file = fsbridge::fopen(path, "rb");
-        if (file) {
+        if (fs::exists(path)) {
             CImportingNow imp;
             LogPrintf("Importing blocks file %s...\n", path.string());
-            LoadExternalBlockFile(file);
+            LoadExternalBlockFile(path);
         } else {
             LogPrintf("Warning: Could not open blocks file %s\n", path.string());
         }
@@ -733,6 +748,30 @@ bool AppInitServers()
     std::terminate();
 };
 
+static std::terminate_handler prev_terminate_handler = nullptr;
+
+[[noreturn]] static void terminate_handler_flush_log()
+{
+    // Write the log lines still queued for the writer thread, among them
+    // those telling why we are terminating
+    g_logger->FlushAsyncLogging();
+    if (prev_terminate_handler)
+        prev_terminate_handler();
+    std::abort();
+}
+
+/**
+ * The same for crashes and failed assertions. Writing the log is not safe in
+ * a signal handler, but the process is lost anyway: it is done best effort,
+ * then the signal is raised again with its default action.
+ */
+static void HandleSIGFATAL(int signum)
+{
+    g_logger->FlushAsyncLogging();
+    signal(signum, SIG_DFL);
+    raise(signum);
+}
+
 bool AppInitBasicSetup()
 {
 // ********************************************************* Step 1: setup
@@ -784,6 +823,16 @@ bool AppInitBasicSetup()
 #endif
 
     std::set_new_handler(new_handler_terminate);
+    prev_terminate_handler = std::set_terminate(terminate_handler_flush_log);
+
+    // Flush the queued log lines before crashing, abort() and failed assertions raise SIGABRT
+    signal(SIGSEGV, HandleSIGFATAL);
+    signal(SIGABRT, HandleSIGFATAL);
+    signal(SIGFPE, HandleSIGFATAL);
+    signal(SIGILL, HandleSIGFATAL);
+#ifndef WIN32
+    signal(SIGBUS, HandleSIGFATAL);
+#endif
 
     return true;
 }
@@ -933,8 +982,21 @@ bool AppInit2()
     int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     int nMaxConnections = std::max(nUserMaxConnections, 4 * MAX_OUTBOUND_CONNECTIONS);
 
+    NetPoller netPoller = NetPoller::SELECT;
+    const std::string strNetPoller = GetArg("-netpoller", DEFAULT_NETPOLLER);
+    if (strNetPoller == "epoll") {
+#ifdef USE_EPOLL
+        netPoller = NetPoller::EPOLL;
+#else
+        return UIError(strprintf(_("Unsupported -netpoller value %s: epoll is not available on this system"), strNetPoller));
+#endif
+    } else if (strNetPoller != "select") {
+        return UIError(strprintf(_("Unknown -netpoller value %s"), strNetPoller));
+    }
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (netPoller == NetPoller::SELECT)
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return UIError(_("Not enough file descriptors available."));
@@ -1070,6 +1132,8 @@ bool AppInit2()
     fReindex = GetBoolArg("-reindex", false);
 
     // Initialize elliptic curve code
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1098,6 +1162,11 @@ bool AppInit2()
             g_logger->ShrinkDebugFile();
         if (!g_logger->OpenDebugLog())
             return UIError(strprintf("Could not open debug log file %s", g_logger->m_file_path.string()));
+        if (GetBoolArg("-logasync", DEFAULT_LOGASYNC)) {
+            g_logger->StartAsyncLogging();
+            // for the lines queued when exiting without Shutdown()
+            std::atexit([]() { g_logger->StopAsyncLogging(); });
+        }
     }
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
@@ -1108,14 +1177,18 @@ bool AppInit2()
     LogPrintf("Using data directory %s\n", strDataDir);
     LogPrintf("Using config file %s\n", GetConfigFile().string());
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
+    LogPrintf("Using %s for socket events\n", strNetPoller);
     std::ostringstream strErrors;
 
     InitSignatureCache();
+    InitScriptExecutionCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and masternode signature verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadMasternodeSigCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1463,6 +1536,9 @@ bool AppInit2()
                 pSporkDB = new CSporkDB(0, false, false);
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                CRewards::SetCoinsDB(pcoinsdbview);
+                mnodeman.SetCoinsDB(pcoinsdbview);
+                SetUTXOStatsDB(pcoinsdbview);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1760,6 +1836,8 @@ bool AppInit2()
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.netPoller = netPoller;
+    connOptions.nMessageWorkers = GetArg("-msgworkers", DEFAULT_MESSAGE_WORKERS);
 
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return UIError(strNodeError);
@@ -1782,6 +1860,12 @@ bool AppInit2()
         fStaking = GetBoolArg("-staking", !Params().IsRegTestNet() && DEFAULT_STAKING);
         // StakeMiner thread disabled by default on regtest
         if (fStaking) {
+            nStakingThreads = GetArg("-stakingthreads", DEFAULT_STAKING_THREADS);
+            if (nStakingThreads <= 0)
+                nStakingThreads += GetNumCores();
+            nStakingThreads = std::max(1, std::min(nStakingThreads, MAX_STAKING_THREADS));
+            for (int i = 0; i < nStakingThreads - 1; i++)
+                threadGroup.create_thread(&ThreadStakeKernelSearch);
             threadGroup.create_thread(boost::bind(&ThreadStakeMinter));
         }
     }
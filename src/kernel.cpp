@@ -8,7 +8,9 @@
 
 #include "kernel.h"
 
+#include "crypto/common.h"
 #include "db.h"
+#include "hash.h"
 #include "legacy/stakemodifier.h"
 #include "script/interpreter.h"
 #include "util.h"
@@ -45,24 +47,35 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
     }
     CBlockIndex* pindexFrom = stakeInput->GetIndexFrom();
     nTimeBlockFrom = pindexFrom->nTime;
+    HashPrefix();
+
+    // Get weighted target
+    bnTarget.SetCompact(nBits);
+    bnTarget *= (uint256(stakeValue) / 100);
+}
+
+// Hash the fixed part of the kernel message once
+void CStakeKernel::HashPrefix()
+{
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness;
+    hasherPrefix.Reset().Write((const unsigned char*)&ss.begin()[0], ss.size());
 }
 
 // Return stake kernel hash
 uint256 CStakeKernel::GetHash() const
 {
-    CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
-    return Hash(ss.begin(), ss.end());
+    // Same as hashing stakeModifier << nTimeBlockFrom << stakeUniqueness << nTime
+    unsigned char timeBytes[4];
+    WriteLE32(timeBytes, (uint32_t)nTime);
+    uint256 hash;
+    CHash256(hasherPrefix).Write(timeBytes, sizeof(timeBytes)).Finalize(hash.begin());
+    return hash;
 }
 
 // Check that the kernel hash meets the target required
 bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
 {
-    // Get weighted target
-    uint256 bnTarget;
-    bnTarget.SetCompact(nBits);
-    bnTarget *= (uint256(stakeValue) / 100);
-
     // Check PoS kernel hash
     const uint256& hashProofOfStake = GetHash();
     const bool res = hashProofOfStake < bnTarget;
@@ -105,7 +118,7 @@ bool LoadStakeInput(const CBlock& block, const CBlockIndex* pindexPrev, std::uni
         return error("called on non PoS block");
 
     // Construct the stakeinput object
-    const CTxIn& txin = block.vtx[1].vin[0];
+    const CTxIn& txin = block.vtx[1]->vin[0];
     stake = std::unique_ptr<CStakeInput>(new CPivStake());
 
     return stake->InitFromTxIn(txin);
@@ -141,9 +154,11 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
         nTimeTx += slotStep;
     }
 
+    // Only the block time changes between slots: build the kernel once
+    CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
     while(nTimeTx <= (fTimeProtocolV2 ? pindexPrev->MaxFutureBlockTime() : pindexPrev->GetBlockTime() + HASH_DRIFT)) {
         // Verify Proof Of Stake
-        CStakeKernel stakeKernel(pindexPrev, stakeInput, nBits, nTimeTx);
+        stakeKernel.SetTime(nTimeTx);
         if(stakeKernel.CheckKernelHash(true)) return true;
         nTimeTx += slotStep;
     }
@@ -195,7 +210,7 @@ bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockI
         strError = "unable to get stake prevout for coinstake";
         return false;
     }
-    const CTransaction& tx = block.vtx[1];
+    const CTransaction& tx = *block.vtx[1];
     const CTxIn& txin = tx.vin[0];
     ScriptError serror;
     if (!VerifyScript(txin.scriptSig, stakePrevout.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
@@ -9,12 +9,19 @@
 #ifndef PIVX_KERNEL_H
 #define PIVX_KERNEL_H
 
+#include "hash.h"
 #include "main.h"
 #include "stakeinput.h"
 
 #define HASH_DRIFT 45
 
+namespace kernel_tests
+{
+    class TestStakeKernel;
+}
+
 class CStakeKernel {
+    friend class kernel_tests::TestStakeKernel; // for test access to the kernel message
 public:
     /**
      * CStakeKernel Constructor
@@ -32,15 +39,24 @@ public:
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
+    // Move the kernel to another block time, keeping the hashed prefix
+    void SetTime(int nTimeTx) { nTime = nTimeTx; }
+
 private:
+    CStakeKernel() {}
+    void HashPrefix();
+
     // kernel message hashed
     CDataStream stakeModifier{CDataStream(SER_GETHASH, 0)};
     int nTimeBlockFrom{0};
     CDataStream stakeUniqueness{CDataStream(SER_GETHASH, 0)};
     int nTime{0};
+    // hash state after everything but nTime, which is the only part that varies while staking
+    CHash256 hasherPrefix;
     // hash target
     unsigned int nBits{0};     // difficulty for the target
     CAmount stakeValue{0};     // target multiplier
+    uint256 bnTarget;          // weighted target
 };
 
 /* PoS Validation */
@@ -7,8 +7,11 @@
 
 #include "chainparamsbase.h"
 #include "logging.h"
+#include "util/threadnames.h"
 #include "utiltime.h"
 
+#include <chrono>
+
 
 const char * const DEFAULT_DEBUGLOGFILE = "debug.log";
 
@@ -172,22 +175,22 @@ std::vector<CLogCategoryActive> ListActiveLogCategories()
     return ret;
 }
 
-std::string BCLog::Logger::LogTimestampStr(const std::string &str)
+std::string BCLog::Logger::LogTimestampStr(const std::string &str, bool& started_new_line)
 {
     std::string strStamped;
 
     if (!m_log_timestamps)
         return str;
 
-    if (m_started_new_line)
+    if (started_new_line)
         strStamped =  DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()) + ' ' + str;
     else
         strStamped = str;
 
     if (!str.empty() && str[str.size()-1] == '\n')
-        m_started_new_line = true;
+        started_new_line = true;
     else
-        m_started_new_line = false;
+        started_new_line = false;
 
     return strStamped;
 }
@@ -199,10 +202,19 @@ int BCLog::Logger::LogPrintStr(const std::string &str)
         // print to console
         ret = fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
+    } else if (m_print_to_file && m_async.load(std::memory_order_acquire)) {
+        // Outside of the lock, a line logged in pieces can only be continued by its own thread
+        static thread_local bool started_new_line = true;
+        std::string strTimestamped = LogTimestampStr(str, started_new_line);
+        ret = strTimestamped.length();
+        if (!m_ring->Push(std::move(strTimestamped))) {
+            m_async_dropped++;
+            ret = 0;
+        }
     } else if (m_print_to_file) {
         std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
 
-        std::string strTimestamped = LogTimestampStr(str);
+        std::string strTimestamped = LogTimestampStr(str, m_started_new_line);
 
         // buffer if we haven't opened the log yet
         if (m_fileout == NULL) {
@@ -217,6 +229,10 @@ int BCLog::Logger::LogPrintStr(const std::string &str)
                     setbuf(m_fileout, NULL); // unbuffered
             }
 
+            // lines still queued when asynchronous logging stopped go first
+            if (m_ring)
+                WriteQueuedLines();
+
             ret = FileWriteStr(strTimestamped, m_fileout);
         }
     }
@@ -224,6 +240,158 @@ int BCLog::Logger::LogPrintStr(const std::string &str)
     return ret;
 }
 
+BCLog::LogRing::LogRing(size_t size) : m_mask(size - 1), m_slots(new Slot[size])
+{
+    assert(size >= 2 && (size & m_mask) == 0);
+    for (size_t i = 0; i < size; i++)
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+bool BCLog::LogRing::Push(std::string&& str)
+{
+    // A slot is free for the producer at pos when its sequence number is pos
+    Slot* slot;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &m_slots[pos & m_mask];
+        const intptr_t diff = (intptr_t)slot->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+        if (diff == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // not yet read since the previous lap: full
+            return false;
+        } else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    slot->str = std::move(str);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool BCLog::LogRing::Pop(std::string& str)
+{
+    // and holds a line for the consumer at pos when it is pos + 1
+    const size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    Slot& slot = m_slots[pos & m_mask];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1)
+        return false;
+    m_dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+    str = std::move(slot.str);
+    slot.str.clear();
+    slot.seq.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+}
+
+void BCLog::Logger::WriteQueuedLines()
+{
+    // reopen the log file, if requested
+    if (m_reopen_file) {
+        m_reopen_file = false;
+        if (fsbridge::freopen(m_file_path,"a",m_fileout) != NULL)
+            setbuf(m_fileout, NULL); // unbuffered
+    }
+
+    // one write for many lines
+    static const size_t MAX_BATCH_SIZE = 1 << 16;
+    std::string batch;
+    std::string str;
+    uint64_t lines = 0;
+    while (m_ring->Pop(str)) {
+        batch += str;
+        lines++;
+        if (batch.size() >= MAX_BATCH_SIZE) {
+            FileWriteStr(batch, m_fileout);
+            batch.clear();
+        }
+    }
+
+    const uint64_t dropped = m_async_dropped;
+    if (dropped != m_async_dropped_reported) {
+        if (m_log_timestamps)
+            batch += DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()) + ' ';
+        batch += strprintf("%u log lines dropped, the log writer fell behind\n", dropped - m_async_dropped_reported);
+        m_async_dropped_reported = dropped;
+    }
+
+    if (!batch.empty())
+        FileWriteStr(batch, m_fileout);
+    m_async_written += lines;
+}
+
+void BCLog::Logger::WriterThread()
+{
+    util::ThreadRename("pivx-logwriter");
+
+    std::unique_lock<std::mutex> lock(m_writer_mutex);
+    while (true) {
+        m_writer_cv.wait_for(lock, std::chrono::milliseconds(LOG_ASYNC_WRITE_INTERVAL_MS), [this] { return m_writer_stop; });
+        const bool stop = m_writer_stop;
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+            WriteQueuedLines();
+        }
+        if (stop)
+            return;
+        lock.lock();
+    }
+}
+
+void BCLog::Logger::StartAsyncLogging()
+{
+    std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+    if (m_async || m_fileout == nullptr)
+        return;
+
+    if (!m_ring)
+        m_ring.reset(new LogRing(LOG_ASYNC_RING_SIZE));
+    m_writer_stop = false;
+    m_writer = std::thread(&BCLog::Logger::WriterThread, this);
+    m_async.store(true, std::memory_order_release);
+}
+
+void BCLog::Logger::StopAsyncLogging()
+{
+    if (!m_async.exchange(false))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_writer_mutex);
+        m_writer_stop = true;
+    }
+    m_writer_cv.notify_one();
+    m_writer.join();
+
+    // lines pushed by threads that saw asynchronous logging still on
+    std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+    WriteQueuedLines();
+}
+
+void BCLog::Logger::FlushAsyncLogging()
+{
+    if (!m_async)
+        return;
+
+    // The writer holds the lock only briefly, but a thread that died holding
+    // it never lets go: give up rather than hang the dying process.
+    for (int i = 0; i < 100; i++) {
+        std::unique_lock<std::mutex> lock(m_file_mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            WriteQueuedLines();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void BCLog::Logger::GetAsyncStats(uint64_t& written, uint64_t& dropped) const
+{
+    written = m_async_written;
+    dropped = m_async_dropped;
+}
+
 void BCLog::Logger::ShrinkDebugFile()
 {
     // Amount of debug.log to save at end when shrinking (must fit in memory)
@@ -16,15 +16,23 @@
 #include "tinyformat.h"
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC      = false;
+//! lines queued for the log writer thread, past which they are dropped (a power of two)
+static const size_t LOG_ASYNC_RING_SIZE = 1 << 16;
+//! how often the log writer thread appends the queued lines to the file
+static const int LOG_ASYNC_WRITE_INTERVAL_MS = 50;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fLogIPs;
@@ -65,6 +73,32 @@ namespace BCLog {
         ALL         = ~(uint32_t)0,
     };
 
+    /**
+     * Bounded ring of log lines, filled by any thread without locking and
+     * emptied by one at a time (Dmitry Vyukov's bounded queue). Producers
+     * claim a slot by a compare-and-swap on the enqueue position, and the
+     * sequence number of a slot tells whether it is free or holds a line.
+     * Push fails instead of waiting when the ring is full.
+     */
+    class LogRing
+    {
+    private:
+        struct Slot {
+            std::atomic<size_t> seq;
+            std::string str;
+        };
+        const size_t m_mask;
+        std::unique_ptr<Slot[]> m_slots;
+        std::atomic<size_t> m_enqueue_pos{0};
+        std::atomic<size_t> m_dequeue_pos{0};
+
+    public:
+        explicit LogRing(size_t size);
+        bool Push(std::string&& str);
+        //! Not to be called by two threads at once
+        bool Pop(std::string& str);
+    };
+
     class Logger
     {
     private:
@@ -72,17 +106,36 @@ namespace BCLog {
         std::mutex m_file_mutex;
         std::list<std::string> m_msgs_before_open;
 
+        /**
+         * With asynchronous logging, lines to the file are queued in m_ring
+         * and appended in batches by m_writer. Lines are dropped when the
+         * ring is full. The ring is emptied with m_file_mutex held.
+         */
+        std::unique_ptr<LogRing> m_ring;
+        std::atomic<bool> m_async{false};
+        std::thread m_writer;
+        std::mutex m_writer_mutex;
+        std::condition_variable m_writer_cv;
+        bool m_writer_stop = false;
+        std::atomic<uint64_t> m_async_written{0};
+        std::atomic<uint64_t> m_async_dropped{0};
+        uint64_t m_async_dropped_reported = 0;
+
+        void WriterThread();
+        void WriteQueuedLines();
+
         /**
          * m_started_new_line is a state variable that will suppress printing of
          * the timestamp when multiple calls are made that don't end in a
-         * newline.
+         * newline. It is guarded by m_file_mutex, asynchronous logging keeps
+         * one per thread instead, as the threads stamp their lines unlocked.
          */
-        std::atomic_bool m_started_new_line{true};
+        bool m_started_new_line = true;
 
         /** Log categories bitfield. */
         std::atomic<uint32_t> m_categories{0};
 
-        std::string LogTimestampStr(const std::string& str);
+        std::string LogTimestampStr(const std::string& str, bool& started_new_line);
 
     public:
         bool m_print_to_console = false;
@@ -103,6 +156,15 @@ namespace BCLog {
         bool OpenDebugLog();
         void ShrinkDebugFile();
 
+        /** Have a writer thread append the lines to the file, instead of the logging threads */
+        void StartAsyncLogging();
+        /** Write the queued lines and stop the writer thread */
+        void StopAsyncLogging();
+        /** Write the queued lines from this thread, when the process is about to die */
+        void FlushAsyncLogging();
+        /** Lines written and dropped by asynchronous logging */
+        void GetAsyncStats(uint64_t& written, uint64_t& dropped) const;
+
         uint32_t GetCategoryMask() const { return m_categories.load(); }
 
         void EnableCategory(LogFlags flag);
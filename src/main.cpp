@@ -14,13 +14,18 @@
 #include "addrman.h"
 #include "amount.h"
 #include "blocksignature.h"
+#include "blockstats.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinstats.h"
 #include "consensus/consensus.h"
+#include "crypto/common.h"
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "fs.h"
 #include "init.h"
 #include "kernel.h"
@@ -53,6 +58,9 @@
 #include <atomic>
 #include <queue>
 #include <regex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 
 #if defined(NDEBUG)
@@ -77,6 +85,7 @@
 RecursiveMutex cs_main;
 
 BlockMap mapBlockIndex;
+CBlockIndexArena blockIndexArena;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
@@ -106,7 +115,7 @@ CFeeRate minRelayTxFee = CFeeRate(10000);
 CTxMemPool mempool(::minRelayTxFee);
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
 };
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
@@ -676,8 +685,9 @@ CSporkDB* pSporkDB = NULL;
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    const CTransaction& tx = *ptx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -695,7 +705,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
+    mapOrphanTransactions[hash].tx = ptx;
     mapOrphanTransactions[hash].fromPeer = peer;
     for (const CTxIn& txin : tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -710,7 +720,7 @@ void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
-    for (const CTxIn& txin : it->second.tx.vin) {
+    for (const CTxIn& txin : it->second.tx->vin) {
         std::map<uint256, std::set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
@@ -728,7 +738,7 @@ void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     while (iter != mapOrphanTransactions.end()) {
         std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer) {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
+            EraseOrphanTx(maybeErase->second.tx->GetHash());
             ++nErased;
         }
     }
@@ -826,11 +836,12 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
                               bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
                               std::vector<COutPoint>& coins_to_uncache)
 {
     AssertLockHeld(cs_main);
+    const CTransaction& tx = *ptx;
     if (pfMissingInputs)
         *pfMissingInputs = false;
 
@@ -973,7 +984,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
+        CTxMemPoolEntry entry(ptx, nFees, GetTime(), dPriority, chainHeight, pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1044,7 +1055,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
         PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
+        if (!CheckInputs(tx, state, view, true, flags, true, false, precomTxData)) {
             return false;
         }
 
@@ -1057,10 +1068,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
-        if (fCLTVIsActivated)
-            flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
+        //
+        // The check uses the flags of a block on top of the tip, which are a
+        // subset of the standard ones, and stores its result in the script
+        // execution cache so that the next block containing the transaction
+        // doesn't run its scripts again.
+        flags = GetBlockScriptFlags(chainActive.Tip());
+        if (!CheckInputs(tx, state, view, true, flags, true, true, precomTxData)) {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                     __func__, hash.ToString(), FormatStateMessage(state));
         }
@@ -1085,7 +1099,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
 {
     LOCK(cs_main);
@@ -1197,7 +1211,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
                 break;
             }
         }
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainHeight, mempool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
+        CTxMemPoolEntry entry(MakeTransactionRef(tx), nFees, GetTime(), dPriority, chainHeight, mempool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbaseOrCoinstake, nSigOps);
         unsigned int nSize = entry.GetTxSize();
 
         // Don't accept it if it can't get into a block
@@ -1258,7 +1272,7 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
             flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
         PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, false, flags, true, precomTxData)) {
+        if (!CheckInputs(tx, state, view, false, flags, true, false, precomTxData)) {
             return error("AcceptableInputs: : ConnectInputs failed %s", hash.ToString());
         }
 
@@ -1345,9 +1359,9 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow)) {
-            for (const CTransaction& tx : block.vtx) {
-                if (tx.GetHash() == hash) {
-                    txOut = tx;
+            for (const auto& tx : block.vtx) {
+                if (tx->GetHash() == hash) {
+                    txOut = *tx;
                     hashBlock = pindexSlow->GetBlockHash();
                     return true;
                 }
@@ -1702,7 +1716,32 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
+/**
+ * Transactions whose scripts all passed with some flags, to skip running them
+ * again when a block brings a transaction already accepted to the mempool.
+ * Entries are SHA256(nonce || txid || flags). Guarded by cs_main.
+ */
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+
+void InitScriptExecutionCache()
+{
+    // Shares -maxsigcachesize with the signature cache, half of it each
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev)
+{
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (pindexPrev && Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight, Consensus::UPGRADE_BIP65))
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return flags;
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase()) {
 
@@ -1720,6 +1759,16 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // The txid commits to the spent outpoints, and so to the coins
+            // whose scripts are run: a transaction that passed with the same
+            // flags passes again. Entries are taken out when a block consults
+            // them, as the transaction can't be connected twice.
+            uint256 hashCacheEntry;
+            CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((const unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            AssertLockHeld(cs_main);
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const Coin& coin = inputs.AccessCoin(prevout);
@@ -1734,7 +1783,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, &precomTxData);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &precomTxData);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1747,7 +1796,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(scriptPubKey, amount, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &precomTxData);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &precomTxData);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1761,6 +1810,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            // With deferred checks the result isn't known yet
+            if (cacheFullScriptStore && !pvChecks)
+                scriptExecutionCache.insert(hashCacheEntry);
         }
     }
 
@@ -1814,6 +1867,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1839,8 +1894,6 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
-} // anon namespace
-
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1882,7 +1935,7 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult DisconnectBlock(CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult DisconnectBlock(CBlock& block, CBlockIndex* pindex, CCoinsViewCache& view, CSupplyDelta* pSupplyDelta = nullptr, CUTXOStats* pStatsDelta = nullptr)
 {
     AssertLockHeld(cs_main);
 
@@ -1914,7 +1967,7 @@ DisconnectResult DisconnectBlock(CBlock& block, CBlockIndex* pindex, CCoinsViewC
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction& tx = block.vtx[i];
+        const CTransaction& tx = *block.vtx[i];
 
         nValueOut += tx.GetValueOut();
         nUnspendableValue += tx.GetUnspendableValueOut();
@@ -1930,6 +1983,10 @@ DisconnectResult DisconnectBlock(CBlock& block, CBlockIndex* pindex, CCoinsViewC
                 if (tx.vout[o] != coin.out) {
                     fClean = false; // transaction output mismatch
                 }
+                if (pSupplyDelta && !coin.IsSpent())
+                    pSupplyDelta->SpendCoin(coin.out, coin.nHeight);
+                if (pStatsDelta && !coin.IsSpent())
+                    pStatsDelta->SpendCoin(out, coin);
             }
         }
 
@@ -1949,6 +2006,13 @@ DisconnectResult DisconnectBlock(CBlock& block, CBlockIndex* pindex, CCoinsViewC
             int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
             if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
             fClean = fClean && res != DISCONNECT_UNCLEAN;
+            if (pSupplyDelta || pStatsDelta) {
+                const Coin& coin = view.AccessCoin(out);
+                if (pSupplyDelta)
+                    pSupplyDelta->AddCoin(coin.out, coin.nHeight);
+                if (pStatsDelta)
+                    pStatsDelta->AddCoin(out, coin);
+            }
         }
         // At this point, all of txundo.vprevout should have been moved out.
 
@@ -2009,7 +2073,7 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked)
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck, bool fAlreadyChecked, CSupplyDelta* pSupplyDelta, CUTXOStats* pStatsDelta)
 {
     AssertLockHeld(cs_main);
 
@@ -2059,11 +2123,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
 
-    // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
-    bool fCLTVIsActivated = false;
-    if (fScriptChecks && pindex->pprev) {
-        fCLTVIsActivated = consensus.NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_BIP65);
-    }
+    const unsigned int flags = GetBlockScriptFlags(pindex->pprev);
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
@@ -2085,7 +2145,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<PrecomputedTransactionData> precomTxData;
     precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
-        const CTransaction& tx = block.vtx[i];
+        const CTransaction& tx = *block.vtx[i];
 
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
@@ -2115,12 +2175,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
-            if (fCLTVIsActivated)
-                flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
@@ -2202,6 +2258,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    // Fee and size statistics, for getblockindexstats not to read the block again
+    CBlockStats blockstats;
+    ComputeBlockStats(block, blockundo, blockstats);
+    if (!pblocktree->WriteBlockStats(pindex->GetBlockHash(), blockstats))
+        return AbortNode(state, "Failed to write block statistics");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2233,7 +2295,40 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     // Update money supply
-    pindex->nMoneySupply = pindex->pprev->nMoneySupply.get() + (nValueOut - nValueIn - nUnspendableValue);
+    pindex->SetMoneySupply(pindex->pprev->GetMoneySupply().get() + (nValueOut - nValueIn - nUnspendableValue));
+
+    // Report the coins created and spent, for the circulating supply accumulator
+    if (pSupplyDelta) {
+        for (const auto& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
+            for (const CTxOut& out : tx.vout) {
+                if (!out.scriptPubKey.IsUnspendable())
+                    pSupplyDelta->AddCoin(out, pindex->nHeight);
+            }
+        }
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            for (const Coin& coin : txundo.vprevout)
+                pSupplyDelta->SpendCoin(coin.out, coin.nHeight);
+        }
+    }
+
+    // Same for the UTXO set statistics, which also need the outpoints
+    if (pStatsDelta) {
+        for (const auto& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
+            const uint256& hash = tx.GetHash();
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable())
+                    pStatsDelta->AddCoin(COutPoint(hash, o), Coin(tx.vout[o], pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()));
+            }
+        }
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); j++)
+                pStatsDelta->SpendCoin(tx.vin[j].prevout, txundo.vprevout[j]);
+        }
+    }
 
     int64_t nTime3 = GetTimeMicros();
     nTimeIndex += nTime3 - nTime2;
@@ -2242,7 +2337,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
     int64_t nTime4 = GetTimeMicros();
     nTimeCallbacks += nTime4 - nTime3;
@@ -2421,9 +2516,15 @@ bool static DisconnectTip(CValidationState& state)
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        CSupplyDelta supplyDelta;
+        CUTXOStats statsDelta;
+        if (DisconnectBlock(block, pindexDelete, view, &supplyDelta, &statsDelta) != DISCONNECT_OK)
             return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
+        if (!CRewards::DisconnectSupply(pindexDelete, supplyDelta))
+            LogPrintf("%s : unable to update the circulating supply, it will be rebuilt\n", __func__);
+        if (!DisconnectUTXOStats(pindexDelete, statsDelta))
+            LogPrintf("%s : unable to update the UTXO set statistics, they will be recomputed\n", __func__);
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
@@ -2431,11 +2532,12 @@ bool static DisconnectTip(CValidationState& state)
         return false;
     // Resurrect mempool transactions from the disconnected block.
     std::vector<uint256> vHashUpdate;
-    for (const CTransaction& tx : block.vtx) {
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         // ignore validation errors in resurrected transactions
-        std::list<CTransaction> removed;
+        std::list<CTransactionRef> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, nullptr, true)) {
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, ptx, false, nullptr, true)) {
             mempool.remove(tx, removed, true);
         } else if (mempool.exists(tx.GetHash())) {
             vHashUpdate.push_back(tx.GetHash());
@@ -2452,7 +2554,8 @@ bool static DisconnectTip(CValidationState& state)
     UpdateTip(pindexDelete->pprev);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
-    for (const CTransaction& tx : block.vtx) {
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         GetMainSignals().SyncTransaction(tx, pindexDelete->pprev, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
     }
     return true;
@@ -2468,7 +2571,7 @@ static int64_t nTimePostConnect = 0;
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
  */
-bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const CBlock* pblock, bool fAlreadyChecked, std::list<CTransaction> &txConflicted, std::vector<std::tuple<CTransaction,CBlockIndex*,int>> &txChanged)
+bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const CBlock* pblock, bool fAlreadyChecked, std::list<CTransactionRef> &txConflicted, std::vector<std::tuple<CTransactionRef,CBlockIndex*,int>> &txChanged)
 {
     assert(pindexNew->pprev == chainActive.Tip());
 
@@ -2490,7 +2593,9 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const CB
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
+        CSupplyDelta supplyDelta;
+        CUTXOStats statsDelta;
+        bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked, &supplyDelta, &statsDelta);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2502,6 +2607,10 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const CB
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         assert(view.Flush());
+        if (!CRewards::ConnectSupply(pindexNew, supplyDelta))
+            LogPrintf("%s : unable to update the circulating supply, it will be rebuilt\n", __func__);
+        if (!ConnectUTXOStats(pindexNew, statsDelta))
+            LogPrintf("%s : unable to update the UTXO set statistics, they will be recomputed\n", __func__);
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -2655,7 +2764,7 @@ static void PruneBlockIndexCandidates()
  * Try to make some progress towards making pindexMostWork the active block.
  * pblock is either NULL or a pointer to a CBlock corresponding to pindexMostWork.
  */
-static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, const CBlock* pblock, bool fAlreadyChecked, std::list<CTransaction>& txConflicted, std::vector<std::tuple<CTransaction,CBlockIndex*,int>>& txChanged)
+static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMostWork, const CBlock* pblock, bool fAlreadyChecked, std::list<CTransactionRef>& txConflicted, std::vector<std::tuple<CTransactionRef,CBlockIndex*,int>>& txChanged)
 {
     AssertLockHeld(cs_main);
     if (pblock == NULL)
@@ -2745,7 +2854,7 @@ bool ActivateBestChain(CValidationState& state, const CBlock* pblock, bool fAlre
 
     CBlockIndex* pindexNewTip = nullptr;
     CBlockIndex* pindexMostWork = nullptr;
-    std::vector<std::tuple<CTransaction,CBlockIndex*,int>> txChanged;
+    std::vector<std::tuple<CTransactionRef,CBlockIndex*,int>> txChanged;
     if (pblock)
         txChanged.reserve(pblock->vtx.size());
     do {
@@ -2753,7 +2862,7 @@ bool ActivateBestChain(CValidationState& state, const CBlock* pblock, bool fAlre
         boost::this_thread::interruption_point();
 
         const CBlockIndex *pindexFork;
-        std::list<CTransaction> txConflicted;
+        std::list<CTransactionRef> txConflicted;
         bool fInitialDownload;
         while (true) {
             TRY_LOCK(cs_main, lockMain);
@@ -2777,12 +2886,12 @@ bool ActivateBestChain(CValidationState& state, const CBlock* pblock, bool fAlre
             fInitialDownload = IsInitialBlockDownload();
 
             // throw all transactions though the signal-interface
-            for (const CTransaction &tx : txConflicted) {
-                GetMainSignals().SyncTransaction(tx, pindexNewTip, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+            for (const CTransactionRef &tx : txConflicted) {
+                GetMainSignals().SyncTransaction(*tx, pindexNewTip, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
             }
             // ... and about transactions that got confirmed:
             for(unsigned int i = 0; i < txChanged.size(); i++) {
-                GetMainSignals().SyncTransaction(std::get<0>(txChanged[i]), std::get<1>(txChanged[i]), std::get<2>(txChanged[i]));
+                GetMainSignals().SyncTransaction(*std::get<0>(txChanged[i]), std::get<1>(txChanged[i]), std::get<2>(txChanged[i]));
             }
 
             break;
@@ -2919,8 +3028,8 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2941,7 +3050,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 
         } else {
             // compute and set new V2 stake modifier (hash of prevout and prevModifier)
-            pindexNew->SetNewStakeModifier(block.vtx[1].vin[0].prevout.hash);
+            pindexNew->SetNewStakeModifier(block.vtx[1]->vin[0].prevout.hash);
         }
     }
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
@@ -2954,6 +3063,24 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
     return pindexNew;
 }
 
+/** Store the masternode payee of a block in its index entry and mark it to be persisted. */
+void SetBlockIndexPaidPayee(const CBlockIndex* pindex, const CScript& paidPayee)
+{
+    AssertLockHeld(cs_main);
+
+    BlockMap::iterator it = mapBlockIndex.find(pindex->GetBlockHash());
+    if (it == mapBlockIndex.end())
+        return;
+
+    CBlockIndex* pindexPaid = it->second;
+    const uint160 hashPaidPayee = Hash160(paidPayee.begin(), paidPayee.end());
+    if (pindexPaid->HasPaidPayee() && pindexPaid->hashPaidPayee == hashPaidPayee)
+        return;
+
+    pindexPaid->SetPaidPayee(paidPayee);
+    setDirtyBlockIndex.insert(pindexPaid);
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
@@ -3088,14 +3215,9 @@ bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool f
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+//! Header, merkle root, size and coinbase/coinstake layout checks of CheckBlock
+static bool CheckBlockLayout(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
 {
-    AssertLockHeld(cs_main);
-
-    if (block.fChecked)
-        return true;
-
-    // These are checks that are independent of context.
     const bool IsPoS = block.IsProofOfStake();
 
     // Check that the header is valid (particularly PoW).  This is mostly
@@ -3127,25 +3249,80 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-length", false, "size limits failed");
 
     // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase())
         return state.DoS(100, false, REJECT_INVALID, "bad-cb-missing", false, "first tx is not coinbase");
     for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
+        if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
     if (IsPoS) {
         // Coinbase output should be empty if proof-of-stake block
-        if (block.vtx[0].vout.size() != 1 || !block.vtx[0].vout[0].IsEmpty())
+        if (block.vtx[0]->vout.size() != 1 || !block.vtx[0]->vout[0].IsEmpty())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-pos", false, "coinbase output not empty for proof-of-stake block");
 
         // Second transaction must be coinstake, the rest must not be
-        if (block.vtx.empty() || !block.vtx[1].IsCoinStake())
+        if (block.vtx.empty() || !block.vtx[1]->IsCoinStake())
             return state.DoS(100, false, REJECT_INVALID, "bad-cs-missing", false, "second tx is not coinstake");
         for (unsigned int i = 2; i < block.vtx.size(); i++)
-            if (block.vtx[i].IsCoinStake())
+            if (block.vtx[i]->IsCoinStake())
                 return state.DoS(100, false, REJECT_INVALID, "bad-cs-multiple", false, "more than one coinstake");
     }
 
+    return true;
+}
+
+//! Transaction and sigop checks of CheckBlock
+static bool CheckBlockTransactions(const CBlock& block, CValidationState& state)
+{
+    // Check transactions
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+        if (!CheckTransaction(
+                tx,
+                state
+        ))
+            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                             strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+
+    }
+
+    unsigned int nSigOps = 0;
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+        nSigOps += GetLegacySigOpCount(tx);
+    }
+    unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_LEGACY;
+    if (nSigOps > nMaxBlockSigOps)
+        return state.DoS(100, error("%s : out-of-bounds SigOpCount", __func__),
+            REJECT_INVALID, "bad-blk-sigops", true);
+
+    return true;
+}
+
+bool PreCheckBlock(const CBlock& block, CValidationState& state)
+{
+    if (block.fPrechecked)
+        return true;
+
+    if (!CheckBlockLayout(block, state, true, true) || !CheckBlockTransactions(block, state))
+        return false;
+
+    block.fPrechecked = true;
+    return true;
+}
+
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    AssertLockHeld(cs_main);
+
+    if (block.fChecked)
+        return true;
+
+    // These are checks that are independent of context, unless PreCheckBlock already ran them.
+    const bool fPrechecked = block.fPrechecked && fCheckPOW && fCheckMerkleRoot;
+    if (!fPrechecked && !CheckBlockLayout(block, state, fCheckPOW, fCheckMerkleRoot))
+        return false;
+
     // masternode payments / budgets
     CBlockIndex* pindexPrev = chainActive.Tip();
     int nHeight = 0;
@@ -3175,25 +3352,8 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
-    // Check transactions
-    for (const CTransaction& tx : block.vtx) {
-        if (!CheckTransaction(
-                tx,
-                state
-        ))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                             strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
-
-    }
-
-    unsigned int nSigOps = 0;
-    for (const CTransaction& tx : block.vtx) {
-        nSigOps += GetLegacySigOpCount(tx);
-    }
-    unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_LEGACY;
-    if (nSigOps > nMaxBlockSigOps)
-        return state.DoS(100, error("%s : out-of-bounds SigOpCount", __func__),
-            REJECT_INVALID, "bad-blk-sigops", true);
+    if (!fPrechecked && !CheckBlockTransactions(block, state))
+        return false;
 
     if (fCheckPOW && fCheckMerkleRoot && fCheckSig)
         block.fChecked = true;
@@ -3343,7 +3503,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     const Consensus::Params& consensus = Params().GetConsensus();
 
     // Check that all transactions are finalized
-    for (const CTransaction& tx : block.vtx) {
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if (!IsFinalTx(tx, nHeight, block.GetBlockTime())) {
             return state.DoS(10, false, REJECT_INVALID, "bad-txns-nonfinal", false, "non-final transaction");
         }
@@ -3351,7 +3512,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 
     // ----------- burn address scanning -----------
     if (!consensus.mBurnAddresses.empty()) {
-        for (const CTransaction& tx : block.vtx) {
+        for (const auto& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             if (!tx.IsCoinBase()) {
                 for (unsigned int i = 0; i < tx.vin.size(); ++i) {
                     uint256 hashBlock;
@@ -3540,7 +3702,7 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppi
         bool isBlockFromFork = pindexPrev != nullptr && chainActive.Tip() != pindexPrev;
 
         // Coin stake
-        const CTransaction &stakeTxIn = block.vtx[1];
+        const CTransaction &stakeTxIn = *block.vtx[1];
 
         // Inputs
         std::vector<CTxIn> pivInputs;
@@ -3553,7 +3715,8 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppi
 
         // Check for serial double spent on the same block, TODO: Move this to the proper method..
 
-        for (const CTransaction& tx : block.vtx) {
+        for (const auto& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             for (const CTxIn& in: tx.vin) {
                 if(tx.IsCoinStake()) continue;
                 if(hasPIVInputs) {
@@ -3590,7 +3753,8 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppi
                 }
 
                 // Loop through every tx of this block
-                for (const CTransaction& t : bl.vtx) {
+                for (const auto& pt : bl.vtx) {
+                    const CTransaction& t = *pt;
                     // Loop through every input of this tx
                     for (const CTxIn& in: t.vin) {
 
@@ -3866,9 +4030,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -3876,27 +4038,307 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
-bool static LoadBlockIndexDB(std::string& strError)
+/**
+ * Run fn over [0, nCount) split into contiguous bands, one per script verification thread.
+ * fn must only touch the entries of its own band. Returns false if any band failed.
+ */
+static bool ForEachBlockIndexBand(size_t nCount, const std::function<bool(size_t, size_t)>& fn)
+{
+    static const size_t MIN_BAND_SIZE = 10000;
+    const size_t nBands = std::min((size_t) std::max(nScriptCheckThreads, 1), std::max(nCount / MIN_BAND_SIZE, (size_t) 1));
+    if (nBands <= 1)
+        return fn(0, nCount);
+
+    const size_t nBandSize = (nCount + nBands - 1) / nBands;
+    std::atomic<bool> fOk{true};
+    std::vector<std::thread> vWorkers;
+    for (size_t nBegin = nBandSize; nBegin < nCount; nBegin += nBandSize) {
+        vWorkers.emplace_back([&fn, &fOk, nBegin, nBandSize, nCount]() {
+            if (!fn(nBegin, std::min(nBegin + nBandSize, nCount)))
+                fOk = false;
+        });
+    }
+    if (!fn(0, nBandSize))
+        fOk = false;
+    for (std::thread& worker : vWorkers)
+        worker.join();
+    return fOk;
+}
+
+/**
+ * Block index snapshot (blocks/index.snapshot): a flat array of fixed-size
+ * records sorted by height, with pprev and pskip stored as record positions.
+ * It is written at a clean shutdown, right after the last flush, and consumed
+ * by the next start. The block tree database stays the authoritative copy.
+ */
+static const uint32_t BLOCK_INDEX_SNAPSHOT_MAGIC = 0x78646962; // "bidx"
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+static const size_t BLOCK_INDEX_SNAPSHOT_HEADER_SIZE = 64;
+static const size_t BLOCK_INDEX_SNAPSHOT_RECORD_SIZE = 216;
+static const uint32_t BLOCK_INDEX_SNAPSHOT_NONE = 0xffffffff;
+
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+//! The header ties the snapshot to the chainstate tip and the block files it was written with
+static void EncodeBlockIndexSnapshotHeader(unsigned char* p, uint32_t nCount)
+{
+    int nLastFile = 0;
+    pblocktree->ReadLastBlockFile(nLastFile);
+    CBlockFileInfo info;
+    pblocktree->ReadBlockFileInfo(nLastFile, info);
+
+    memset(p, 0, BLOCK_INDEX_SNAPSHOT_HEADER_SIZE);
+    WriteLE32(p, BLOCK_INDEX_SNAPSHOT_MAGIC);
+    WriteLE32(p + 4, BLOCK_INDEX_SNAPSHOT_VERSION);
+    WriteLE32(p + 8, BLOCK_INDEX_SNAPSHOT_RECORD_SIZE);
+    WriteLE32(p + 12, nCount);
+    const uint256 hashBestChain = pcoinsTip->GetBestBlock();
+    memcpy(p + 16, hashBestChain.begin(), 32);
+    WriteLE32(p + 48, nLastFile);
+    WriteLE32(p + 52, info.nBlocks);
+    WriteLE32(p + 56, info.nSize);
+    WriteLE32(p + 60, info.nUndoSize);
+}
+
+static void EncodeBlockIndexRecord(unsigned char* p, const CBlockIndex* pindex, uint32_t nPrev, uint32_t nSkip)
+{
+    memset(p, 0, BLOCK_INDEX_SNAPSHOT_RECORD_SIZE);
+    memcpy(p, pindex->phashBlock->begin(), 32);
+    memcpy(p + 32, pindex->hashMerkleRoot.begin(), 32);
+    const CBlockIndexCold& cold = pindex->cold.Get();
+    memcpy(p + 64, cold.nAccumulatorCheckpoint.begin(), 32);
+    memcpy(p + 96, cold.vchStakeModifier, 32);
+    memcpy(p + 128, pindex->hashPaidPayee.begin(), 20);
+    WriteLE32(p + 148, nPrev);
+    WriteLE32(p + 152, nSkip);
+    WriteLE32(p + 156, pindex->nHeight);
+    WriteLE32(p + 160, pindex->nFile);
+    WriteLE32(p + 164, pindex->nDataPos);
+    WriteLE32(p + 168, pindex->nUndoPos);
+    WriteLE32(p + 172, pindex->nTx);
+    WriteLE32(p + 176, pindex->nStatus);
+    WriteLE32(p + 180, pindex->nFlags);
+    WriteLE32(p + 184, pindex->nVersion);
+    WriteLE32(p + 188, pindex->nTime);
+    WriteLE32(p + 192, pindex->nBits);
+    WriteLE32(p + 196, pindex->nNonce);
+    WriteLE64(p + 200, cold.nMoneySupply);
+    p[208] = cold.nStakeModifierSize;
+    p[209] = cold.fHaveMoneySupply ? 1 : 0;
+}
+
+static bool DecodeBlockIndexRecord(const unsigned char* p, CBlockIndex* pindex)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    if (p[208] > 32)
         return false;
 
-    boost::this_thread::interruption_point();
+    memcpy(pindex->hashMerkleRoot.begin(), p + 32, 32);
+    CBlockIndexCold& cold = pindex->cold.Get();
+    memcpy(cold.nAccumulatorCheckpoint.begin(), p + 64, 32);
+    memcpy(cold.vchStakeModifier, p + 96, 32);
+    cold.nStakeModifierSize = p[208];
+    memcpy(pindex->hashPaidPayee.begin(), p + 128, 20);
+    pindex->nHeight = ReadLE32(p + 156);
+    pindex->nFile = ReadLE32(p + 160);
+    pindex->nDataPos = ReadLE32(p + 164);
+    pindex->nUndoPos = ReadLE32(p + 168);
+    pindex->nTx = ReadLE32(p + 172);
+    pindex->nStatus = ReadLE32(p + 176);
+    pindex->nFlags = ReadLE32(p + 180);
+    pindex->nVersion = ReadLE32(p + 184);
+    pindex->nTime = ReadLE32(p + 188);
+    pindex->nBits = ReadLE32(p + 192);
+    pindex->nNonce = ReadLE32(p + 196);
+    cold.nMoneySupply = ReadLE64(p + 200);
+    cold.fHaveMoneySupply = p[209] != 0;
+    return true;
+}
+
+bool WriteBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
 
-    // Calculate nChainWork
+    // Only a block index that fully reached the database may be snapshotted
+    if (!pcoinsTip || !pblocktree || !setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty())
+        return false;
+
+    int64_t nStart = GetTimeMillis();
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vSortedByHeight.emplace_back(item.second->nHeight, item.second);
     std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const PAIRTYPE(int, CBlockIndex*) & item : vSortedByHeight) {
+
+    std::unordered_map<const CBlockIndex*, uint32_t> mapPosition;
+    mapPosition.reserve(vSortedByHeight.size());
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
+        mapPosition.emplace(vSortedByHeight[i].second, i);
+
+    const fs::path path = GetBlockIndexSnapshotPath();
+    const fs::path pathTmp = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s : failed to open %s", __func__, pathTmp.string());
+
+    try {
+        std::vector<unsigned char> vBuffer(BLOCK_INDEX_SNAPSHOT_HEADER_SIZE);
+        EncodeBlockIndexSnapshotHeader(vBuffer.data(), vSortedByHeight.size());
+        fileout.write((const char*) vBuffer.data(), vBuffer.size());
+
+        static const size_t RECORDS_PER_WRITE = 4096;
+        vBuffer.resize(RECORDS_PER_WRITE * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE);
+        size_t nBuffered = 0;
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            const CBlockIndex* pindex = item.second;
+            const uint32_t nPrev = pindex->pprev ? mapPosition.at(pindex->pprev) : BLOCK_INDEX_SNAPSHOT_NONE;
+            const uint32_t nSkip = pindex->pskip ? mapPosition.at(pindex->pskip) : BLOCK_INDEX_SNAPSHOT_NONE;
+            EncodeBlockIndexRecord(&vBuffer[nBuffered * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE], pindex, nPrev, nSkip);
+            if (++nBuffered == RECORDS_PER_WRITE) {
+                fileout.write((const char*) vBuffer.data(), nBuffered * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE);
+                nBuffered = 0;
+            }
+        }
+        fileout.write((const char*) vBuffer.data(), nBuffered * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE);
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s : failed to write %s: %s", __func__, pathTmp.string(), e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s : failed to rename %s", __func__, pathTmp.string());
+
+    LogPrintf("%s: %u entries, %dms\n", __func__, vSortedByHeight.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+static void RemoveBlockIndexSnapshot()
+{
+    try {
+        fs::remove(GetBlockIndexSnapshotPath());
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+}
+
+/**
+ * Rebuild mapBlockIndex from the snapshot left by the last clean shutdown, if it
+ * still matches the databases. Leaves the index empty when it returns false.
+ */
+static bool LoadBlockIndexSnapshot(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    const fs::path path = GetBlockIndexSnapshotPath();
+    if (!fs::exists(path))
+        return false;
+
+    CMappedFile file(path);
+    // Consumed by this start: the database moves on from here, a later start
+    // must not pick up a stale copy if this session does not end cleanly
+    RemoveBlockIndexSnapshot();
+    if (file.IsNull() || file.size() < BLOCK_INDEX_SNAPSHOT_HEADER_SIZE)
+        return false;
+
+    const unsigned char* pdata = file.data();
+    const uint32_t nCount = ReadLE32(pdata + 12);
+    unsigned char vHeader[BLOCK_INDEX_SNAPSHOT_HEADER_SIZE];
+    EncodeBlockIndexSnapshotHeader(vHeader, nCount);
+    if (memcmp(vHeader, pdata, BLOCK_INDEX_SNAPSHOT_HEADER_SIZE) != 0 ||
+            file.size() != BLOCK_INDEX_SNAPSHOT_HEADER_SIZE + (size_t) nCount * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE) {
+        LogPrintf("%s: snapshot does not match the block tree database, ignoring it\n", __func__);
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    const unsigned char* precords = pdata + BLOCK_INDEX_SNAPSHOT_HEADER_SIZE;
+    std::vector<CBlockIndex*> vIndex(nCount);
+    blockIndexArena.Reserve(nCount);
+    mapBlockIndex.reserve(nCount);
+    bool fOk = true;
+    for (uint32_t i = 0; i < nCount && fOk; i++) {
+        uint256 hash;
+        memcpy(hash.begin(), precords + (size_t) i * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE, 32);
+        CBlockIndex* pindex = blockIndexArena.Allocate();
+        std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.emplace(hash, pindex);
+        fOk = ret.second;
+        pindex->phashBlock = &ret.first->first;
+        vIndex[i] = pindex;
+    }
+
+    // Decode the records and link pprev/pskip, each band on its own thread
+    fOk = fOk && ForEachBlockIndexBand(nCount, [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const unsigned char* p = precords + i * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE;
+            CBlockIndex* pindex = vIndex[i];
+            if (!DecodeBlockIndexRecord(p, pindex))
+                return false;
+            const uint32_t nPrev = ReadLE32(p + 148);
+            const uint32_t nSkip = ReadLE32(p + 152);
+            if (nPrev != BLOCK_INDEX_SNAPSHOT_NONE) {
+                // records are sorted by height, ancestors always come first
+                if (nPrev >= i || (int) ReadLE32(precords + (size_t) nPrev * BLOCK_INDEX_SNAPSHOT_RECORD_SIZE + 156) != pindex->nHeight - 1)
+                    return false;
+                pindex->pprev = vIndex[nPrev];
+            }
+            if (nSkip != BLOCK_INDEX_SNAPSHOT_NONE) {
+                if (nSkip >= i)
+                    return false;
+                pindex->pskip = vIndex[nSkip];
+            }
+        }
+        return true;
+    });
+
+    if (!fOk) {
+        LogPrintf("%s: snapshot is corrupted, ignoring it\n", __func__);
+        mapBlockIndex.clear();
+        blockIndexArena.Clear();
+        return false;
+    }
+
+    vSortedByHeight.reserve(nCount);
+    for (CBlockIndex* pindex : vIndex)
+        vSortedByHeight.emplace_back(pindex->nHeight, pindex);
+
+    LogPrintf("%s: %u entries, %dms\n", __func__, nCount, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool static LoadBlockIndexDB(std::string& strError)
+{
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    const bool fSnapshot = LoadBlockIndexSnapshot(vSortedByHeight);
+    if (!fSnapshot) {
+        if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+            return false;
+
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    }
+
+    boost::this_thread::interruption_point();
+
+    // Calculate nChainWork: the proofs of work in parallel height bands, then their sums along the chain
+    std::vector<uint256> vBlockProof(vSortedByHeight.size());
+    ForEachBlockIndexBand(vSortedByHeight.size(), [&](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++)
+            vBlockProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+        return true;
+    });
+    for (size_t i = 0; i < vSortedByHeight.size(); i++) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
 
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         if (pindex->nStatus & BLOCK_HAVE_DATA) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
@@ -3913,7 +4355,8 @@ bool static LoadBlockIndexDB(std::string& strError)
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
+        // the snapshot already carries the skip pointers
+        if (pindex->pprev && !fSnapshot)
             pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
@@ -4111,7 +4554,7 @@ void ResyncSupply()
         pcursor->Next();
     }
 
-    chainActive.Tip()->nMoneySupply = nMoneySupply;
+    chainActive.Tip()->SetMoneySupply(nMoneySupply);
 }
 
 bool RewindBlockIndex(std::string param)
@@ -4246,8 +4689,9 @@ bool RewindBlockIndex(std::string param)
     for (auto pindex : vBlocks) {
         auto ret = mapBlockIndex.find(*pindex->phashBlock);
         if (ret != mapBlockIndex.end()) {
+            CBlockIndex* pindexErase = ret->second;
             mapBlockIndex.erase(ret);
-            delete pindex;
+            blockIndexArena.Free(pindexErase);
         }
     }
 
@@ -4286,14 +4730,16 @@ void UnloadBlockIndex()
     mapNodeState.clear();
     recentRejects.reset(nullptr);
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
 {
+    // A reindex rebuilds the block tree database the snapshot was taken from
+    if (fReindex)
+        RemoveBlockIndexSnapshot();
+
     // Load block index from databases
     if (!fReindex && !LoadBlockIndexDB(strError))
         return false;
@@ -4343,10 +4789,62 @@ bool InitBlockIndex()
 }
 
 
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/** Hand a block read from an import file to validation, followed by the blocks
+ *  found before it that were waiting for it. Returns false on a fatal error. */
+static bool ImportBlock(const CBlock& block, CDiskBlockPos* dbp, int& nLoaded)
+{
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                hash.GetHex(), block.hashPrevBlock.GetHex());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        CValidationState state;
+        if (ProcessNewBlock(state, nullptr, &block, dbp, nullptr))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    CBlock blockChild;
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            if (ReadBlockFromDisk(blockChild, it->second)) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                    head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, nullptr, &blockChild, &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(blockChild.GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -4388,49 +4886,8 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                            hash.GetHex(), block.hashPrevBlock.GetHex());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, nullptr, &block, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, nullptr, &block, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
+                if (!ImportBlock(block, dbp, nLoaded))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -4443,6 +4900,217 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
     return nLoaded > 0;
 }
 
+//! A block header found in an import file, and the block the import workers decoded after it
+struct CImportCandidate {
+    uint64_t nMagicPos;
+    uint64_t nBlockPos;
+    unsigned int nSize;
+    //! where decoding the block stopped, zero if it failed
+    uint64_t nEndPos;
+    std::unique_ptr<CBlock> pblock;
+};
+
+//! Bytes of the file the import workers may decode ahead of the block being connected
+static const uint64_t IMPORT_DECODE_WINDOW = 64 * 1024 * 1024;
+
+/** Find the first block header at or after nPos, skipping bad message starts
+ *  and sizes one byte at a time like the buffered importer does. */
+static bool FindImportHeader(const unsigned char* pdata, uint64_t nFileSize, uint64_t nPos, CImportCandidate& candidate)
+{
+    const unsigned char* pchMessageStart = Params().MessageStart();
+    while (nPos + MESSAGE_START_SIZE + 4 <= nFileSize) {
+        const unsigned char* pch = (const unsigned char*)memchr(pdata + nPos, pchMessageStart[0], nFileSize - nPos);
+        if (!pch)
+            return false;
+        nPos = pch - pdata;
+        if (nPos + MESSAGE_START_SIZE + 4 > nFileSize)
+            return false;
+        if (memcmp(pch, pchMessageStart, MESSAGE_START_SIZE) == 0) {
+            const unsigned int nSize = ReadLE32(pch + MESSAGE_START_SIZE);
+            const uint64_t nBlockPos = nPos + MESSAGE_START_SIZE + 4;
+            // a block cut short by the end of the file fails to decode, which is the same as skipping it
+            if (nSize >= 80 && nSize <= MAX_BLOCK_SIZE_CURRENT && nBlockPos + nSize <= nFileSize) {
+                candidate.nMagicPos = nPos;
+                candidate.nBlockPos = nBlockPos;
+                candidate.nSize = nSize;
+                candidate.nEndPos = 0;
+                return true;
+            }
+        }
+        nPos++;
+    }
+    return false;
+}
+
+//! Decode the block of a candidate, and optionally run the checks that don't need the chain on it
+static void DecodeImportCandidate(const unsigned char* pdata, CImportCandidate& candidate, bool fCheck)
+{
+    candidate.nEndPos = 0;
+    candidate.pblock.reset(new CBlock());
+    try {
+        const char* pbegin = (const char*)pdata + candidate.nBlockPos;
+        CDataStream ss(pbegin, pbegin + candidate.nSize, SER_DISK, CLIENT_VERSION);
+        ss >> *candidate.pblock;
+        candidate.nEndPos = candidate.nBlockPos + candidate.nSize - ss.size();
+    } catch (const std::exception& e) {
+        LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+        candidate.pblock.reset();
+        return;
+    }
+
+    // A failure is reported when the block is connected
+    CValidationState state;
+    if (fCheck && PreCheckBlock(*candidate.pblock, state))
+        CheckBlockSignature(*candidate.pblock, true);
+}
+
+bool LoadExternalBlockFile(const fs::path& path, CDiskBlockPos* dbp)
+{
+    const int64_t nStart = GetTimeMillis();
+
+    CMappedFile file(path);
+    if (file.IsNull()) {
+        FILE* fileIn = fsbridge::fopen(path, "rb");
+        if (!fileIn)
+            return error("%s: unable to open %s", __func__, path.string());
+        return LoadExternalBlockFile(fileIn, dbp);
+    }
+    const unsigned char* pdata = file.data();
+    const uint64_t nFileSize = file.size();
+
+    // Scan: find the block headers, jumping from each one over the block it announces
+    std::vector<CImportCandidate> vCandidates;
+    {
+        CImportCandidate candidate;
+        for (uint64_t nPos = 0; FindImportHeader(pdata, nFileSize, nPos, candidate); nPos = candidate.nBlockPos + candidate.nSize)
+            vCandidates.push_back(std::move(candidate));
+    }
+    const int64_t nScanned = GetTimeMillis();
+
+    // Decode and check: workers take the blocks in file order, staying within
+    // IMPORT_DECODE_WINDOW of the block the connect stage is waiting for
+    std::mutex csImport;
+    std::condition_variable cvDecoded, cvWindow;
+    std::vector<char> vDecoded(vCandidates.size(), 0);
+    size_t nNextDecode = 0;
+    size_t nConnecting = 0;
+    bool fStop = false;
+    std::atomic<int64_t> nDecodeMicros{0};
+    auto decode = [&]() {
+        while (true) {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(csImport);
+                cvWindow.wait(lock, [&] {
+                    return fStop || nNextDecode >= vCandidates.size() ||
+                           vCandidates[nNextDecode].nMagicPos < vCandidates[nConnecting].nMagicPos + IMPORT_DECODE_WINDOW;
+                });
+                if (fStop || nNextDecode >= vCandidates.size())
+                    return;
+                i = nNextDecode++;
+            }
+            const int64_t nTimeStart = GetTimeMicros();
+            DecodeImportCandidate(pdata, vCandidates[i], true);
+            nDecodeMicros += GetTimeMicros() - nTimeStart;
+            {
+                std::lock_guard<std::mutex> lock(csImport);
+                vDecoded[i] = 1;
+            }
+            cvDecoded.notify_all();
+        }
+    };
+    const int nThreads = std::max(1, GetNumCores() - 1);
+    std::vector<std::thread> vWorkers;
+    for (int i = 0; i < nThreads && !vCandidates.empty(); i++)
+        vWorkers.emplace_back(decode);
+    auto stopWorkers = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(csImport);
+            fStop = true;
+        }
+        cvWindow.notify_all();
+        for (std::thread& worker : vWorkers)
+            worker.join();
+        vWorkers.clear();
+    };
+
+    // Connect: one block at a time in file order, as the buffered importer does
+    int nLoaded = 0;
+    int64_t nWaitMicros = 0;
+    int64_t nConnectMicros = 0;
+    auto connect = [&](const CImportCandidate& candidate) {
+        const int64_t nTimeStart = GetTimeMicros();
+        bool fContinue = true;
+        try {
+            CDiskBlockPos pos;
+            if (dbp)
+                pos = CDiskBlockPos(dbp->nFile, candidate.nBlockPos);
+            fContinue = ImportBlock(*candidate.pblock, dbp ? &pos : nullptr, nLoaded);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+        nConnectMicros += GetTimeMicros() - nTimeStart;
+        return fContinue;
+    };
+    try {
+        bool fContinue = true;
+        size_t i = 0;
+        while (fContinue && i < vCandidates.size()) {
+            boost::this_thread::interruption_point();
+
+            CImportCandidate& candidate = vCandidates[i];
+            {
+                const int64_t nTimeStart = GetTimeMicros();
+                std::unique_lock<std::mutex> lock(csImport);
+                nConnecting = i;
+                nNextDecode = std::max(nNextDecode, i);
+                cvWindow.notify_all();
+                cvDecoded.wait(lock, [&] { return vDecoded[i] != 0; });
+                nWaitMicros += GetTimeMicros() - nTimeStart;
+            }
+
+            uint64_t nResume = candidate.nMagicPos + 1;
+            if (candidate.pblock) {
+                fContinue = connect(candidate);
+                nResume = candidate.nEndPos;
+                candidate.pblock.reset();
+            }
+            if (nResume == candidate.nBlockPos + candidate.nSize) {
+                i++;
+                continue;
+            }
+
+            // The buffered importer would carry on from somewhere the scan
+            // jumped over: follow it until it finds a header the scan found too
+            i = vCandidates.size();
+            CImportCandidate found;
+            while (fContinue && FindImportHeader(pdata, nFileSize, nResume, found)) {
+                auto it = std::lower_bound(vCandidates.begin(), vCandidates.end(), found.nMagicPos,
+                    [](const CImportCandidate& c, uint64_t nMagicPos) { return c.nMagicPos < nMagicPos; });
+                if (it != vCandidates.end() && it->nMagicPos == found.nMagicPos) {
+                    i = it - vCandidates.begin();
+                    break;
+                }
+                DecodeImportCandidate(pdata, found, false);
+                nResume = found.nMagicPos + 1;
+                if (found.pblock) {
+                    fContinue = connect(found);
+                    nResume = found.nEndPos;
+                }
+            }
+        }
+    } catch (...) {
+        stopWorkers();
+        throw;
+    }
+    stopWorkers();
+
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms (scan %dms, decode and check %dms on %d threads, connect %dms, waiting for decoding %dms)\n",
+            nLoaded, GetTimeMillis() - nStart, nScanned - nStart, nDecodeMicros / 1000, nThreads, nConnectMicros / 1000, nWaitMicros / 1000);
+    return nLoaded > 0;
+}
+
 void static CheckBlockIndex()
 {
     if (!fCheckBlockIndex) {
@@ -4765,7 +5433,7 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                             // however we MUST always provide at least what the remote peer needs
                             typedef std::pair<unsigned int, uint256> PairType;
                             for (PairType& pair : merkleBlock.vMatchedTxn)
-                                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, block.vtx[pair.first]));
+                                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
                         }
                         // else
                         // no response
@@ -4795,11 +5463,11 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
                 }
 
                 if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
+                    CTransactionRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << tx;
+                        ss << *ptx;
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, ss));
                         pushed = true;
                     }
@@ -4857,6 +5525,107 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, std::atomic<bool>& i
     }
 }
 
+/** A message ProcessMessage hands on to the masternode and spork managers */
+struct ExtensionMsgHandler {
+    std::function<void(CNode*, std::string&, CDataStream&)> handler;
+    // reads the signed message, so its signatures can be checked before the handler
+    // runs without touching any state
+    std::function<std::shared_ptr<const CSignedMessage>(CDataStream&)> readSigned;
+    // bursts of the message are checked together on the masternode check queue
+    // instead of one by one on a message worker
+    bool fBatchCheck;
+};
+
+template <typename T>
+static std::shared_ptr<const CSignedMessage> ReadSignedMessage(CDataStream& vRecv)
+{
+    auto pmessage = std::make_shared<T>();
+    vRecv >> *pmessage;
+    return pmessage;
+}
+
+static const std::unordered_map<std::string, ExtensionMsgHandler>& GetExtensionMsgHandlers()
+{
+    static const auto mnodemanHandler = [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv) {
+        mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
+    };
+    static const auto sporkHandler = [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv) {
+        sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
+    };
+    static const auto syncHandler = [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv) {
+        masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
+    };
+    static const std::unordered_map<std::string, ExtensionMsgHandler> mapHandlers = {
+        {NetMsgType::MNBROADCAST, {mnodemanHandler, ReadSignedMessage<CMasternodeBroadcast>, true}},
+        {NetMsgType::MNPING, {mnodemanHandler, ReadSignedMessage<CMasternodePing>, true}},
+        {NetMsgType::GETMNLIST, {mnodemanHandler, nullptr, false}},
+        {NetMsgType::SPORK, {sporkHandler, ReadSignedMessage<CSporkMessage>, false}},
+        {NetMsgType::GETSPORKS, {sporkHandler, nullptr, false}},
+        {NetMsgType::SYNCSTATUSCOUNT, {syncHandler, nullptr, false}},
+    };
+    return mapHandlers;
+}
+
+static bool IsKnownMessageType(const std::string& strCommand)
+{
+    static const std::unordered_set<std::string> setAllMessages(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    return setAllMessages.count(strCommand) > 0;
+}
+
+// Check the signatures of a masternode message together with those of the broadcasts and
+// pings queued right behind it. Returns how many of the queued messages were covered.
+static int CheckMasternodeMessageBatch(CNode* pfrom, const ExtensionMsgHandler& handler, CDataStream& vRecv)
+{
+    const auto& mapHandlers = GetExtensionMsgHandlers();
+    std::vector<std::pair<const ExtensionMsgHandler*, CDataStream>> vQueued;
+    {
+        LOCK(pfrom->cs_vProcessMsg);
+        for (const CNetMessage& msg : pfrom->vProcessMsg) {
+            if (vQueued.size() + 1 >= MAX_MASTERNODE_SIG_BATCH)
+                break;
+            const auto it = mapHandlers.find(msg.hdr.GetCommand());
+            if (it == mapHandlers.end() || !it->second.fBatchCheck)
+                break;
+            vQueued.emplace_back(&it->second, msg.vRecv);
+        }
+    }
+
+    std::vector<CMasternodeSigCheck> vChecks;
+    vChecks.reserve(vQueued.size() + 1);
+    try {
+        CDataStream vRecvCopy(vRecv);
+        vChecks.emplace_back(handler.readSigned(vRecvCopy));
+    } catch (const std::exception&) {
+        // the handler will complain about it
+    }
+    for (auto& queued : vQueued) {
+        try {
+            queued.second.SetVersion(pfrom->GetRecvVersion());
+            vChecks.emplace_back(queued.first->readSigned(queued.second));
+        } catch (const std::exception&) {
+            // so will the handler of this one, when it gets there
+        }
+    }
+    CheckMasternodeSignatures(vChecks);
+
+    return vQueued.size();
+}
+
+// Run an extension message after its signatures were precomputed, catching what ProcessMessages would
+static void ProcessExtensionMessage(const ExtensionMsgHandler& handler, CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
+{
+    try {
+        handler.handler(pfrom, strCommand, vRecv);
+    } catch (const std::ios_base::failure& e) {
+        connman.PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::REJECT, strCommand, REJECT_MALFORMED, std::string("error parsing message")));
+        LogPrintf("%s(%s, %u bytes): Exception '%s' caught\n", __func__, SanitizeString(strCommand), vRecv.size(), e.what());
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "ProcessExtensionMessage()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ProcessExtensionMessage()");
+    }
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -5265,14 +6034,15 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     else if (strCommand == NetMsgType::TX) {
         std::vector<uint256> vWorkQueue;
         std::vector<uint256> vEraseQueue;
-        CTransaction tx;
+        CTransactionRef ptx;
 
         //masternode signed transaction
         bool ignoreFees = false;
         CTxIn vin;
         std::vector<unsigned char> vchSig;
 
-        vRecv >> tx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -5282,7 +6052,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         bool fMissingInputs = false;
         CValidationState state;
 
-        if (AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) 
+        if (AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) 
         {
             WITH_LOCK(cs_main, mempool.check(pcoinsTip)); 
             
@@ -5307,7 +6077,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                         mi != itByPrev->second.end();
                         ++mi) {
                         const uint256& orphanHash = *mi;
-                        const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                        const CTransactionRef& porphanTx = mapOrphanTransactions[orphanHash].tx;
+                        const CTransaction& orphanTx = *porphanTx;
                         NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                         bool fMissingInputs2 = false;
                         // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -5318,7 +6089,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
                         if (setMisbehaving.count(fromPeer))
                             continue;
-                        if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
+                        if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2)) {
                             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
                             RelayTransaction(orphanTx, connman);
                             vWorkQueue.push_back(orphanHash);
@@ -5348,7 +6119,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         } else if (fMissingInputs) {
             LOCK(cs_main);
 
-            AddOrphanTx(tx, pfrom->GetId());
+            AddOrphanTx(ptx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -5520,10 +6291,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         std::vector<CInv> vInv;
         for (uint256& hash : vtxid) {
             CInv inv(MSG_TX, hash);
-            CTransaction tx;
-            bool fInMemPool = mempool.lookup(hash, tx);
-            if (!fInMemPool) continue; // another thread removed since queryHashes, maybe...
-            if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(tx)) ||
+            CTransactionRef ptx = mempool.get(hash);
+            if (!ptx) continue; // another thread removed since queryHashes, maybe...
+            if ((pfrom->pfilter && pfrom->pfilter->IsRelevantAndUpdate(*ptx)) ||
                 (!pfrom->pfilter))
                 vInv.push_back(inv);
             if (vInv.size() == MAX_INV_SZ) {
@@ -5692,21 +6462,37 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             LogPrint(BCLog::NET, "Unparseable reject message received\n");
         }
     } else {
-        bool found = false;
-        const std::vector<std::string>& allMessages = getAllNetMessageTypes();
-        for (const std::string& msg : allMessages) {
-            if (msg == strCommand) {
-                found = true;
-                break;
+        const auto& mapHandlers = GetExtensionMsgHandlers();
+        const auto it = mapHandlers.find(strCommand);
+
+        if (it != mapHandlers.end()) {
+            //one of the extensions
+            const ExtensionMsgHandler& handler = it->second;
+            if (handler.fBatchCheck && nScriptCheckThreads) {
+                // a masternode list sync or restart brings thousands of these at once
+                if (pfrom->nBatchCheckedMessages > 0)
+                    pfrom->nBatchCheckedMessages--;
+                else
+                    pfrom->nBatchCheckedMessages = CheckMasternodeMessageBatch(pfrom, handler, vRecv);
+            } else if (handler.readSigned) {
+                // verify masternode and spork signatures without holding up block and transaction relay
+                auto pvRecvWork = std::make_shared<CDataStream>(vRecv);
+                auto work = [&handler, pvRecvWork]() {
+                    CDataStream vRecvCopy(*pvRecvWork);
+                    try {
+                        handler.readSigned(vRecvCopy)->PrecomputeSignature();
+                    } catch (const std::exception&) {
+                        // the handler will complain about it
+                    }
+                };
+                auto finish = [&handler, pfrom, strCommand, pvRecvWork, &connman]() mutable {
+                    ProcessExtensionMessage(handler, pfrom, strCommand, *pvRecvWork, connman);
+                };
+                if (connman.QueueMessageWork(pfrom, work, finish))
+                    return true;
             }
-        }
-
-        if (found) {
-            //probably one the extensions
-            mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
-            sporkManager.ProcessSpork(pfrom, strCommand, vRecv);
-            masternodeSync.ProcessMessage(pfrom, strCommand, vRecv);
-        } else {
+            handler.handler(pfrom, strCommand, vRecv);
+        } else if (!IsKnownMessageType(strCommand)) {
             // Ignore unknown commands for extensibility
             LogPrint(BCLog::NET, "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
         }
@@ -5749,7 +6535,13 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     if (pfrom->fPauseSend)
         return false;
 
+    // Don't handle the next message ahead of the work still queued for this peer,
+    // the message handler is woken up when the worker gets through it
+    if (connman.IsMessageWorkBacklogged(pfrom))
+        return false;
+
     std::list<CNetMessage> msgs;
+    bool fResumeRecv = false;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -5757,9 +6549,13 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        const bool fWasPaused = pfrom->fPauseRecv;
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
+        fResumeRecv = fWasPaused && !pfrom->fPauseRecv;
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    if (fResumeRecv)
+        connman.WakeSocketHandler();
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
@@ -6067,10 +6863,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -51,6 +51,8 @@ class CBloomFilter;
 class CInv;
 class CConnman;
 class CScriptCheck;
+class CSupplyDelta;
+class CUTXOStats;
 class CValidationInterface;
 class CValidationState;
 
@@ -143,6 +145,7 @@ extern RecursiveMutex cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -202,12 +205,16 @@ FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/** Import blocks from an external file, decoding and checking them on all cores ahead of connecting them */
+bool LoadExternalBlockFile(const fs::path& path, CDiskBlockPos* dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(std::string& strError);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Dump the flushed block index for a fast load at the next start */
+bool WriteBlockIndexSnapshot();
 /** See whether the protocol update is enforced for connected nodes */
 int ActiveProtocol();
 /** Process protocol messages received from a given node */
@@ -251,7 +258,7 @@ void FlushStateToDisk();
 
 
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
 bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fRejectInsaneFee = false, bool isDSTX = false);
 
@@ -282,9 +289,16 @@ CAmount GetMinRelayFee(const CTransaction& tx, const CTxMemPool& pool, unsigned
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. cacheSigStore stores the verified signatures in the
+ * signature cache, cacheFullScriptStore the transaction and flags in the script execution cache.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+
+/** Initialize the script execution cache, sized by -maxsigcachesize */
+void InitScriptExecutionCache();
+
+/** Script verification flags of a block connected on top of pindexPrev */
+unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -352,6 +366,9 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/** Remember the masternode payee of a block in its index entry, replacing any stored before, so its data isn't read for it again */
+void SetBlockIndexPaidPayee(const CBlockIndex* pindex, const CScript& paidPayee);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -366,12 +383,15 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 bool DisconnectBlocks(int nBlocks);
 void ReprocessBlocks(int nBlocks);
 
-/** Apply the effects of this block (with given index) on the UTXO set represented by coins */
-bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false);
+/** Apply the effects of this block (with given index) on the UTXO set represented by coins.
+ *  In case pSupplyDelta is provided, it receives the coins created and spent by the block. */
+bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins, bool fJustCheck, bool fAlreadyChecked = false, CSupplyDelta* pSupplyDelta = nullptr, CUTXOStats* pStatsDelta = nullptr);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
+/** The checks of CheckBlock that don't depend on the chain, which need no lock. Once passed, CheckBlock skips them. */
+bool PreCheckBlock(const CBlock& block, CValidationState& state);
 bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev);
 
 /** Context-dependent validity checks */
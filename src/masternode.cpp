@@ -188,17 +188,18 @@ void CMasternode::Check(bool forceCheck)
     //once spent, stop doing the checks
     if (activeState == MASTERNODE_VIN_SPENT) return;
 
-    if (!IsPingedWithin(MASTERNODE_REMOVAL_SECONDS)) {
+    const int64_t nNow = GetAdjustedTime();
+    if (!IsPingedWithin(MASTERNODE_REMOVAL_SECONDS, nNow)) {
         activeState = MASTERNODE_REMOVE;
         return;
     }
 
-    if (!IsPingedWithin(MASTERNODE_EXPIRATION_SECONDS)) {
+    if (!IsPingedWithin(MASTERNODE_EXPIRATION_SECONDS, nNow)) {
         activeState = MASTERNODE_EXPIRED;
         return;
     }
 
-    if(lastPing.sigTime - sigTime < MASTERNODE_MIN_MNP_SECONDS) {
+    if (nNow >= GetEnabledUntil()) {
         activeState = MASTERNODE_PRE_ENABLED;
         return;
     }
@@ -206,6 +207,16 @@ void CMasternode::Check(bool forceCheck)
     activeState = MASTERNODE_ENABLED; // OK
 }
 
+int64_t CMasternode::GetEnabledUntil()
+{
+    LOCK(cs);
+
+    if (activeState == MASTERNODE_VIN_SPENT || lastPing.IsNull()) return 0;
+    // not before the ping following the announcement by MASTERNODE_MIN_MNP_SECONDS
+    if (lastPing.sigTime - sigTime < MASTERNODE_MIN_MNP_SECONDS) return 0;
+    return lastPing.sigTime + std::min(MASTERNODE_EXPIRATION_SECONDS, MASTERNODE_REMOVAL_SECONDS);
+}
+
 int CMasternode::BlocksSincePayment(const CBlockIndex* pindex)
 {
     const CScript& mnpayee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
@@ -317,6 +328,14 @@ std::pair<int, CAmount> CMasternode::GetNextMasternodeCollateral(int nHeight) {
     return std::make_pair(-1, -1);
 }
 
+bool CMasternode::IsMasternodeCollateralAmount(CAmount nValue) {
+    if(vecCollaterals.empty()) InitMasternodeCollateralList();
+    for(const auto& p : vecCollaterals) {
+        if(p.second > 0 && p.second == nValue) return true;
+    }
+    return false;
+}
+
 CMasternodeBroadcast::CMasternodeBroadcast() :
         CMasternode()
 { }
@@ -501,6 +520,18 @@ bool CMasternodeBroadcast::CheckSignature() const
     return true;
 }
 
+void CMasternodeBroadcast::PrecomputeSignature() const
+{
+    // the messages CheckSignature accepts, and the ping CheckAndUpdate checks
+    if (nMessVersion == MessageVersion::MESS_VER_HASH) {
+        CHashSigner::PrecomputeHash(CMessageSigner::GetMessageHash(GetSignatureHash().GetHex()), vchSig);
+    } else {
+        CHashSigner::PrecomputeHash(CMessageSigner::GetMessageHash(GetOldStrMessage()), vchSig);
+        CHashSigner::PrecomputeHash(CMessageSigner::GetMessageHash(GetStrMessage()), vchSig);
+    }
+    lastPing.PrecomputeSignature();
+}
+
 bool CMasternodeBroadcast::CheckDefaultPort(CService service, std::string& strErrorRet, const std::string& strContext)
 {
     int nDefaultPort = Params().GetDefaultPort();
@@ -589,6 +620,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
         //take the newest entry
         LogPrint(BCLog::MASTERNODE, "mnb - Got updated entry for %s\n", vin.prevout.ToStringShort());
         if (pmn->UpdateFromNewBroadcast((*this))) {
+            mnodeman.UpdatedMasternode();
             pmn->Check(true);
             if (pmn->IsEnabled()) Relay();
         }
@@ -822,6 +854,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
             }
 
             pmn->lastPing = *this;
+            mnodeman.UpdatedMasternodePing(pmn);
 
             //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
             CMasternodeBroadcast mnb(*pmn);
@@ -220,6 +220,8 @@ public:
     bool UpdateFromNewBroadcast(CMasternodeBroadcast& mnb);
 
     void Check(bool forceCheck = false);
+    //! Until when the last ping keeps the MN enabled for Check(), 0 if it doesn't at any time
+    int64_t GetEnabledUntil();
 
     bool IsBroadcastedWithin(int seconds)
     {
@@ -303,6 +305,7 @@ public:
     static CAmount GetMasternodePayment(int nHeight);
     static void InitMasternodeCollateralList();
     static std::pair<int, CAmount> GetNextMasternodeCollateral(int nHeight);
+    static bool IsMasternodeCollateralAmount(CAmount nValue);
 };
 
 //
@@ -324,6 +327,7 @@ public:
     void Relay();
 
     std::string GetOldStrMessage() const;
+    void PrecomputeSignature() const override;
 
     // special sign/verify
     bool Sign(const CKey& key, const CPubKey& pubKey);
@@ -7,12 +7,14 @@
 #include "masternodeman.h"
 
 #include "addrman.h"
+#include "checkqueue.h"
 #include "fs.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternode.h"
 #include "messagesigner.h"
 #include "netbase.h"
+#include "txdb.h"
 #include "netmessagemaker.h"
 #include "spork.h"
 #include "util.h"
@@ -200,6 +202,33 @@ void DumpMasternodes()
     LogPrint(BCLog::MASTERNODE,"Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
+static CCheckQueue<CMasternodeSigCheck> mnsigcheckqueue(16);
+
+void ThreadMasternodeSigCheck()
+{
+    util::ThreadRename("pivx-mnsigch");
+    mnsigcheckqueue.Thread();
+}
+
+bool CMasternodeSigCheck::operator()()
+{
+    // a bad signature is simply not cached, the handler rejects the message
+    pmessage->PrecomputeSignature();
+    return true;
+}
+
+void CheckMasternodeSignatures(std::vector<CMasternodeSigCheck>& vChecks)
+{
+    if (!nScriptCheckThreads) {
+        for (CMasternodeSigCheck& check : vChecks)
+            check();
+        return;
+    }
+    CCheckQueueControl<CMasternodeSigCheck> control(&mnsigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
@@ -217,6 +246,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if(mnScript) {
         auto it = std::find(vMasternodes.begin(), vMasternodes.end(), mnScript);
         if(it != vMasternodes.end()) vMasternodes.erase(it);
+        nListVersion++;
 
         return false;
     }
@@ -225,6 +255,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
         LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Adding new Masternode %s - count %i now\n", mn.vin.prevout.ToStringShort(), size() + 1);
         auto m = new CMasternode(mn);
         vMasternodes.push_back(m);
+        nListVersion++;
         {
             LOCK(cs_script);
             mapScriptMasternodes[GetScriptForDestination(m->pubKeyCollateralAddress.GetID())] = m;
@@ -319,6 +350,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
             delete *it;
             it = vMasternodes.erase(it);
+            nListVersion++;
         } else {
             ++it;
         }
@@ -398,6 +430,7 @@ void CMasternodeMan::Clear()
             delete *it;
             it = vMasternodes.erase(it);
         }
+        nListVersion++;
         mAskedUsForMasternodeList.clear();
         mWeAskedForMasternodeList.clear();
         mWeAskedForMasternodeListEntry.clear();
@@ -552,6 +585,14 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(const CBlockInde
     const auto nBlockHeight = pindexPrev->nHeight + 1;
     CMasternode* pBestMasternode = nullptr;
 
+    {
+        LOCK2(cs, cs_collaterals);
+        // the usual case: the payee of the next block on top of the tip
+        if (pindexPaymentQueue && pindexPrev == pindexPaymentQueue) {
+            return GetNextMasternodeInPaymentQueue(pindexPrev, fFilterSigTime, nCount, vEligibleTxIns, fJustCount);
+        }
+    }
+
     /*
         Make a vector with all of the last paid times
     */
@@ -610,34 +651,226 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(const CBlockInde
     return pBestMasternode;
 }
 
+CMasternode* CMasternodeMan::GetNextMasternodeInPaymentQueue(const CBlockIndex* pindexPrev, bool fFilterSigTime, int& nCount, std::vector<CTxIn>& vEligibleTxIns, bool fJustCount)
+{
+    AssertLockHeld(cs);
+    AssertLockHeld(cs_collaterals);
+
+    const auto nBlockHeight = pindexPrev->nHeight + 1;
+    const int64_t nPrevTime = pindexPrev->nTime;
+    const int64_t nNow = GetAdjustedTime();
+    CMasternode* pBestMasternode = nullptr;
+
+    vEligibleTxIns.clear();
+    nCount = 0;
+
+    // Only the MNs whose payments or pings changed since the last call are looked at
+    UpdatePaymentQueueEntries(nNow);
+    const int nMnCount = setPaymentQueueEnabledUntil.size();
+    const int nEligibleNetwork = std::max(10, nMnCount * 5 / 100); // oldest 5% or the minimal of 10 MNs
+
+    // Merge the queue and the MNs it can't order in ascending last paid time (i.e. descending SecondsSincePayment)
+    auto itQueue = mapPaymentQueue.begin();
+    auto itOffQueue = mapPaymentOffQueue.begin();
+    auto nextCandidate = [&](int64_t& nLastPaid) -> CMasternode* {
+        CMasternode* pmn = nullptr;
+        for (; itQueue != mapPaymentQueue.end(); ++itQueue) {
+            pmn = Find(itQueue->second);
+            if (!pmn) continue;
+            const auto it = mapPaymentQueueEntries.find(pmn);
+            if (it != mapPaymentQueueEntries.end() && !it->second.fOffQueue && it->second.payee == itQueue->second) break;
+        }
+        if (itQueue != mapPaymentQueue.end() &&
+                (itOffQueue == mapPaymentOffQueue.end() || itQueue->first.first <= itOffQueue->first.first)) {
+            nLastPaid = (itQueue++)->first.first;
+            return pmn;
+        }
+        if (itOffQueue != mapPaymentOffQueue.end()) {
+            nLastPaid = itOffQueue->first.first;
+            return (itOffQueue++)->second;
+        }
+        return nullptr;
+    };
+
+    // SecondsSincePayment saturates after a month: those masternodes come first,
+    // ordered by the deterministic value it gives them.
+    std::vector<std::pair<int64_t, CMasternode*>> vCandidates;
+    int64_t nLastPaid = 0;
+    CMasternode* pNext = nextCandidate(nLastPaid);
+    while (pNext && nPrevTime - nLastPaid >= MONTH_IN_SECONDS) {
+        vCandidates.emplace_back(pNext->SecondsSincePayment(pindexPrev), pNext);
+        pNext = nextCandidate(nLastPaid);
+    }
+    std::sort(vCandidates.begin(), vCandidates.end(), [](const std::pair<int64_t, CMasternode*>& a, const std::pair<int64_t, CMasternode*>& b) {
+        return a.first > b.first || (a.first == b.first && a.second->vin.prevout < b.second->vin.prevout);
+    });
+
+    // Walk the candidates in payment order, checking each one only when reached
+    size_t nCandidate = 0;
+    while (true) {
+        CMasternode* pmn = nullptr;
+        if (nCandidate < vCandidates.size()) {
+            pmn = vCandidates[nCandidate++].second;
+        } else if (pNext) {
+            pmn = pNext;
+            pNext = nextCandidate(nLastPaid);
+        } else {
+            break;
+        }
+
+        pmn->Check();
+        if (!pmn->IsEnabled()) continue;
+
+        //it's too new, wait for a cycle
+        if (fFilterSigTime && pmn->sigTime + (nMnCount * 60) > nNow) continue;
+
+        //make sure it has as many confirmations as there are masternodes
+        if (pcoinsTip->GetCoinDepthAtHeight(pmn->vin.prevout, nBlockHeight) < nMnCount) continue;
+
+        nCount++;
+        if (fJustCount) continue;
+
+        if ((int)vEligibleTxIns.size() < nEligibleNetwork) {
+            auto pmnVin = Find(pmn->vin);
+            if (!pmnVin) continue;
+
+            if (!pBestMasternode) {
+                pBestMasternode = pmnVin; // get the MN that was paid the last
+            }
+            vEligibleTxIns.push_back(pmn->vin);
+        }
+
+        // once the eligible set is full, only the count below is still needed,
+        // and it is not needed past the point where it rules out the fallback
+        if ((int)vEligibleTxIns.size() >= nEligibleNetwork && nCount >= nMnCount / 3) break;
+    }
+
+    //when the network is in the process of upgrading, don't penalize nodes that recently restarted
+    if (fFilterSigTime && nCount < nMnCount / 3) return GetNextMasternodeInPaymentQueue(pindexPrev, false, nCount, vEligibleTxIns, fJustCount);
+
+    return pBestMasternode;
+}
+
+void CMasternodeMan::UpdatePaymentQueue(const CScript& script, const CBlockIndex* pindexOld, const CBlockIndex* pindexNew)
+{
+    AssertLockHeld(cs_collaterals);
+
+    if (pindexOld) {
+        mapPaymentQueue.erase(std::make_pair(pindexOld->GetBlockTime(), pindexOld->nHeight));
+    }
+    if (pindexNew) {
+        mapPaymentQueue[std::make_pair(pindexNew->GetBlockTime(), pindexNew->nHeight)] = script;
+    }
+    setPaymentQueueDirtyPayees.insert(script);
+}
+
+void CMasternodeMan::UpdatePaymentQueueEntry(CMasternode* pmn, PaymentQueueEntry& entry)
+{
+    AssertLockHeld(cs);
+    AssertLockHeld(cs_collaterals);
+
+    // The queue orders a MN by its last payment, unless it was announced again since, or
+    // its payee is not found as this MN. Those are ordered by GetLastPaid apart.
+    if (entry.fOffQueue) {
+        mapPaymentOffQueue.erase(std::make_pair(entry.nLastPaid, pmn->vin.prevout));
+    }
+    const auto it = mapPaidPayeesBlocks.find(entry.payee);
+    const CBlockIndex* pindexPaid = (it != mapPaidPayeesBlocks.end() && !it->second.empty()) ? it->second.back() : nullptr;
+    entry.nLastPaid = pindexPaid ? pindexPaid->GetBlockTime() : 0;
+    entry.fOffQueue = !pindexPaid || entry.nLastPaid < pmn->sigTime || Find(entry.payee) != pmn;
+    if (entry.fOffQueue) {
+        entry.nLastPaid = std::max(entry.nLastPaid, pmn->sigTime);
+        mapPaymentOffQueue.emplace(std::make_pair(entry.nLastPaid, pmn->vin.prevout), pmn);
+    }
+
+    if (entry.nEnabledUntil > nPaymentQueueTime) {
+        setPaymentQueueEnabledUntil.erase(setPaymentQueueEnabledUntil.find(entry.nEnabledUntil));
+    }
+    entry.nEnabledUntil = pmn->GetEnabledUntil();
+    if (entry.nEnabledUntil > nPaymentQueueTime) {
+        setPaymentQueueEnabledUntil.insert(entry.nEnabledUntil);
+    }
+}
+
+void CMasternodeMan::UpdatePaymentQueueEntries(int64_t nNow)
+{
+    AssertLockHeld(cs);
+    AssertLockHeld(cs_collaterals);
+
+    if (!fPaymentQueueEntries || nPaymentQueueListVersion != nListVersion || nNow < nPaymentQueueTime) {
+        // the list changed (or the clock went back), look at every MN again
+        mapPaymentQueueEntries.clear();
+        mapPaymentQueuePayees.clear();
+        mapPaymentOffQueue.clear();
+        setPaymentQueueEnabledUntil.clear();
+        nPaymentQueueTime = nNow;
+        nPaymentQueueListVersion = nListVersion;
+        for (auto mn : vMasternodes) {
+            auto& entry = mapPaymentQueueEntries[mn];
+            entry.payee = GetScriptForDestination(mn->pubKeyCollateralAddress.GetID());
+            mapPaymentQueuePayees.emplace(entry.payee, mn);
+            UpdatePaymentQueueEntry(mn, entry);
+        }
+        fPaymentQueueEntries = true;
+    } else {
+        // the list didn't change, so the MNs noted since are still listed
+        for (const CScript& payee : setPaymentQueueDirtyPayees) {
+            const auto range = mapPaymentQueuePayees.equal_range(payee);
+            for (auto it = range.first; it != range.second; ++it) {
+                UpdatePaymentQueueEntry(it->second, mapPaymentQueueEntries[it->second]);
+            }
+        }
+        for (CMasternode* pmn : setPaymentQueueDirtyMasternodes) {
+            const auto it = mapPaymentQueueEntries.find(pmn);
+            if (it != mapPaymentQueueEntries.end()) {
+                UpdatePaymentQueueEntry(pmn, it->second);
+            }
+        }
+
+        // the MNs whose last ping got too old since
+        setPaymentQueueEnabledUntil.erase(setPaymentQueueEnabledUntil.begin(), setPaymentQueueEnabledUntil.upper_bound(nNow));
+        nPaymentQueueTime = nNow;
+    }
+    setPaymentQueueDirtyPayees.clear();
+    setPaymentQueueDirtyMasternodes.clear();
+}
+
+void CMasternodeMan::UpdatedMasternodePing(CMasternode* pmn)
+{
+    LOCK(cs_collaterals);
+    setPaymentQueueDirtyMasternodes.insert(pmn);
+}
+
 const CBlockIndex* CMasternodeMan::GetLastPaidBlockSlow(const CScript& script, const CBlockIndex* pindexPrev) 
 {
     auto pindex = pindexPrev;
-    CBlock block;
+    const auto hashPayee = Hash160(script.begin(), script.end());
 
     {
         LOCK(cs_main);
 
         for(int i = 0; i < DEFAULT_MAX_REORG_DEPTH; i++) 
         {
-            if(chainActive[pindex->nHeight]->GetBlockHash() == pindex->GetBlockHash()) {
+            if(chainActive.Contains(pindex)) {
                 return GetLastPaidBlock(script, pindex); // onchain, use a faster alternative
             }
 
-            if(!ReadBlockFromDisk(block, pindex)) {
-                return nullptr; // should not happen
+            if(!pindex->HasPaidPayee()) {
+                // fork block not connected yet, read it once
+                CBlock block;
+                if(!ReadBlockFromDisk(block, pindex)) {
+                    return nullptr; // should not happen
+                }
+                SetBlockIndexPaidPayee(pindex, block.GetPaidPayee(CMasternode::GetMasternodePayment(pindex->nHeight)));
             }
 
-            auto amount = CMasternode::GetMasternodePayment(pindex->nHeight);
-            auto paidPayee = block.GetPaidPayee(amount);
-
-            if(paidPayee == script) {
+            if(pindex->hashPaidPayee == hashPayee) {
                 return pindex;
             }
 
-            if(block.hashPrevBlock.IsNull()) return nullptr; // should not happen or we reached the genesis block
+            if(!pindex->pprev) return nullptr; // should not happen or we reached the genesis block
 
-            pindex = mapBlockIndex[block.hashPrevBlock];
+            pindex = pindex->pprev;
         }
     }
 
@@ -652,12 +885,12 @@ const CBlockIndex* CMasternodeMan::GetLastPaidBlock(const CScript& script, const
     if(mapPaidPayeesBlocks.find(script) != mapPaidPayeesBlocks.end() &&
        !mapPaidPayeesBlocks[script].empty()
     ) {
+        // the blocks are in height order
         const auto& vblocks = mapPaidPayeesBlocks[script];
-        for (auto it = vblocks.rbegin(); it != vblocks.rend(); ++it)
-        {
-            if((*it)->nHeight <= pindex->nHeight) {
-                return *it;
-            }
+        const auto it = std::upper_bound(vblocks.begin(), vblocks.end(), pindex->nHeight,
+            [](int nHeight, const CBlockIndex* pindexPaid) { return nHeight < pindexPaid->nHeight; });
+        if (it != vblocks.begin()) {
+            return *std::prev(it);
         }
     }
     return nullptr;
@@ -790,20 +1023,10 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         } //else, asking for a specific node which is ok
 
         if(vin == CTxIn()) { // send all
-            LOCK(cs);
-            int nInvCount = 0;
-            for (const auto& mn : vMasternodes) {
-                if (mn->IsEnabled() && !mn->addr.IsRFC1918()) {
-                    LogPrint(BCLog::MASTERNODE, "dseg - Sending Masternode entry - %s \n", mn->vin.prevout.ToStringShort());
-                    
-                    CMasternodeBroadcast mnb = CMasternodeBroadcast(*mn);
-                    uint256 hash = mnb.GetHash();
-                    pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
-                    nInvCount++;
-
-                    if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.insert(std::make_pair(hash, mnb));
-                }
-            }
+            const auto pSnapshot = GetListSnapshot();
+            for (const uint256& hash : pSnapshot->vHashes)
+                pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+            const int nInvCount = pSnapshot->vHashes.size();
 
             g_connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_LIST, nInvCount));
             LogPrint(BCLog::MASTERNODE, "dseg - Sent %d Masternode entries to peer %i\n", nInvCount, pfrom->GetId());
@@ -826,6 +1049,45 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
     }
 }
 
+std::shared_ptr<const CMasternodeListSnapshot> CMasternodeMan::GetListSnapshot()
+{
+    const int64_t nNow = GetTime();
+    {
+        LOCK(cs_listsnapshot);
+        if (pListSnapshot && pListSnapshot->nVersion == nListVersion && nNow < pListSnapshot->nTime + MASTERNODE_LIST_SNAPSHOT_SECONDS) {
+            nListSnapshotHits++;
+            return pListSnapshot;
+        }
+    }
+
+    // A change while building bumps the version past the one taken here, so it is built again next time
+    auto pSnapshot = std::make_shared<CMasternodeListSnapshot>(nListVersion, nNow);
+    {
+        LOCK(cs);
+        for (const auto& mn : vMasternodes) {
+            if (mn->IsEnabled() && !mn->addr.IsRFC1918()) {
+                CMasternodeBroadcast mnb = CMasternodeBroadcast(*mn);
+                uint256 hash = mnb.GetHash();
+                // getdata is served from the broadcasts seen, the first one seen with this hash
+                mapSeenMasternodeBroadcast.insert(std::make_pair(hash, mnb));
+                pSnapshot->vHashes.push_back(hash);
+            }
+        }
+    }
+    LogPrint(BCLog::MASTERNODE, "%s: %d Masternode entries at list version %d\n", __func__, pSnapshot->vHashes.size(), pSnapshot->nVersion);
+
+    LOCK(cs_listsnapshot);
+    pListSnapshot = pSnapshot;
+    nListSnapshotBuilds++;
+    return pListSnapshot;
+}
+
+void CMasternodeMan::GetListSnapshotStats(uint64_t& nHits, uint64_t& nBuilds) const
+{
+    nHits = nListSnapshotHits;
+    nBuilds = nListSnapshotBuilds;
+}
+
 void CMasternodeMan::Remove(CTxIn vin)
 {
     LOCK(cs);
@@ -848,6 +1110,7 @@ void CMasternodeMan::Remove(CTxIn vin)
             }
             delete *it;
             vMasternodes.erase(it);
+            nListVersion++;
             break;
         }
         ++it;
@@ -866,15 +1129,23 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb)
     if (pmn == NULL) {
         CMasternode mn(mnb);
         Add(mn);
-    } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+    } else if (pmn->UpdateFromNewBroadcast(mnb)) {
+        nListVersion++;
     }
 }
 
+void CMasternodeMan::SetCoinsDB(CCoinsViewDB* pcoinsdbviewIn)
+{
+    LOCK(cs_collaterals);
+    pcoinsdbCollaterals = pcoinsdbviewIn;
+    initiatedAt = -1;
+}
+
 bool CMasternodeMan::Init()
 {
     if(initiatedAt > 0) return true;
 
+    // the collateral index on disk is written along with the coins
     FlushStateToDisk();
 
     LOCK(cs_collaterals);
@@ -886,6 +1157,9 @@ bool CMasternodeMan::Init()
     mapRemovedCollaterals.clear();
     mapPaidPayeesBlocks.clear();
     mapPaidPayeesHeight.clear();
+    mapPaymentQueue.clear();
+    pindexPaymentQueue = nullptr;
+    fPaymentQueueEntries = false;
 
     const auto nHeight = chainActive.Height();
     const auto& params = Params();
@@ -897,37 +1171,52 @@ bool CMasternodeMan::Init()
     auto nNextWeekCollateralAmount = CMasternode::GetMasternodeNodeCollateral(nHeight + nBlocksPerWeek);
 
     if (nCollateralAmount > 0 || nNextWeekCollateralAmount > 0) {
-        std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsTip->Cursor());
+        // the chainstate keeps the collateral-sized coins apart, no need to walk the whole UTXO set
+        std::vector<std::pair<COutPoint, Coin>> vCollaterals;
+        if (pcoinsdbCollaterals == nullptr || !pcoinsdbCollaterals->GetCollaterals(vCollaterals)) {
+            return error("%s: unable to read the collateral index", __func__);
+        }
 
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
-            COutPoint key;
-            Coin coin;
-            if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-                if (!coin.IsSpent() && (coin.out.nValue == nCollateralAmount || coin.out.nValue == nNextWeekCollateralAmount)) {
-                    const auto& out = coin.out;
-                    const auto& nCollateral = out.nValue;
-                    // this is a possible collateral UTXO
-                    mapScriptCollaterals[coin.out.scriptPubKey] = coin;
-                    mapCOutPointCollaterals[key] = coin;
-                    // check if there is no entry for this collateral
-                    if(mapCAmountCollaterals.find(nCollateral) == mapCAmountCollaterals.end()) {
-                        mapCAmountCollaterals[nCollateral] = boost::unordered_set<COutPoint, COutPointCheapHasher>(); // add an empty set
-                    }
-                    mapCAmountCollaterals[nCollateral].insert(key);
+        for (const auto& collateral : vCollaterals) {
+            const auto& key = collateral.first;
+            const auto& coin = collateral.second;
+            if (!coin.IsSpent() && (coin.out.nValue == nCollateralAmount || coin.out.nValue == nNextWeekCollateralAmount)) {
+                const auto& out = coin.out;
+                const auto& nCollateral = out.nValue;
+                // this is a possible collateral UTXO
+                mapScriptCollaterals[coin.out.scriptPubKey] = coin;
+                mapCOutPointCollaterals[key] = coin;
+                // check if there is no entry for this collateral
+                if(mapCAmountCollaterals.find(nCollateral) == mapCAmountCollaterals.end()) {
+                    mapCAmountCollaterals[nCollateral] = boost::unordered_set<COutPoint, COutPointCheapHasher>(); // add an empty set
                 }
+                mapCAmountCollaterals[nCollateral].insert(key);
             }
-            pcursor->Next();
         }
     }
 
-    // scan the blockchain for paid payees
+    // scan the blockchain for paid payees, the block index keeps their script hashes
     const auto nCollaterals = mapScriptCollaterals.size();
-    const auto nMaxDepth = nCollaterals * 2;
+    const int nMaxDepth = nCollaterals * 2;
+
+    std::map<uint160, CScript> mapPayeeScripts;
+    for (const auto& kv : mapScriptCollaterals) {
+        mapPayeeScripts.emplace(Hash160(kv.first.begin(), kv.first.end()), kv.first);
+    }
 
-    for(int h = nHeight - nMaxDepth; h <= nHeight; h++) {
+    for(int h = std::max(nHeight - nMaxDepth, 0); h <= nHeight; h++) {
         const auto pBlockIndex = chainActive[h];
-        const auto paidPayee = pBlockIndex->GetPaidPayee();
+        if (!pBlockIndex->HasPaidPayee()) {
+            // connected while syncing, read it once
+            const auto paidPayee = pBlockIndex->GetPaidPayee();
+            if (paidPayee.empty()) continue; // the block couldn't be read, don't store it
+            SetBlockIndexPaidPayee(pBlockIndex, paidPayee);
+        }
+
+        // only the payees still holding a collateral can be paid again
+        const auto it = mapPayeeScripts.find(pBlockIndex->hashPaidPayee);
+        if (it == mapPayeeScripts.end()) continue;
+        const auto& paidPayee = it->second;
 
         if(mapPaidPayeesBlocks.find(paidPayee) == mapPaidPayeesBlocks.end()) {
             mapPaidPayeesBlocks[paidPayee] = std::vector<const CBlockIndex*>();
@@ -937,6 +1226,11 @@ bool CMasternodeMan::Init()
         mapPaidPayeesHeight[h] = paidPayee;
     }
 
+    for (const auto& kv : mapPaidPayeesBlocks) {
+        UpdatePaymentQueue(kv.first, nullptr, kv.second.back());
+    }
+    pindexPaymentQueue = chainActive.Tip();
+
     initiatedAt = nHeight;
     lastProcess = GetTime();
 
@@ -997,6 +1291,7 @@ bool CMasternodeMan::ConnectBlock(const CBlockIndex* pindex, const CBlock& block
                 const auto pmn = Find(script);
                 if(pmn) {
                     pmn->activeState = CMasternode::MASTERNODE_VIN_SPENT;
+                    setPaymentQueueDirtyMasternodes.insert(pmn);
                 }
             }
             mapCAmountCollaterals.erase(nCollateral);
@@ -1005,7 +1300,7 @@ bool CMasternodeMan::ConnectBlock(const CBlockIndex* pindex, const CBlock& block
 
     for (const auto& tx : block.vtx) {
         // remove the collaterals that were spent
-        for (const auto& in : tx.vin) {
+        for (const auto& in : tx->vin) {
             if(mapCOutPointCollaterals.find(in.prevout) != mapCOutPointCollaterals.end()) 
             {
                 const auto& outPoint = in.prevout;
@@ -1030,16 +1325,17 @@ bool CMasternodeMan::ConnectBlock(const CBlockIndex* pindex, const CBlock& block
                 const auto pmn = Find(scriptPubKey);
                 if(pmn) {
                     pmn->activeState = CMasternode::MASTERNODE_VIN_SPENT;
+                    setPaymentQueueDirtyMasternodes.insert(pmn);
                 }
             }
         }
 
         // add the collaterals that were created
         auto n = 0;
-        for (const auto& out : tx.vout) {
+        for (const auto& out : tx->vout) {
             if (out.nValue == nCollateralAmount || out.nValue == nNextWeekCollateralAmount) {
                 const auto& nCollateral = out.nValue;
-                const auto& outPoint = COutPoint(tx.GetHash(), n);
+                const auto& outPoint = COutPoint(tx->GetHash(), n);
                 const auto coin = Coin(out, nHeight, n == 0, n == 1);
                 
                 mapScriptCollaterals[out.scriptPubKey] = coin;
@@ -1054,18 +1350,22 @@ bool CMasternodeMan::ConnectBlock(const CBlockIndex* pindex, const CBlock& block
         }
     }
 
-    // register the paid payee for this block
+    // register the paid payee for this block, now that its reward is known
     const auto amount = CMasternode::GetMasternodePayment(nHeight);
     const auto paidPayee = block.GetPaidPayee(amount);
+    SetBlockIndexPaidPayee(pindex, paidPayee);
 
     if(!paidPayee.empty()) {
         if(mapPaidPayeesBlocks.find(paidPayee) == mapPaidPayeesBlocks.end()) {
             mapPaidPayeesBlocks[paidPayee] = std::vector<const CBlockIndex*>();
         }
 
-        mapPaidPayeesBlocks[paidPayee].push_back(pindex);
+        auto& vBlocks = mapPaidPayeesBlocks[paidPayee];
+        UpdatePaymentQueue(paidPayee, vBlocks.empty() ? nullptr : vBlocks.back(), pindex);
+        vBlocks.push_back(pindex);
         mapPaidPayeesHeight[nHeight] = paidPayee;
     }
+    pindexPaymentQueue = pindex;
 
     return true;
 }
@@ -1088,6 +1388,7 @@ bool CMasternodeMan::DisconnectBlock(const CBlockIndex* pindex, const CBlock& bl
 
     if(nHeight < initiatedAt) {
         initiatedAt = -1; // redo all the mappings at next connect block
+        pindexPaymentQueue = nullptr;
         return true;
     }
 
@@ -1098,10 +1399,10 @@ bool CMasternodeMan::DisconnectBlock(const CBlockIndex* pindex, const CBlock& bl
     for (const auto& tx : block.vtx) {
         // remove the collaterals that were created
         auto n = 0;
-        for (const auto& out : tx.vout) {
+        for (const auto& out : tx->vout) {
             if (out.nValue == nCollateralAmount || out.nValue == nNextWeekCollateralAmount) {
                 const auto& nCollateral = out.nValue;
-                const auto& outPoint = COutPoint(tx.GetHash(), n);
+                const auto& outPoint = COutPoint(tx->GetHash(), n);
 
                 mapScriptCollaterals.erase(out.scriptPubKey);
                 mapCOutPointCollaterals.erase(outPoint);
@@ -1135,15 +1436,19 @@ bool CMasternodeMan::DisconnectBlock(const CBlockIndex* pindex, const CBlock& bl
     // remove the paidpayees that were registered
     if(mapPaidPayeesHeight.find(nHeight) != mapPaidPayeesHeight.end()) {
         const auto& script = mapPaidPayeesHeight[nHeight];
+        auto& vBlocks = mapPaidPayeesBlocks[script];
 
-        mapPaidPayeesBlocks[script].pop_back();
+        const CBlockIndex* pindexOld = vBlocks.empty() ? nullptr : vBlocks.back();
+        vBlocks.pop_back();
+        UpdatePaymentQueue(script, pindexOld, vBlocks.empty() ? nullptr : vBlocks.back());
 
-        if(mapPaidPayeesBlocks[script].empty()) {
+        if(vBlocks.empty()) {
             mapPaidPayeesBlocks.erase(script);
         }
 
         mapPaidPayeesHeight.erase(nHeight);
     }
+    pindexPaymentQueue = pindex->pprev;
 
     return true;
 }
@@ -14,21 +14,74 @@
 #include "main.h"
 #include "masternode.h"
 #include "net.h"
+#include "streams.h"
 #include "sync.h"
 #include "util.h"
 
+#include <atomic>
+#include <memory>
+#include <set>
+
 #include <boost/unordered_map.hpp>
 
 #define MASTERNODES_DSEG_SECONDS (5 * 60)
+//! seconds a snapshot of the list answers dseg before it is rebuilt, even if the list didn't change
+#define MASTERNODE_LIST_SNAPSHOT_SECONDS 60
 
 class CMasternodeMan;
 class CActiveMasternode;
+class CCoinsViewDB;
 
 extern CMasternodeMan mnodeman;
 extern CActiveMasternodeMan amnodeman;
 
 void DumpMasternodes();
 
+/** Maximum number of queued broadcasts and pings whose signatures are checked together */
+static const unsigned int MAX_MASTERNODE_SIG_BATCH = 256;
+
+/**
+ * Closure representing the signature checks of one received masternode broadcast or ping.
+ * The outcome is left in the message signature cache, for the handler to pick up.
+ */
+class CMasternodeSigCheck
+{
+private:
+    std::shared_ptr<const CSignedMessage> pmessage;
+
+public:
+    CMasternodeSigCheck() {}
+    explicit CMasternodeSigCheck(std::shared_ptr<const CSignedMessage> pmessageIn) : pmessage(std::move(pmessageIn)) {}
+
+    bool operator()();
+
+    void swap(CMasternodeSigCheck& check)
+    {
+        pmessage.swap(check.pmessage);
+    }
+};
+
+void ThreadMasternodeSigCheck();
+/** Check the signatures of a burst of broadcasts and pings in parallel, ahead of handling them one by one */
+void CheckMasternodeSignatures(std::vector<CMasternodeSigCheck>& vChecks);
+
+/**
+ * The announces of the enabled masternodes, as sent in answer to dseg for the
+ * whole list. It isn't changed once built, so it is read without the manager lock.
+ * The broadcasts themselves are served from mapSeenMasternodeBroadcast, since
+ * pings keep updating them.
+ */
+class CMasternodeListSnapshot
+{
+public:
+    //! version of the list it was built from, and when
+    uint64_t nVersion;
+    int64_t nTime;
+    std::vector<uint256> vHashes;
+
+    CMasternodeListSnapshot(uint64_t nVersionIn, int64_t nTimeIn) : nVersion(nVersionIn), nTime(nTimeIn) {}
+};
+
 /** Access to the MN database (mncache.dat)
  */
 class CMasternodeDB
@@ -53,8 +106,14 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+namespace masternode_tests
+{
+    class TestMasternodeMan;
+}
+
 class CMasternodeMan
 {
+friend class masternode_tests::TestMasternodeMan; // for test access to the payment queue
 private:
     int initiatedAt = -1;
     int64_t lastProcess;
@@ -89,18 +148,63 @@ private:
     boost::unordered_map<CScript, std::vector<const CBlockIndex*>, CScriptCheapHasher> mapPaidPayeesBlocks;
     // map paid payees and block indexes by height 
     boost::unordered_map<int, CScript> mapPaidPayeesHeight;
+    // payment queue: each paid payee keyed by the (time, height) of its last payment, oldest first
+    std::map<std::pair<int64_t, int>, CScript> mapPaymentQueue;
+    // block at which mapPaymentQueue is valid
+    const CBlockIndex* pindexPaymentQueue = nullptr;
+    // what the payment queue walk knows of each listed MN: its payee, whether mapPaymentQueue
+    // can't order it and the last paid time it is ordered by instead, and until when it stays
+    // enabled without a new ping (0 if it isn't enabled)
+    struct PaymentQueueEntry {
+        CScript payee;
+        bool fOffQueue = false;
+        int64_t nLastPaid = 0;
+        int64_t nEnabledUntil = 0;
+    };
+    std::map<CMasternode*, PaymentQueueEntry> mapPaymentQueueEntries;
+    std::multimap<CScript, CMasternode*> mapPaymentQueuePayees;
+    // MNs that mapPaymentQueue can't order, by (last paid time, collateral)
+    std::map<std::pair<int64_t, COutPoint>, CMasternode*> mapPaymentOffQueue;
+    // ends of the enabled time of the MNs still enabled at nPaymentQueueTime, one per MN
+    std::multiset<int64_t> setPaymentQueueEnabledUntil;
+    int64_t nPaymentQueueTime = 0;
+    // list version the entries were built at, and the payees paid and MNs pinged or spent since
+    bool fPaymentQueueEntries = false;
+    uint64_t nPaymentQueueListVersion = 0;
+    std::set<CScript> setPaymentQueueDirtyPayees;
+    std::set<CMasternode*> setPaymentQueueDirtyMasternodes;
+    // chainstate database with the collateral index
+    CCoinsViewDB* pcoinsdbCollaterals = nullptr;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // bumped whenever a Masternode is added, removed or updated from a new broadcast
+    std::atomic<uint64_t> nListVersion{0};
+    // snapshot answering dseg, and how often it was used or rebuilt
+    mutable RecursiveMutex cs_listsnapshot;
+    std::shared_ptr<const CMasternodeListSnapshot> pListSnapshot;
+    std::atomic<uint64_t> nListSnapshotHits{0};
+    std::atomic<uint64_t> nListSnapshotBuilds{0};
 
     // find an entry in the masternode list that is next to be paid (internally)
     CMasternode* GetNextMasternodeInQueueForPayment(
         const CBlockIndex* pindexPrev, bool fFilterSigTime, 
         int& nCount, std::vector<CTxIn>& vecEligibleTxIns,
         bool fJustCount);
+    // same, walking mapPaymentQueue (only valid when pindexPrev == pindexPaymentQueue);
+    // nCount is only complete when fJustCount is set
+    CMasternode* GetNextMasternodeInPaymentQueue(
+        const CBlockIndex* pindexPrev, bool fFilterSigTime,
+        int& nCount, std::vector<CTxIn>& vecEligibleTxIns,
+        bool fJustCount);
+    // move a payee in the payment queue from its previous last paid block to the new one
+    void UpdatePaymentQueue(const CScript& script, const CBlockIndex* pindexOld, const CBlockIndex* pindexNew);
+    // bring mapPaymentQueueEntries and the indexes built on it up to date at nNow
+    void UpdatePaymentQueueEntries(int64_t nNow);
+    void UpdatePaymentQueueEntry(CMasternode* pmn, PaymentQueueEntry& entry);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -136,6 +240,7 @@ public:
                 }
 
                 vMasternodes.push_back(mn);
+                nListVersion++;
                 {
                     LOCK(cs_script);
                     mapScriptMasternodes[GetScriptForDestination(mn->pubKeyCollateralAddress.GetID())] = mn;
@@ -186,6 +291,14 @@ public:
 
     void DsegUpdate(CNode* pnode);
 
+    /// Snapshot of the announces of the enabled Masternodes, rebuilt if the list changed or it got old
+    std::shared_ptr<const CMasternodeListSnapshot> GetListSnapshot();
+    void GetListSnapshotStats(uint64_t& nHits, uint64_t& nBuilds) const;
+    /// Note that a Masternode got a new ping, for the payment queue to count it as enabled again
+    void UpdatedMasternodePing(CMasternode* pmn);
+    /// Note that a Masternode was updated from a new broadcast, for the snapshot to be rebuilt
+    void UpdatedMasternode() { nListVersion++; }
+
     /// Find an entry
     CMasternode* Find(const CScript& payee);
     CMasternode* Find(const CTxIn& vin);
@@ -246,6 +359,8 @@ public:
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast mnb);
 
+    //! the chainstate database keeping the collateral index
+    void SetCoinsDB(CCoinsViewDB* pcoinsdbviewIn);
     bool Init();
     void Shutdown();
     bool ConnectBlock(const CBlockIndex* pindex, const CBlock& block);
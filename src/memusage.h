@@ -9,6 +9,7 @@
 #include <stdlib.h>
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 #include <boost/unordered_map.hpp>
@@ -159,6 +160,22 @@ static inline size_t RecursiveDynamicUsage(const std::pair<X, Y>& v)
     return RecursiveDynamicUsage(v.first) + RecursiveDynamicUsage(v.second);
 }
 
+struct stl_shared_counter
+{
+    /* Various platforms use different sized counters here.
+     * Conservatively assume that they won't be larger than size_t. */
+    size_t use_count;
+    size_t weak_count;
+};
+
+template<typename X>
+static inline size_t DynamicUsage(const std::shared_ptr<X>& p)
+{
+    // make_shared allocates the object and the counters together, but a
+    // shared_ptr may also have been built from a separate allocation
+    return p ? MallocUsage(sizeof(X)) + MallocUsage(sizeof(stl_shared_counter)) : 0;
+}
+
 // Boost data structures
 
 template<typename X>
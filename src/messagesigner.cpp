@@ -9,9 +9,58 @@
 #include "main.h" // For strMessageMagic
 #include "messagesigner.h"
 #include "masternodeman.h"  // For GetPublicKey (of MN from its vin)
+#include "random.h"
+#include "script/sigcache.h" // For SignatureCacheHasher
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
+#include "cuckoocache.h"
+#include <boost/thread.hpp>
+
+namespace {
+/**
+ * Valid message signature cache, so that signatures recovered on a message
+ * worker or the masternode check queue aren't recovered again when the
+ * message is processed
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || signer key id || signature):
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_sigcache;
+
+public:
+    CMessageSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(MESSAGE_SIG_CACHE_BYTES);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        setValid.insert(entry);
+    }
+
+    static const size_t MESSAGE_SIG_CACHE_BYTES = 1 << 20;
+};
+
+static CMessageSignatureCache messageSignatureCache;
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string& strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     keyRet = DecodeSecret(strSecret);
@@ -57,6 +106,11 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if (messageSignatureCache.Get(entry))
+        return true;
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
@@ -70,9 +124,21 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std
         return false;
     }
 
+    messageSignatureCache.Set(entry);
     return true;
 }
 
+void CHashSigner::PrecomputeHash(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    CPubKey pubkeyFromSig;
+    if (!pubkeyFromSig.RecoverCompact(hash, vchSig))
+        return;
+
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, pubkeyFromSig.GetID(), vchSig);
+    messageSignatureCache.Set(entry);
+}
+
 /** CSignedMessage Class
  *  Functions inherited by network signed-messages
  */
@@ -133,6 +199,15 @@ bool CSignedMessage::CheckSignature(const CPubKey& pubKey) const
     return CMessageSigner::VerifyMessage(pubKey, vchSig, strMessage, strError);
 }
 
+void CSignedMessage::PrecomputeSignature() const
+{
+    if (nMessVersion == MessageVersion::MESS_VER_HASH) {
+        CHashSigner::PrecomputeHash(GetSignatureHash(), vchSig);
+    } else {
+        CHashSigner::PrecomputeHash(CMessageSigner::GetMessageHash(GetStrMessage()), vchSig);
+    }
+}
+
 bool CSignedMessage::CheckSignature() const
 {
     std::string strError = "";
@@ -43,6 +43,8 @@ public:
     static bool VerifyHash(const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
     /// Verify the hash signature, returns true if successful
     static bool VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
+    /// Recover the signer of the hash ahead of VerifyHash, which then finds it in the signature cache
+    static void PrecomputeHash(const uint256& hash, const std::vector<unsigned char>& vchSig);
 };
 
 /** Base Class for all signed messages on the network
@@ -72,6 +74,8 @@ public:
     bool Sign(const std::string strSignKey);
     bool CheckSignature(const CPubKey& pubKey) const;
     bool CheckSignature() const;
+    // Recover the signer ahead of CheckSignature, e.g. on a message worker or check queue thread
+    virtual void PrecomputeSignature() const;
 
     // Pure virtual functions (used in Sign-Verify functions)
     // Must be implemented in child classes
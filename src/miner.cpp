@@ -36,7 +36,8 @@
 
 
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
+
+#include <queue>
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -44,53 +45,26 @@
 // Miner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
-
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+// Orders mempool entries whose parents are already in the block by fee rate
+class ScoreCompare
 {
-    bool byFee;
-
 public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
+    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b) const
     {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
+        return CompareTxMemPoolEntryByScore()(*b, *a); // Convert to less than
     }
 };
 
+// Transactions whose inputs passed CheckInputs on top of hashTemplateTip.
+// The staker asks for a template every time slot, mostly on the same tip and
+// an almost unchanged mempool, so only the new arrivals are verified again.
+// Guarded by cs_main.
+static uint256 hashTemplateTip;
+static std::set<uint256> setTemplateVerified;
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -118,7 +92,7 @@ bool CreateCoinbaseTx(CBlock* pblock, const CScript& scriptPubKeyIn, CBlockIndex
         txNew.vout[0].nValue = CRewards::GetBlockValue(pindexPrev->nHeight + 1);
     }
 
-    pblock->vtx.emplace_back(txNew);
+    pblock->vtx.emplace_back(MakeTransactionRef(std::move(txNew)));
     return true;
 }
 
@@ -139,11 +113,190 @@ bool SolveProofOfStake(CBlock* pblock, CBlockIndex* pindexPrev, CWallet* pwallet
     emptyTx.vin[0].scriptSig = CScript() << pindexPrev->nHeight + 1 << OP_0;
     emptyTx.vout.resize(1);
     emptyTx.vout[0].SetEmpty();
-    pblock->vtx.emplace_back(emptyTx);
-    pblock->vtx.emplace_back(txCoinStake);
+    pblock->vtx.emplace_back(MakeTransactionRef(std::move(emptyTx)));
+    pblock->vtx.emplace_back(MakeTransactionRef(std::move(txCoinStake)));
     return true;
 }
 
+CAmount AddMempoolTransactions(CBlockTemplate& blocktemplate, CTxMemPool& pool, CCoinsView* pcoinsBase, const uint256& hashTip, int nHeight,
+                               unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+
+    if (hashTemplateTip != hashTip || setTemplateVerified.size() > 2 * pool.mapTx.size()) {
+        hashTemplateTip = hashTip;
+        setTemplateVerified.clear();
+    }
+    CCoinsViewMemPool viewMemPool(pcoinsBase, pool);
+    CCoinsViewCache view(&viewMemPool);
+
+    uint64_t nBlockSize = 1000;
+    uint64_t nBlockTx = 0;
+    unsigned int nBlockSigOps = 100;
+    int nLastFewTxs = 0;
+    CAmount nFees = 0;
+    const bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+
+    // Coin age priority moves with the height, so it is the one ordering built
+    // per template, from the values cached in the mempool entries. The fee rate
+    // order is the mining score index the mempool keeps up to date.
+    bool fPriorityBlock = nBlockPrioritySize > 0;
+    std::vector<TxCoinAgePriority> vecPriority;
+    TxCoinAgePriorityCompare pricomparer;
+    if (fPriorityBlock) {
+        vecPriority.reserve(pool.mapTx.size());
+        for (CTxMemPool::txiter mi = pool.mapTx.begin(); mi != pool.mapTx.end(); ++mi) {
+            double dPriority = mi->GetPriority(nHeight);
+            CAmount dummy;
+            pool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+            vecPriority.emplace_back(dPriority, mi);
+        }
+        std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+    }
+
+    // Entries waiting for their mempool parents to be added first
+    CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries waitSet;
+    std::set<COutPoint> setSpent;
+    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
+
+    // Index 3 of mapTx: sorted by score (fee rate with deltas), best first
+    auto mi = pool.mapTx.get<3>().begin();
+    while (mi != pool.mapTx.get<3>().end() || !clearedTxs.empty()) {
+        CTxMemPool::txiter iter;
+        double dPriority = 0;
+        bool fPriorityTx = false;
+        if (fPriorityBlock && !vecPriority.empty()) {
+            // Fill -blockprioritysize from the priority queue
+            fPriorityTx = true;
+            iter = vecPriority.front().second;
+            dPriority = vecPriority.front().first;
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            vecPriority.pop_back();
+        } else if (clearedTxs.empty()) {
+            // Next highest fee rate
+            iter = pool.mapTx.project<0>(mi);
+            ++mi;
+        } else {
+            // A postponed child whose parents are now in the block
+            iter = clearedTxs.top();
+            clearedTxs.pop();
+        }
+
+        if (inBlock.count(iter))
+            continue;
+
+        const CTransaction& tx = iter->GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+            continue;
+
+        bool fWaiting = false;
+        for (CTxMemPool::txiter parent : pool.GetMemPoolParents(iter)) {
+            if (!inBlock.count(parent)) {
+                fWaiting = true;
+                break;
+            }
+        }
+        if (fWaiting) {
+            if (fPriorityTx)
+                waitPriMap.emplace(iter, dPriority);
+            else
+                waitSet.insert(iter);
+            continue;
+        }
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        const unsigned int nTxSize = iter->GetTxSize();
+        if (fPriorityBlock && (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(dPriority))) {
+            fPriorityBlock = false;
+            waitPriMap.clear();
+        }
+
+        // The rest pays less than the relay fee: stop once past the minimum block size
+        if (!fPriorityTx && iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize)
+            break;
+
+        // Size limits; once within 1000 bytes of a full block, only look at 50 more txs
+        if (nBlockSize + nTxSize >= nBlockMaxSize) {
+            if (nBlockSize > nBlockMaxSize - 100 || nLastFewTxs > 50)
+                break;
+            if (nBlockSize > nBlockMaxSize - 1000)
+                nLastFewTxs++;
+            continue;
+        }
+
+        // Legacy limits on sigOps, P2SH ones included
+        const unsigned int nTxSigOps = iter->GetSigOpCount();
+        if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_CURRENT) {
+            if (nBlockSigOps > MAX_BLOCK_SIGOPS_CURRENT - 2)
+                break;
+            continue;
+        }
+
+        // Never spend an output twice, whatever the state of the mempool
+        bool fDoubleSpend = false;
+        for (const CTxIn& txin : tx.vin) {
+            if (setSpent.count(txin.prevout)) {
+                fDoubleSpend = true;
+                break;
+            }
+        }
+        if (fDoubleSpend)
+            continue;
+
+        // Note that flags: we don't want to set mempool/IsStandard()
+        // policy here, but we still have to ensure that the block we
+        // create only contains transactions that are valid in new blocks.
+        const uint256& hash = tx.GetHash();
+        if (!setTemplateVerified.count(hash)) {
+            CValidationState state;
+            PrecomputedTransactionData precomTxData(tx);
+            if (!view.HaveInputs(tx) || !CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, false, precomTxData))
+                continue;
+            setTemplateVerified.insert(hash);
+        }
+
+        // Added
+        const CAmount nTxFees = iter->GetFee();
+        blocktemplate.block.vtx.push_back(iter->GetSharedTx());
+        blocktemplate.vTxFees.push_back(nTxFees);
+        blocktemplate.vTxSigOps.push_back(nTxSigOps);
+        nBlockSize += nTxSize;
+        ++nBlockTx;
+        nBlockSigOps += nTxSigOps;
+        nFees += nTxFees;
+        inBlock.insert(iter);
+        for (const CTxIn& txin : tx.vin)
+            setSpent.insert(txin.prevout);
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), hash.ToString());
+        }
+
+        // Add transactions that depend on this one to their queue
+        for (CTxMemPool::txiter child : pool.GetMemPoolChildren(iter)) {
+            if (fPriorityBlock) {
+                auto wpiter = waitPriMap.find(child);
+                if (wpiter != waitPriMap.end()) {
+                    vecPriority.emplace_back(wpiter->second, child);
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                    waitPriMap.erase(wpiter);
+                }
+            } else if (waitSet.erase(child)) {
+                clearedTxs.push(child);
+            }
+        }
+    }
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    return nFees;
+}
+
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, std::vector<COutput>* availableCoins)
 {
     // Create new block
@@ -206,193 +359,24 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    // Collect memory pool transactions into the block
-    CAmount nFees = 0;
-
     LOCK(cs_main);
 
     {
         LOCK(mempool.cs);
 
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoin(txin.prevout)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                const Coin& coin = view.AccessCoin(txin.prevout);
-                assert(!coin.IsSpent());
-
-                CAmount nValueIn = coin.out.nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coin.nHeight;
-
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-
-            CValidationState state;
-            PrecomputedTransactionData precomTxData(tx);
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData))
-                continue;
-
-            UpdateCoins(tx, view, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        // Collect memory pool transactions into the block
+        const CAmount nFees = AddMempoolTransactions(*pblocktemplate, mempool, pcoinsTip, pindexPrev->GetBlockHash(), nHeight,
+                                                     nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
 
         if (!fProofOfStake) {
             // Coinbase can get the fees.
-            pblock->vtx[0].vout[0].nValue += nFees;
+            CMutableTransaction txCoinbase(*pblock->vtx[0]);
+            txCoinbase.vout[0].nValue += nFees;
+            pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
             pblocktemplate->vTxFees[0] = -nFees;
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("%s : total size %u\n", __func__, nBlockSize);
+        LogPrintf("%s : total size %u\n", __func__, nLastBlockSize);
 
         // Fill in header
         pblock->hashPrevBlock = pindexPrev->GetBlockHash();
@@ -401,7 +385,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
         pblock->nNonce = 0;
 
-        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(*pblock->vtx[0]);
 
         if (fProofOfStake) {
             pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
@@ -417,6 +401,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
     if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
         LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
         mempool.clear();
+        setTemplateVerified.clear();
         return nullptr;
     }
 
@@ -433,11 +418,11 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     }
     ++nExtraNonce;
     unsigned int nHeight = pindexPrev->nHeight + 1; // Height first in coinbase required for block.version=2
-    CMutableTransaction txCoinbase(pblock->vtx[0]);
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
-    pblock->vtx[0] = txCoinbase;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
@@ -473,7 +458,7 @@ CBlockTemplate* CreateNewBlockWithKey(CReserveKey& reservekey, CWallet* pwallet)
 bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, Optional<CReserveKey>& reservekey)
 {
     LogPrintf("%s\n", pblock->ToString());
-    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0].vout[0].nValue));
+    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0]->vout[0].nValue));
 
     // Found a solution
     {
@@ -679,9 +664,17 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             unsigned int nHashesDone = 0;
 
             uint256 hash;
+            uint256 hashes[QUARK_BATCH_LANES];
             while (true) {
-                hash = pblock->GetHash();
-                if (hash <= hashTarget) {
+                // hash a batch of consecutive nonces at once
+                pblock->GetNonceHashes(pblock->nNonce, QUARK_BATCH_LANES, hashes);
+                size_t nLane = 0;
+                while (nLane < QUARK_BATCH_LANES && hashes[nLane] > hashTarget) nLane++;
+                nHashesDone += QUARK_BATCH_LANES;
+
+                if (nLane < QUARK_BATCH_LANES) {
+                    pblock->nNonce += nLane;
+                    hash = hashes[nLane];
                     // Found a solution
                     SetThreadPriority(THREAD_PRIORITY_NORMAL);
                     LogPrintf("%s:\n", __func__);
@@ -696,9 +689,8 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
                     break;
                 }
-                pblock->nNonce += 1;
-                nHashesDone += 1;
-                if ((pblock->nNonce & 0xFF) == 0)
+                pblock->nNonce += QUARK_BATCH_LANES;
+                if ((pblock->nNonce & 0xFF) < QUARK_BATCH_LANES)
                     break;
             }
 
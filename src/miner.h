@@ -8,6 +8,7 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
 #include "primitives/block.h"
 
 #include <stdint.h>
@@ -15,9 +16,11 @@
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
+class CCoinsView;
 class COutput;
 class CReserveKey;
 class CScript;
+class CTxMemPool;
 class CWallet;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
@@ -26,6 +29,14 @@ struct CBlockTemplate;
 
 /** Generate a new block, without valid proof-of-work */
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, std::vector<COutput>* availableCoins = nullptr);
+/**
+ * Append the mempool transactions that best fill a block at nHeight to the
+ * template, parents first: by coin age priority up to nBlockPrioritySize, then
+ * by fee rate. Inputs are checked against pcoinsBase plus the mempool, once per
+ * transaction and tip. Returns the fees. Requires cs_main and pool.cs.
+ */
+CAmount AddMempoolTransactions(CBlockTemplate& blocktemplate, CTxMemPool& pool, CCoinsView* pcoinsBase, const uint256& hashTip, int nHeight,
+                               unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize, unsigned int nBlockMinSize);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 /** Check mined block */
@@ -33,6 +33,11 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -424,7 +429,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char* pszDest, bool fCo
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed, sHostIp) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed, sHostIp)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (netPoller == NetPoller::SELECT && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -895,6 +900,7 @@ size_t CConnman::SocketSendData(CNode* pnode)
                 it++;
             } else {
                 // could not send full message; stop sending more
+                pnode->fCanSendData = false;
                 break;
             }
         } else {
@@ -904,6 +910,8 @@ size_t CConnman::SocketSendData(CNode* pnode)
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                     pnode->CloseSocketDisconnect();
+                } else if (nErr == WSAEWOULDBLOCK) {
+                    pnode->fCanSendData = false;
                 }
             }
             // couldn't send anything at all
@@ -1118,7 +1126,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (netPoller == NetPoller::SELECT && !IsSelectableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
         return;
@@ -1165,6 +1173,11 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+#ifdef USE_EPOLL
+    if (!RegisterNodeSocket(pnode))
+        pnode->CloseSocketDisconnect();
+#endif
+
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1206,6 +1219,9 @@ void CConnman::ThreadSocketHandler()
                     pnode->grantOutbound.Release();
 
                     // close socket and cleanup
+#ifdef USE_EPOLL
+                    UnregisterNodeSocket(pnode);
+#endif
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -1232,6 +1248,10 @@ void CConnman::ThreadSocketHandler()
                     }
                     if (fDelete) {
                         vNodesDisconnected.remove(pnode);
+#ifdef USE_EPOLL
+                        setReceivableNodes.erase(pnode);
+                        WITH_LOCK(cs_setPendingSendNodes, setPendingSendNodes.erase(pnode));
+#endif
                         DeleteNode(pnode);
                     }
                 }
@@ -1248,207 +1268,450 @@ void CConnman::ThreadSocketHandler()
                 clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
         }
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+#ifdef USE_EPOLL
+        if (netPoller == NetPoller::EPOLL) {
+            SocketHandlerEpoll();
+            continue;
         }
+#endif
+        SocketHandlerSelect();
+    }
+}
 
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes) {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
+void CConnman::SocketHandlerSelect()
+{
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
 
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
 
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            if (select_send) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (select_recv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
             }
         }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+            return;
+    }
+
+    //
+    // Accept new connections
+    //
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            AcceptConnection(hListenSocket);
+        }
+    }
+
+    //
+    // Service each socket
+    //
+    std::vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        for (CNode* pnode : vNodesCopy)
+            pnode->AddRef();
+    }
+    for (CNode* pnode : vNodesCopy) {
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
+        //
+        // Receive
+        //
+        bool recvSet = false;
+        bool sendSet = false;
+        bool errorSet = false;
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
+            sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
+            errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+        }
+        if (recvSet || errorSet) {
+            SocketRecvData(pnode);
         }
 
         //
-        // Accept new connections
+        // Send
         //
+        if (sendSet) {
+            LOCK(pnode->cs_vSend);
+            size_t nBytes = SocketSendData(pnode);
+            if (nBytes)
+                RecordBytesSent(nBytes);
+        }
+
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodesCopy)
+            pnode->Release();
+    }
+}
+
+#ifdef USE_EPOLL
+bool CConnman::StartEpoll(std::string& strError)
+{
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        strError = strprintf("epoll_create1 failed: %s", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupfd == -1) {
+        strError = strprintf("eventfd failed: %s", NetworkErrorString(WSAGetLastError()));
+        StopEpoll();
+        return false;
+    }
+
+    // level-triggered: the wakeup counter is reset when read, one connection is accepted per event
+    epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeupfd, &event) == -1) {
+        strError = strprintf("epoll_ctl failed: %s", NetworkErrorString(WSAGetLastError()));
+        StopEpoll();
+        return false;
+    }
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, hListenSocket.socket, &event) == -1) {
+            strError = strprintf("epoll_ctl failed: %s", NetworkErrorString(WSAGetLastError()));
+            StopEpoll();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CConnman::StopEpoll()
+{
+    if (wakeupfd != -1)
+        close(wakeupfd);
+    if (epollfd != -1)
+        close(epollfd);
+    wakeupfd = -1;
+    epollfd = -1;
+    setReceivableNodes.clear();
+    WITH_LOCK(cs_setPendingSendNodes, setPendingSendNodes.clear());
+}
+
+bool CConnman::RegisterNodeSocket(CNode* pnode)
+{
+    if (epollfd == -1)
+        return true;
+
+    // edge-triggered: readiness is remembered in setReceivableNodes and fCanSendData
+    // until the socket would block again
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return false;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, pnode->hSocket, &event) == -1) {
+        LogPrintf("%s: epoll_ctl failed for peer=%d: %s\n", __func__, pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    return true;
+}
+
+void CConnman::UnregisterNodeSocket(CNode* pnode)
+{
+    if (epollfd == -1)
+        return;
+
+    // a socket closed before is gone from the epoll set already
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, pnode->hSocket, nullptr) == -1) {
+        LogPrint(BCLog::NET, "%s: epoll_ctl failed for peer=%d: %s\n", __func__, pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+    }
+}
+
+void CConnman::SocketHandlerEpoll()
+{
+    // Only wait for events when no node has data left to read. As with select(),
+    // a node's send queue is drained before receiving more from it.
+    bool fMoreRecv = false;
+    for (CNode* pnode : setReceivableNodes) {
+        if (pnode->fPauseRecv)
+            continue;
+        LOCK(pnode->cs_vSend);
+        if (pnode->vSendMsg.empty()) {
+            fMoreRecv = true;
+            break;
+        }
+    }
+
+    epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(epollfd, events, EPOLL_MAX_EVENTS, fMoreRecv ? 0 : EPOLL_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return;
+
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    //
+    // Accept new connections and note which sockets became ready
+    //
+    for (int i = 0; i < nEvents; i++) {
+        void* ptr = events[i].data.ptr;
+        if (ptr == nullptr) {
+            uint64_t nWakeups;
+            if (read(wakeupfd, &nWakeups, sizeof(nWakeups)) != sizeof(nWakeups))
+                LogPrint(BCLog::NET, "%s: failed to read the wakeup event\n", __func__);
+            continue;
+        }
+
+        bool fListenSocket = false;
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (&hListenSocket == ptr) {
                 AcceptConnection(hListenSocket);
+                fListenSocket = true;
+                break;
             }
         }
+        if (fListenSocket)
+            continue;
 
-        //
-        // Service each socket
-        //
-        std::vector<CNode*> vNodesCopy;
+        // nodes are only deleted by this thread, after their socket left the epoll set
+        CNode* pnode = static_cast<CNode*>(ptr);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            setReceivableNodes.insert(pnode);
+        }
+        if (events[i].events & EPOLLOUT) {
+            LOCK(pnode->cs_vSend);
+            pnode->fCanSendData = true;
+        }
+    }
+
+    //
+    // Send
+    //
+    std::vector<CNode*> vSendNodes;
+    {
+        LOCK(cs_setPendingSendNodes);
+        vSendNodes.assign(setPendingSendNodes.begin(), setPendingSendNodes.end());
+    }
+    for (CNode* pnode : vSendNodes) {
+        if (interruptNet)
+            return;
+
+        size_t nBytes = 0;
         {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
-                pnode->AddRef();
+            LOCK(pnode->cs_vSend);
+            if (pnode->fCanSendData)
+                nBytes = SocketSendData(pnode);
+            if (pnode->vSendMsg.empty())
+                WITH_LOCK(cs_setPendingSendNodes, setPendingSendNodes.erase(pnode));
         }
-        for (CNode* pnode : vNodesCopy) {
-            if (interruptNet)
-                return;
+        if (nBytes)
+            RecordBytesSent(nBytes);
+    }
 
-            //
-            // Receive
-            //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
-            }
-            if (recvSet || errorSet) {
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = 0;
-                        {
-                            LOCK(pnode->cs_hSocket);
-                            if (pnode->hSocket == INVALID_SOCKET)
-                                continue;
-                            nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        }
-                        if (nBytes > 0) {
-                            bool notify = false;
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                                pnode->CloseSocketDisconnect();
-                            RecordBytesRecv(nBytes);
-                            if (notify) {
-                                size_t nSizeAdded = 0;
-                                auto it(pnode->vRecvMsg.begin());
-                                for (; it != pnode->vRecvMsg.end(); ++it) {
-                                    if (!it->complete())
-                                        break;
-                                    nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                                }
-                                {
-                                    LOCK(pnode->cs_vProcessMsg);
-                                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                                    pnode->nProcessQueueSize += nSizeAdded;
-                                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                                }
-                                WakeMessageHandler();
-                            }
-                        } else if (nBytes == 0) {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint(BCLog::NET, "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        } else if (nBytes < 0) {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
-            }
+    //
+    // Receive
+    //
+    for (auto it = setReceivableNodes.begin(); it != setReceivableNodes.end();) {
+        if (interruptNet)
+            return;
 
-            //
-            // Send
-            //
-            if (sendSet) {
-                LOCK(pnode->cs_vSend);
-                size_t nBytes = SocketSendData(pnode);
-                if (nBytes)
-                    RecordBytesSent(nBytes);
-            }
+        CNode* pnode = *it;
+        bool fSendPending = false;
+        {
+            LOCK(pnode->cs_vSend);
+            fSendPending = !pnode->vSendMsg.empty();
+        }
+        if (pnode->fPauseRecv || fSendPending) {
+            ++it;
+            continue;
+        }
+        if (SocketRecvData(pnode)) {
+            ++it;
+        } else {
+            it = setReceivableNodes.erase(it);
+        }
+    }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60) {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
-                    LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
+    //
+    // Inactivity checking, the timeouts are counted in seconds anyway
+    //
+    int64_t nTime = GetTime();
+    if (nTime != nLastInactivityCheck) {
+        nLastInactivityCheck = nTime;
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+            InactivityCheck(pnode);
+    }
+}
+#endif
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (wakeupfd == -1)
+        return;
+
+    uint64_t nWakeup = 1;
+    if (write(wakeupfd, &nWakeup, sizeof(nWakeup)) != sizeof(nWakeup))
+        LogPrint(BCLog::NET, "%s: failed to write the wakeup event\n", __func__);
+#endif
+}
+
+// Receive from the socket once, returns whether there may be more to read
+bool CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0) {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                if (!it->complete())
+                    break;
+                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
             }
+            WakeMessageHandler();
         }
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodesCopy)
-                pnode->Release();
+        // a short read drained the socket
+        return nBytes == (int)sizeof(pchBuf);
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint(BCLog::NET, "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        } else if (nErr == WSAEINTR) {
+            // interrupted, try again
+            return true;
+        }
+    }
+    return false;
+}
+
+void CConnman::InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60) {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0) {
+            LogPrint(BCLog::NET, "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL) {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        } else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90 * 60)) {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        } else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros()) {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
         }
     }
 }
@@ -1958,6 +2221,10 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->fFeeler = true;
 
     GetNodeSignals().InitializeNode(pnode, *this);
+#ifdef USE_EPOLL
+    if (!RegisterNodeSocket(pnode))
+        pnode->CloseSocketDisconnect();
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1969,6 +2236,10 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
 void CConnman::ThreadMessageHandler()
 {
     while (!flagInterruptMsgProc) {
+        FinishMessageWork();
+        if (flagInterruptMsgProc)
+            return;
+
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
@@ -2014,6 +2285,78 @@ void CConnman::ThreadMessageHandler()
     }
 }
 
+bool CConnman::QueueMessageWork(CNode* pnode, std::function<void()> work, std::function<void()> finish)
+{
+    if (vMessageWorkers.empty())
+        return false;
+
+    // a node always uses the same worker, keeping its work in order
+    MessageWorker& worker = *vMessageWorkers[pnode->GetId() % vMessageWorkers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.queue.size() >= MAX_MESSAGE_WORKER_QUEUE)
+            return false;
+        pnode->AddRef();
+        worker.queue.push_back(MessageWork{pnode, std::move(work), std::move(finish)});
+    }
+    pnode->nMessageWorkPending++;
+    worker.cond.notify_one();
+    return true;
+}
+
+bool CConnman::IsMessageWorkBacklogged(CNode* pnode)
+{
+    if (vMessageWorkers.empty() || pnode->nMessageWorkPending == 0)
+        return false;
+
+    MessageWorker& worker = *vMessageWorkers[pnode->GetId() % vMessageWorkers.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    return worker.queue.size() >= MAX_MESSAGE_WORKER_QUEUE;
+}
+
+void CConnman::ThreadMessageWorker(MessageWorker& worker)
+{
+    while (true) {
+        MessageWork work;
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.cond.wait(lock, [&] { return flagInterruptMsgProc || !worker.queue.empty(); });
+            if (flagInterruptMsgProc)
+                return;
+            work = std::move(worker.queue.front());
+            worker.queue.pop_front();
+        }
+
+        if (!work.pnode->fDisconnect)
+            work.work();
+
+        {
+            std::lock_guard<std::mutex> lock(mutexMessageWorkDone);
+            queueMessageWorkDone.push_back(std::move(work));
+        }
+        WakeMessageHandler();
+    }
+}
+
+void CConnman::FinishMessageWork()
+{
+    std::deque<MessageWork> queueDone;
+    {
+        std::lock_guard<std::mutex> lock(mutexMessageWorkDone);
+        queueDone.swap(queueMessageWorkDone);
+    }
+
+    for (const MessageWork& work : queueDone) {
+        work.pnode->nMessageWorkPending--;
+        if (!work.pnode->fDisconnect)
+            work.finish();
+    }
+
+    LOCK(cs_vNodes);
+    for (const MessageWork& work : queueDone)
+        work.pnode->Release();
+}
+
 bool CConnman::BindListenPort(const CService& addrBind, std::string& strError, bool fWhitelisted)
 {
     strError = "";
@@ -2152,6 +2495,8 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    netPoller = NetPoller::SELECT;
+    nMessageWorkers = 0;
     semOutbound = NULL;
     nMaxConnections = 0;
     nMaxOutbound = 0;
@@ -2179,6 +2524,13 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
 
+    netPoller = connOptions.netPoller;
+    nMessageWorkers = std::max(0, std::min(connOptions.nMessageWorkers, MAX_MESSAGE_WORKERS));
+#ifdef USE_EPOLL
+    if (netPoller == NetPoller::EPOLL && !StartEpoll(strNodeError))
+        return false;
+#endif
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2265,6 +2617,11 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
+    for (int i = 0; i < nMessageWorkers; i++) {
+        vMessageWorkers.emplace_back(new MessageWorker());
+        MessageWorker& worker = *vMessageWorkers.back();
+        worker.thread = std::thread(&TraceThread<std::function<void()> >, "msgworker", std::function<void()>(std::bind(&CConnman::ThreadMessageWorker, this, std::ref(worker))));
+    }
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
     // Dump network addresses
@@ -2306,9 +2663,16 @@ void CConnman::Interrupt()
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    for (const auto& worker : vMessageWorkers) {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->cond.notify_all();
+    }
 
     interruptNet();
     InterruptSocks5(true);
+    WakeSocketHandler();
 
     if (semOutbound)
         for (int i=0; i<(nMaxOutbound + nMaxFeeler); i++)
@@ -2321,6 +2685,16 @@ void CConnman::Stop()
 
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    for (const auto& worker : vMessageWorkers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+        for (const MessageWork& work : worker->queue)
+            work.pnode->Release();
+    }
+    vMessageWorkers.clear();
+    for (const MessageWork& work : queueMessageWorkDone)
+        work.pnode->Release();
+    queueMessageWorkDone.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2329,6 +2703,9 @@ void CConnman::Stop()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+#ifdef USE_EPOLL
+    StopEpoll();
+#endif
 
     if (fAddressesInitialized)
     {
@@ -2590,7 +2967,10 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
     fPauseRecv = false;
     fPauseSend = false;
+    fCanSendData = true;
     nProcessQueueSize = 0;
+    nBatchCheckedMessages = 0;
+    nMessageWorkPending = 0;
 
     for (const std::string &msg : getAllNetMessageTypes())
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2677,6 +3057,16 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+
+#ifdef USE_EPOLL
+        // leave the rest to the socket handler, which only needs waking when it
+        // won't get an event for this socket
+        if (epollfd != -1 && !pnode->vSendMsg.empty()) {
+            bool fAdded = WITH_LOCK(cs_setPendingSendNodes, return setPendingSendNodes.insert(pnode).second);
+            if (fAdded && pnode->fCanSendData)
+                WakeSocketHandler();
+        }
+#endif
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
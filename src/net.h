@@ -26,6 +26,7 @@
 
 #include <atomic>
 #include <deque>
+#include <set>
 #include <stdint.h>
 #include <thread>
 #include <memory>
@@ -90,6 +91,23 @@ static const bool DEFAULT_FORCEDNSSEED = true;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** Mechanisms the socket handler thread can wait for socket events with (-netpoller) */
+enum class NetPoller {
+    SELECT,
+    EPOLL,
+};
+static const char* const DEFAULT_NETPOLLER = "select";
+/** Maximum time the socket handler waits for socket events (in milliseconds) */
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+static const int EPOLL_TIMEOUT_MILLISECONDS = 1000;
+/** Maximum number of socket events handled per epoll_wait() call */
+static const int EPOLL_MAX_EVENTS = 256;
+/** -msgworkers default: threads processing the messages that don't need the message handler thread */
+static const int DEFAULT_MESSAGE_WORKERS = 2;
+static const int MAX_MESSAGE_WORKERS = 8;
+/** Messages waiting per worker before the message handler processes new ones itself */
+static const size_t MAX_MESSAGE_WORKER_QUEUE = 1000;
+
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
@@ -145,6 +163,8 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        NetPoller netPoller = NetPoller::SELECT;
+        int nMessageWorkers = 0;
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -159,6 +179,15 @@ public:
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
 
+    /**
+     * Run work on a message worker thread, then finish on the message handler thread.
+     * The work queued for a node is finished in the order it was queued. Returns
+     * false, leaving both to the caller, when there are no workers or they are too busy.
+     */
+    bool QueueMessageWork(CNode* pnode, std::function<void()> work, std::function<void()> finish);
+    /** Whether the worker of a node is too busy and still has work of that node to finish */
+    bool IsMessageWorkBacklogged(CNode* pnode);
+
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
     {
@@ -277,6 +306,9 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id);
 
     unsigned int GetReceiveFloodSize() const;
+
+    /** Make the socket handler thread look at its sockets again without waiting for an event. */
+    void WakeSocketHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -289,8 +321,21 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections();
     void ThreadMessageHandler();
+    struct MessageWorker;
+    void ThreadMessageWorker(MessageWorker& worker);
+    void FinishMessageWork();
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+    void SocketHandlerSelect();
+#ifdef USE_EPOLL
+    bool StartEpoll(std::string& strError);
+    void StopEpoll();
+    bool RegisterNodeSocket(CNode* pnode);
+    void UnregisterNodeSocket(CNode* pnode);
+    void SocketHandlerEpoll();
+#endif
+    bool SocketRecvData(CNode* pnode);
+    void InactivityCheck(CNode* pnode);
     void ThreadDNSAddressSeed();
 
     void WakeMessageHandler();
@@ -342,6 +387,19 @@ private:
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
 
+    NetPoller netPoller;
+#ifdef USE_EPOLL
+    int epollfd = -1;
+    // eventfd waking up epoll_wait()
+    int wakeupfd = -1;
+    // nodes whose socket may have data left to read, only used by the socket handler thread
+    std::set<CNode*> setReceivableNodes;
+    // nodes with queued data left to send
+    std::set<CNode*> setPendingSendNodes;
+    Mutex cs_setPendingSendNodes;
+    int64_t nLastInactivityCheck = 0;
+#endif
+
     std::vector<ListenSocket> vhListenSocket;
     banmap_t setBanned;
     RecursiveMutex cs_setBanned;
@@ -380,6 +438,23 @@ private:
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
+    struct MessageWork {
+        CNode* pnode;
+        std::function<void()> work;
+        std::function<void()> finish;
+    };
+    struct MessageWorker {
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<MessageWork> queue;
+        std::thread thread;
+    };
+    int nMessageWorkers;
+    std::vector<std::unique_ptr<MessageWorker>> vMessageWorkers;
+    // work done by the workers, to be finished by the message handler thread
+    std::deque<MessageWork> queueMessageWorkDone;
+    std::mutex mutexMessageWorkDone;
+
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
@@ -559,6 +634,10 @@ public:
     RecursiveMutex cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
+    // number of queued masternode messages whose signatures were checked in a batch already (message handler only)
+    int nBatchCheckedMessages;
+    // number of messages queued to a message worker and not finished yet (message handler only)
+    int nMessageWorkPending;
 
     RecursiveMutex cs_sendProcessing;
 
@@ -600,6 +679,8 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // whether a send would not block, as last seen with epoll (guarded by cs_vSend)
+    bool fCanSendData;
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
@@ -20,6 +20,10 @@
 
 #include <atomic>
 
+#ifdef USE_EPOLL
+#include <poll.h>
+#endif
+
 #ifndef WIN32
 #include <fcntl.h>
 #endif
@@ -284,6 +288,13 @@ static IntrRecvError InterruptibleRecv(char* data, size_t len, int timeout, SOCK
         } else { // Other error or blocking
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
+#ifdef USE_EPOLL
+                // sockets can be past FD_SETSIZE with -netpoller=epoll
+                struct pollfd pollfd = {};
+                pollfd.fd = hSocket;
+                pollfd.events = POLLIN;
+                int nRet = poll(&pollfd, 1, std::min(endTime - curTime, maxWait));
+#else
                 if (!IsSelectableSocket(hSocket)) {
                     return IntrRecvError::NetworkError;
                 }
@@ -292,6 +303,7 @@ static IntrRecvError InterruptibleRecv(char* data, size_t len, int timeout, SOCK
                 FD_ZERO(&fdset);
                 FD_SET(hSocket, &fdset);
                 int nRet = select(hSocket + 1, &fdset, NULL, NULL, &tval);
+#endif
                 if (nRet == SOCKET_ERROR) {
                     return IntrRecvError::NetworkError;
                 }
@@ -505,11 +517,19 @@ bool static ConnectSocketDirectly(const CService& addrConnect, SOCKET& hSocketRe
         int nErr = WSAGetLastError();
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK || nErr == WSAEINVAL) {
+#ifdef USE_EPOLL
+            // sockets can be past FD_SETSIZE with -netpoller=epoll
+            struct pollfd pollfd = {};
+            pollfd.fd = hSocket;
+            pollfd.events = POLLOUT;
+            int nRet = poll(&pollfd, 1, nTimeout);
+#else
             struct timeval timeout = MillisToTimeval(nTimeout);
             fd_set fdset;
             FD_ZERO(&fdset);
             FD_SET(hSocket, &fdset);
             int nRet = select(hSocket + 1, NULL, &fdset, NULL, &timeout);
+#endif
             if (nRet == 0) {
                 LogPrint(BCLog::NET, "connection to %s timeout\n", addrConnect.ToString());
                 CloseSocket(hSocket);
@@ -34,9 +34,38 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+void CBlockHeader::GetNonceHashes(uint32_t nNonceStart, size_t nCount, uint256* phashes) const
+{
+    if (nVersion < 4)  {
+        // the headers differ in their nonce only
+        uint8_t data[QUARK_BATCH_LANES * 80];
+        for (size_t n = 0; n < QUARK_BATCH_LANES; n++) {
+            uint8_t* p = &data[n * 80];
+            WriteLE32(&p[0], nVersion);
+            memcpy(&p[4], hashPrevBlock.begin(), hashPrevBlock.size());
+            memcpy(&p[36], hashMerkleRoot.begin(), hashMerkleRoot.size());
+            WriteLE32(&p[68], nTime);
+            WriteLE32(&p[72], nBits);
+        }
+        for (size_t nFirst = 0; nFirst < nCount; nFirst += QUARK_BATCH_LANES) {
+            const size_t nGroup = std::min(nCount - nFirst, QUARK_BATCH_LANES);
+            for (size_t n = 0; n < nGroup; n++)
+                WriteLE32(&data[n * 80 + 76], nNonceStart + nFirst + n);
+            HashQuarkBatch(data, 80, nGroup, phashes + nFirst);
+        }
+        return;
+    }
+    // version >= 4
+    CBlockHeader header(*this);
+    for (size_t n = 0; n < nCount; n++) {
+        header.nNonce = nNonceStart + n;
+        phashes[n] = header.GetHash();
+    }
+}
+
 CScript CBlock::GetPaidPayee(CAmount nAmount) const
 {
-    const auto& tx = vtx[IsProofOfWork() ? 0 : 1];
+    const CTransaction& tx = *vtx[IsProofOfWork() ? 0 : 1];
 
     for (auto it = tx.vout.rbegin(); it != tx.vout.rend(); ++it)
     {
@@ -63,7 +92,7 @@ std::string CBlock::ToString() const
         vtx.size());
     for (unsigned int i = 0; i < vtx.size(); i++)
     {
-        s << "  " << vtx[i].ToString() << "\n";
+        s << "  " << vtx[i]->ToString() << "\n";
     }
     return s.str();
 }
@@ -72,6 +72,9 @@ public:
 
     uint256 GetHash() const;
 
+    //! hashes of this header for nCount consecutive nonces starting at nNonceStart
+    void GetNonceHashes(uint32_t nNonceStart, size_t nCount, uint256* phashes) const;
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -83,13 +86,17 @@ class CBlock : public CBlockHeader
 {
 public:
     // network and disk
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
 
     // ppcoin: block signature - signed by one of the coin base txout[N]'s owner
     std::vector<unsigned char> vchBlockSig;
 
     // memory only
     mutable bool fChecked;
+    //! the context-free checks of CheckBlock passed, see PreCheckBlock
+    mutable bool fPrechecked;
+    //! the block signature was verified against the coinstake key
+    mutable bool fSigChecked;
 
     CBlock()
     {
@@ -102,13 +109,29 @@ public:
         *((CBlockHeader*)this) = header;
     }
 
+    // the memos are of the checks run on this object, a copy is checked again
+    CBlock(const CBlock& block) : CBlockHeader(block), vtx(block.vtx), vchBlockSig(block.vchBlockSig), fChecked(false), fPrechecked(false), fSigChecked(false) {}
+    CBlock(CBlock&& block) = default;
+
+    CBlock& operator=(const CBlock& block)
+    {
+        *((CBlockHeader*)this) = block;
+        vtx = block.vtx;
+        vchBlockSig = block.vchBlockSig;
+        fChecked = false;
+        fPrechecked = false;
+        fSigChecked = false;
+        return *this;
+    }
+    CBlock& operator=(CBlock&& block) = default;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(*(CBlockHeader*)this);
         READWRITE(vtx);
-	if(vtx.size() > 1 && vtx[1].IsCoinStake())
+	if(vtx.size() > 1 && vtx[1]->IsCoinStake())
 		READWRITE(vchBlockSig);
     }
 
@@ -117,6 +140,8 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fPrechecked = false;
+        fSigChecked = false;
         vchBlockSig.clear();
     }
 
@@ -136,7 +161,7 @@ public:
 
     bool IsProofOfStake() const
     {
-        return (vtx.size() > 1 && vtx[1].IsCoinStake());
+        return (vtx.size() > 1 && vtx[1]->IsCoinStake());
     }
 
     bool IsProofOfWork() const
@@ -15,6 +15,7 @@
 #include "uint256.h"
 
 #include <list>
+#include <memory>
 
 class CTransaction;
 
@@ -342,4 +343,11 @@ struct CMutableTransaction
     std::string ToString() const;
 };
 
+/** A shared, immutable transaction. Blocks, mempool entries and the
+ *  validation signals hold these instead of copies of the transaction. */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx>
+static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "fs.h"
+#include "key_io.h"
 #include "logging.h"
 #include "main.h"
 #include "masternode.h"
@@ -12,22 +13,209 @@
 #include "masternode-sync.h"
 #include "rewards.h"
 #include "sqlite3/sqlite3.h"
+#include "streams.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "utilmoneystr.h"
 #include "utiltime.h"
 
 #include <algorithm>
-#include <cstdio>
+#include <limits>
 #include <sstream>
-#include <boost/unordered_map.hpp>
 
-boost::unordered_map<int, CAmount> mDynamicRewards;
+// (epoch height, amount), sorted by height
+std::vector<std::pair<int, CAmount>> vDynamicRewards;
+CCoinsViewDB* pcoinsdbRewards = nullptr;
 
 sqlite3* db = nullptr;
-sqlite3_stmt* insertStmt = nullptr;
-sqlite3_stmt* deleteStmt = nullptr;
+sqlite3_stmt* insertSupplyStmt = nullptr;
+sqlite3_stmt* deleteSupplyStmt = nullptr;
+sqlite3_stmt* insertSupplyStateStmt = nullptr;
 bool initiated = false;
 
+CSupplyAccumulator supply;
+bool fSupplyRewrite = false;
+int nSupplyPendingBlocks = 0;
+
+static CSupplyKey GetSupplyKey(const CTxOut& out)
+{
+    const auto& consensus = Params().GetConsensus();
+
+    CSupplyKey key;
+
+    CTxDestination dest;
+    if (ExtractDestination(out.scriptPubKey, dest)) {
+        const std::string addr = EncodeDestination(dest);
+        if (consensus.mBurnAddresses.find(addr) != consensus.mBurnAddresses.end()) {
+            key.strBurnAddress = addr;
+        }
+    }
+
+    if (CMasternode::IsMasternodeCollateralAmount(out.nValue)) {
+        key.nCollateral = out.nValue;
+    }
+
+    return key;
+}
+
+void CSupplyBucket::Add(CAmount nValue, int nSign)
+{
+    nHundreds += nSign * (nValue / 100);
+
+    const int nRemainder = static_cast<int>(nValue % 100);
+    if (nRemainder != 0) {
+        auto it = mapRemainders.emplace(nRemainder, 0).first;
+        it->second += nSign;
+        if (it->second == 0) mapRemainders.erase(it);
+    }
+}
+
+CAmount CSupplyBucket::GetWeightedValue(int64_t nWeight) const
+{
+    // floor((100 * q + r) * w / 100) == q * w + floor(r * w / 100)
+    CAmount nValue = nHundreds * nWeight;
+    for (const auto& it : mapRemainders) {
+        nValue += it.second * ((it.first * nWeight) / 100);
+    }
+    return nValue;
+}
+
+void CSupplyDelta::Push(const CTxOut& out, int nHeight, int nSign)
+{
+    vEntries.push_back({GetSupplyKey(out), nHeight, out.nValue, nSign});
+}
+
+void CSupplyAccumulator::Clear()
+{
+    mapBuckets.clear();
+    setDirty.clear();
+    hashBestBlock.SetNull();
+}
+
+void CSupplyAccumulator::Apply(const CSupplyDelta& delta)
+{
+    for (const auto& entry : delta.vEntries) {
+        auto& buckets = mapBuckets[entry.key];
+        auto& bucket = buckets[entry.nHeight];
+        bucket.Add(entry.nValue, entry.nSign);
+        if (bucket.IsEmpty()) {
+            buckets.erase(entry.nHeight);
+            if (buckets.empty()) mapBuckets.erase(entry.key);
+        }
+        setDirty.emplace(entry.key, entry.nHeight);
+    }
+}
+
+bool CSupplyAccumulator::Rebuild(CCoinsView* pview)
+{
+    Clear();
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(pview->Cursor());
+
+    while (pcursor->Valid()) {
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key)) {
+            if (!pcursor->GetValue(coin)) return false;
+            if (!coin.IsSpent()) {
+                mapBuckets[GetSupplyKey(coin.out)][coin.nHeight].Add(coin.out.nValue, 1);
+            }
+        }
+        pcursor->Next();
+    }
+
+    hashBestBlock = pview->GetBestBlock();
+
+    return true;
+}
+
+int64_t CSupplyAccumulator::GetSupplyWeight(int64_t nBlocksDiff, int64_t nBlocksPerMonth)
+{
+    const auto nMultiplier = 100000000LL;
+
+    // y = mx + b 
+    // 3 months old or less => 100%
+    // 12 months old or greater => 0%
+    return
+        std::min(
+            std::max(
+                (100LL * nMultiplier - (((100LL * nMultiplier)/(9LL * nBlocksPerMonth)) * (nBlocksDiff - 3LL * nBlocksPerMonth))) / nMultiplier, 
+            0LL), 
+        100LL);
+}
+
+CAmount CSupplyAccumulator::GetCirculatingSupply(int nHeight, int64_t nBlocksPerMonth, CAmount nCollateral, CAmount nNextCollateral) const
+{
+    const auto& consensus = Params().GetConsensus();
+
+    CAmount nSupply = 0;
+
+    for (const auto& it : mapBuckets) {
+        const auto& key = it.first;
+
+        // ----------- burn address filtering -----------
+        if (!key.strBurnAddress.empty() &&
+            consensus.mBurnAddresses.at(key.strBurnAddress) < nHeight
+        ) {
+            continue;
+        }
+
+        // ----------- masternode collaterals filtering ----------- 
+        if (key.nCollateral != 0 &&
+            (key.nCollateral == nCollateral || key.nCollateral == nNextCollateral)
+        ) {
+            continue;
+        }
+
+        // ----------- UTXOs age related weighting -----------
+        // newest heights first, the weight only decreases with the age
+        for (auto bit = it.second.rbegin(); bit != it.second.rend(); ++bit) {
+            const auto nWeight = GetSupplyWeight(nHeight - bit->first, nBlocksPerMonth);
+            if (nWeight <= 0) break;
+            nSupply += bit->second.GetWeightedValue(nWeight);
+        }
+    }
+
+    return nSupply;
+}
+
+// The epochs follow each other, so the entry is normally found by its position
+static std::vector<std::pair<int, CAmount>>::iterator FindDynamicReward(int nEpochHeight)
+{
+    if (!vDynamicRewards.empty()) {
+        const int64_t nPos = (nEpochHeight - vDynamicRewards.front().first) / Params().GetConsensus().nRewardAdjustmentInterval;
+        if (nPos >= 0 && nPos < static_cast<int64_t>(vDynamicRewards.size()) && vDynamicRewards[nPos].first == nEpochHeight) {
+            return vDynamicRewards.begin() + nPos;
+        }
+    }
+
+    auto it = std::lower_bound(vDynamicRewards.begin(), vDynamicRewards.end(), std::make_pair(nEpochHeight, std::numeric_limits<CAmount>::min()));
+    return (it != vDynamicRewards.end() && it->first == nEpochHeight) ? it : vDynamicRewards.end();
+}
+
+static void SetDynamicReward(int nEpochHeight, CAmount nAmount)
+{
+    auto it = std::lower_bound(vDynamicRewards.begin(), vDynamicRewards.end(), std::make_pair(nEpochHeight, std::numeric_limits<CAmount>::min()));
+    if (it != vDynamicRewards.end() && it->first == nEpochHeight) {
+        it->second = nAmount;
+    } else {
+        vDynamicRewards.emplace(it, nEpochHeight, nAmount);
+    }
+}
+
+// the history is committed together with the coins of the blocks it was computed from
+static bool WriteDynamicRewards()
+{
+    if (pcoinsdbRewards == nullptr) return false;
+    pcoinsdbRewards->WriteDynamicRewards(vDynamicRewards);
+    return true;
+}
+
+void CRewards::SetCoinsDB(CCoinsViewDB* pcoinsdbviewIn)
+{
+    pcoinsdbRewards = pcoinsdbviewIn;
+}
+
 bool CRewards::Init()
 {
     if(initiated) return true;
@@ -55,21 +243,6 @@ bool CRewards::Init()
                 }
             }
 
-            // Delete the database file if it exists when reindexing
-            if(ok && fReindex) 
-            {
-                if (auto file = std::fopen(filename.c_str(), "r")) {
-                    std::fclose(file);
-                    // File exists, delete it
-                    if (std::remove(filename.c_str()) == 0) {
-                        oss << "Deleted existing database file: " << filename << std::endl;
-                    } else {
-                        oss << "Failed to delete existing database file: " << filename << std::endl;
-                        ok = false;
-                    }
-                }
-            }
-
             if(ok) { // Create and/or open the database
                 // the wallet sometimes restarts
                 // and the restart starts by spawnning a new wallet instance
@@ -94,45 +267,86 @@ bool CRewards::Init()
             }
 
             if(ok) { // database is open and working
-                // Create the rewards table if not exists
-                const auto create_table_query = "CREATE TABLE IF NOT EXISTS rewards (height INT PRIMARY KEY, amount INTEGER)";
-                auto rc = sqlite3_exec(db, create_table_query, NULL, NULL, NULL);
+                // the rewards history moved to the chainstate, where it's refilled from the blocks
+                auto rc = sqlite3_exec(db, "DROP TABLE IF EXISTS rewards", NULL, NULL, NULL);
 
                 if (rc != SQLITE_OK) {
-                    oss << "SQL error CREATE TABLE: " << sqlite3_errmsg(db) << std::endl;
+                    oss << "SQL error DROP TABLE: " << sqlite3_errmsg(db) << std::endl;
                     ok = false;
                 }
             }
 
-            if(ok) { // Create insert statement
-                const std::string insertSql = "INSERT OR REPLACE INTO rewards (height, amount) VALUES (?, ?)";
-                auto rc = sqlite3_prepare_v2(db, insertSql.c_str(), insertSql.length(), &insertStmt, nullptr);
+            if(ok) { // Create the circulating supply tables if not exist
+                const auto create_supply_query = 
+                    "CREATE TABLE IF NOT EXISTS supply (key BLOB, height INT, bucket BLOB, PRIMARY KEY (key, height));"
+                    "CREATE TABLE IF NOT EXISTS supply_state (id INT PRIMARY KEY, best BLOB)";
+                auto rc = sqlite3_exec(db, create_supply_query, NULL, NULL, NULL);
+
                 if (rc != SQLITE_OK) {
-                    oss << "SQL error INSERT OR REPLACE: " << sqlite3_errmsg(db) << std::endl;
+                    oss << "SQL error CREATE TABLE: " << sqlite3_errmsg(db) << std::endl;
                     ok = false;
                 }
             }
 
-            if(ok) { // Create delete statement
-                const std::string deleteSql = "DELETE FROM rewards WHERE height >= ?";
-                auto rc = sqlite3_prepare_v2(db, deleteSql.c_str(), deleteSql.length(), &deleteStmt, nullptr);
-                if (rc != SQLITE_OK) {
-                    oss << "SQL error DELETE FROM: " << sqlite3_errmsg(db) << std::endl;
+            if(ok) { // Create the circulating supply statements
+                const std::string insertSupplySql = "INSERT OR REPLACE INTO supply (key, height, bucket) VALUES (?, ?, ?)";
+                const std::string deleteSupplySql = "DELETE FROM supply WHERE key = ? AND height = ?";
+                const std::string insertSupplyStateSql = "INSERT OR REPLACE INTO supply_state (id, best) VALUES (0, ?)";
+                if (sqlite3_prepare_v2(db, insertSupplySql.c_str(), insertSupplySql.length(), &insertSupplyStmt, nullptr) != SQLITE_OK ||
+                    sqlite3_prepare_v2(db, deleteSupplySql.c_str(), deleteSupplySql.length(), &deleteSupplyStmt, nullptr) != SQLITE_OK ||
+                    sqlite3_prepare_v2(db, insertSupplyStateSql.c_str(), insertSupplyStateSql.length(), &insertSupplyStateStmt, nullptr) != SQLITE_OK
+                ) {
+                    oss << "SQL error supply statements: " << sqlite3_errmsg(db) << std::endl;
                     ok = false;
                 }
             }
 
-            if(ok) { // Loads the database into the in-memory map
-                const char* sql = "SELECT height, amount FROM rewards";
-                auto rc = sqlite3_exec(db, sql, [](void* data, int argc, char** argv, char** /* azColName */) -> int {
-                    int height = std::stoi(argv[0]);
-                    CAmount amount = std::stoll(argv[1]);
-                    mDynamicRewards[height] = amount;
-                    return 0;
-                }, nullptr, nullptr);
+            if(ok && fReindex) { // the stored circulating supply belongs to the previous chainstate
+                supply.Clear();
+                fSupplyRewrite = true;
+                oss << "Circulating supply will be rebuilt" << std::endl;
+            } else if(ok) { // Loads the circulating supply into memory
+                supply.Clear();
+
+                sqlite3_stmt* selectStmt = nullptr;
+                auto rc = sqlite3_prepare_v2(db, "SELECT key, height, bucket FROM supply", -1, &selectStmt, nullptr);
+                while (rc == SQLITE_OK && (rc = sqlite3_step(selectStmt)) == SQLITE_ROW) {
+                    const auto pKey = static_cast<const char*>(sqlite3_column_blob(selectStmt, 0));
+                    const auto pBucket = static_cast<const char*>(sqlite3_column_blob(selectStmt, 2));
+                    CDataStream ssKey(pKey, pKey + sqlite3_column_bytes(selectStmt, 0), SER_DISK, CLIENT_VERSION);
+                    CDataStream ssBucket(pBucket, pBucket + sqlite3_column_bytes(selectStmt, 2), SER_DISK, CLIENT_VERSION);
+                    CSupplyKey key;
+                    ssKey >> key;
+                    ssBucket >> supply.mapBuckets[key][sqlite3_column_int(selectStmt, 1)];
+                    rc = SQLITE_OK;
+                }
+                sqlite3_finalize(selectStmt);
 
-                if (rc != SQLITE_OK) {
-                    oss << "SQL error SELECT: " << sqlite3_errmsg(db) << std::endl;
+                if (rc == SQLITE_DONE) {
+                    selectStmt = nullptr;
+                    rc = sqlite3_prepare_v2(db, "SELECT best FROM supply_state WHERE id = 0", -1, &selectStmt, nullptr);
+                    if (rc == SQLITE_OK && (rc = sqlite3_step(selectStmt)) == SQLITE_ROW &&
+                        sqlite3_column_bytes(selectStmt, 0) == static_cast<int>(supply.hashBestBlock.size())
+                    ) {
+                        const auto pBest = static_cast<const unsigned char*>(sqlite3_column_blob(selectStmt, 0));
+                        supply.hashBestBlock = uint256(std::vector<unsigned char>(pBest, pBest + supply.hashBestBlock.size()));
+                        rc = SQLITE_DONE;
+                    }
+                    sqlite3_finalize(selectStmt);
+                }
+
+                if (rc != SQLITE_DONE) {
+                    oss << "SQL error SELECT supply: " << sqlite3_errmsg(db) << std::endl;
+                    ok = false;
+                } else {
+                    oss << "Circulating supply loaded at block " << supply.hashBestBlock.GetHex() << std::endl;
+                }
+            }
+
+            if(ok) { // Loads the rewards history from the chainstate
+                vDynamicRewards.clear();
+                if (pcoinsdbRewards == nullptr || !pcoinsdbRewards->ReadDynamicRewards(vDynamicRewards)) {
+                    oss << "Unable to read the rewards history from the chainstate" << std::endl;
                     ok = false;
                 }
             }
@@ -141,18 +355,19 @@ bool CRewards::Init()
                 const auto nFeatureStartHeight = consensus.vUpgrades[Consensus::UPGRADE_DYNAMIC_REWARDS].nActivationHeight;
                 const auto nCurrentHeight = chainActive.Height();
                 const auto nRewardAdjustmentInterval = consensus.nRewardAdjustmentInterval;
+                auto fFilled = false;
 
                 for(
                     int nEpochHeight = GetDynamicRewardsEpochHeight(nFeatureStartHeight) + nRewardAdjustmentInterval; 
                     nEpochHeight <= nCurrentHeight; 
                     nEpochHeight += nRewardAdjustmentInterval
                 ) {
-                    if (mDynamicRewards.find(nEpochHeight) == mDynamicRewards.end()) { // missing entry
+                    if (FindDynamicReward(nEpochHeight) == vDynamicRewards.end()) { // missing entry
                         const auto& pIndex = chainActive[nEpochHeight + 1];            // gets the first block index of that epoch
 
                         CBlock block;
                         if (ReadBlockFromDisk(block, pIndex)) {
-                            const auto& tx = block.vtx[block.IsProofOfWork() ? 0 : 1];
+                            const CTransaction& tx = *block.vtx[block.IsProofOfWork() ? 0 : 1];
 
                             CAmount nSubsidy = 0;
 
@@ -168,29 +383,22 @@ bool CRewards::Init()
 
                             nSubsidy += tx.GetValueOut();
 
-                            mDynamicRewards[nEpochHeight] = nSubsidy;
-
-                            sqlite3_bind_int(insertStmt, 1, nEpochHeight); // on the file database
-                            sqlite3_bind_int64(insertStmt, 2, nSubsidy);
-                            auto rc = sqlite3_step(insertStmt);
-                            if (rc != SQLITE_DONE) {
-                                oss << "SQL error INSERT OR REPLACE: " << sqlite3_errmsg(db) << std::endl;
-                                ok = false;
-                            }
-                            sqlite3_reset(insertStmt);
+                            SetDynamicReward(nEpochHeight, nSubsidy);
+                            fFilled = true;
                         }
                     }
                 }
+
+                if (fFilled && !WriteDynamicRewards()) {
+                    oss << "Unable to write the rewards history" << std::endl;
+                    ok = false;
+                }
             }
 
-            if(ok && mDynamicRewards.size() > 0) { // Printing the map
+            if(ok && vDynamicRewards.size() > 0) { // Printing the history
                 oss << "Dynamic Rewards:" << std::endl;
 
-                // Copy elements to std::map, which is ordered by key
-                std::map<int, CAmount> orderedRewards(mDynamicRewards.begin(), mDynamicRewards.end());
-
-                // Iterate the ordered map
-                for (const auto& pair : orderedRewards) {
+                for (const auto& pair : vDynamicRewards) {
                     oss << "Height: " << pair.first << ", Amount: " << FormatMoney(pair.second) << std::endl;
                 }
             }
@@ -220,8 +428,10 @@ bool CRewards::Init()
 
 void CRewards::Shutdown()
 {
-    if(insertStmt != nullptr) sqlite3_finalize(insertStmt);
-    if(deleteStmt != nullptr) sqlite3_finalize(deleteStmt);
+    if(db != nullptr && nSupplyPendingBlocks > 0) WriteSupply();
+    if(insertSupplyStmt != nullptr) sqlite3_finalize(insertSupplyStmt);
+    if(deleteSupplyStmt != nullptr) sqlite3_finalize(deleteSupplyStmt);
+    if(insertSupplyStateStmt != nullptr) sqlite3_finalize(insertSupplyStateStmt);
     if(db != nullptr) sqlite3_close(db);
 }
 
@@ -268,7 +478,7 @@ bool CRewards::ConnectBlock(const CBlockIndex* pindex, CAmount nSubsidy)
             auto nBlocksPerMonth = MONTH_IN_SECONDS / consensus.nTargetSpacing;
 
             // get total money supply
-            const auto nMoneySupply = pindex->nMoneySupply.get();
+            const auto nMoneySupply = pindex->GetMoneySupply().get();
             oss << "nMoneySupply: " << FormatMoney(nMoneySupply) << std::endl;
 
             // get the current masternode collateral, and the next week collateral
@@ -276,54 +486,12 @@ bool CRewards::ConnectBlock(const CBlockIndex* pindex, CAmount nSubsidy)
             auto nNextWeekCollateralAmount = CMasternode::GetMasternodeNodeCollateral(nHeight + nBlocksPerWeek);
 
             // calculate the current circulating supply
-            CAmount nCirculatingSupply = 0;
-            FlushStateToDisk();
-            std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsTip->Cursor());
-
-            while (pcursor->Valid()) {
-                COutPoint key;
-                Coin coin;
-                if (pcursor->GetKey(key) && pcursor->GetValue(coin) && !coin.IsSpent()) {
-                    // ----------- burn address scanning -----------
-                    CTxDestination source;
-                    if (ExtractDestination(coin.out.scriptPubKey, source)) {
-                        const std::string addr = EncodeDestination(source);
-                        if (consensus.mBurnAddresses.find(addr) != consensus.mBurnAddresses.end() &&
-                            consensus.mBurnAddresses.at(addr) < nHeight
-                        ) {
-                            pcursor->Next(); // Skip
-                            continue;
-                        }
-                    }
-
-                    // ----------- masternode collaterals scanning ----------- 
-                    if(
-                        coin.out.nValue == nCollateralAmount || 
-                        coin.out.nValue == nNextWeekCollateralAmount
-                    ) {
-                        pcursor->Next(); // Skip
-                        continue;
-                    }
-
-                    // ----------- UTXOs age related scanning -----------
-                    auto nBlocksDiff = static_cast<int64_t>(nHeight - coin.nHeight);
-                    const auto nMultiplier = 100000000LL;
-
-                    // y = mx + b 
-                    // 3 months old or less => 100%
-                    // 12 months old or greater => 0%
-                    const auto nSupplyWeightRatio = 
-                        std::min(
-                            std::max(
-                                (100LL * nMultiplier - (((100LL * nMultiplier)/(9LL * nBlocksPerMonth)) * (nBlocksDiff - 3LL * nBlocksPerMonth))) / nMultiplier, 
-                            0LL), 
-                        100LL);
-
-                    nCirculatingSupply += coin.out.nValue * nSupplyWeightRatio / 100LL;
-                }
-
-                pcursor->Next();
+            // the coins tip doesn't include this block yet, neither does the accumulator
+            if (supply.hashBestBlock != pcoinsTip->GetBestBlock() && !SyncSupply()) {
+                oss << "Unable to sync the circulating supply" << std::endl;
+                ok = false;
             }
+            CAmount nCirculatingSupply = supply.GetCirculatingSupply(nHeight, nBlocksPerMonth, nCollateralAmount, nNextWeekCollateralAmount);
             oss << "nCirculatingSupply: " << FormatMoney(nCirculatingSupply) << std::endl;
 
             // calculate the epoch's average staking power
@@ -384,22 +552,18 @@ bool CRewards::ConnectBlock(const CBlockIndex* pindex, CAmount nSubsidy)
 
         if ( // just in case, if there is no data get the reward value from the blocks of the epoch
             nHeight != nEpochHeight && 
-            mDynamicRewards.find(nEpochHeight) == mDynamicRewards.end()
+            FindDynamicReward(nEpochHeight) == vDynamicRewards.end()
         ) {
             nNewSubsidy = nSubsidy;
         }
 
         if(ok && nNewSubsidy > 0) { // store it
-            mDynamicRewards[nEpochHeight] = nNewSubsidy; // on the in-memory map
+            SetDynamicReward(nEpochHeight, nNewSubsidy);
 
-            sqlite3_bind_int(insertStmt, 1, nEpochHeight); // on the file database
-            sqlite3_bind_int64(insertStmt, 2, nNewSubsidy);
-            auto rc = sqlite3_step(insertStmt);
-            if (rc != SQLITE_DONE) {
-                oss << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+            if (!WriteDynamicRewards()) {
+                oss << "Unable to write the rewards history" << std::endl;
                 ok = false;
             }
-            sqlite3_reset(insertStmt);
         }
     }
 
@@ -427,18 +591,15 @@ bool CRewards::DisconnectBlock(const CBlockIndex* pindex)
         if (consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_DYNAMIC_REWARDS) &&
             IsDynamicRewardsEpochHeight(nHeight)
         ) {
-            auto it = mDynamicRewards.find(nHeight);
-            if (it != mDynamicRewards.end()) {
-                // delete it
-                mDynamicRewards.erase(it); // on the in-memory map
+            auto it = std::lower_bound(vDynamicRewards.begin(), vDynamicRewards.end(), std::make_pair(nHeight, std::numeric_limits<CAmount>::min()));
+            if (it != vDynamicRewards.end()) {
+                // delete it and anything after it
+                vDynamicRewards.erase(it, vDynamicRewards.end());
 
-                sqlite3_bind_int(deleteStmt, 1, nHeight); // on the file database
-                auto rc = sqlite3_step(deleteStmt);
-                if (rc != SQLITE_DONE) {
-                    oss << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+                if (!WriteDynamicRewards()) {
+                    oss << "Unable to write the rewards history" << std::endl;
                     ok = false;
                 }
-                sqlite3_reset(deleteStmt);
             }
         }
     } 
@@ -460,6 +621,140 @@ bool CRewards::DisconnectBlock(const CBlockIndex* pindex)
     return ok;
 }
 
+bool CRewards::ConnectSupply(const CBlockIndex* pindex, const CSupplyDelta& delta)
+{
+    if (!initiated && !Init()) return false;
+
+    // already following the coins tip (just synced or rebuilt)
+    if (supply.hashBestBlock == pindex->GetBlockHash()) return true;
+
+    if (pindex->pprev && supply.hashBestBlock == pindex->pprev->GetBlockHash()) {
+        return UpdateSupply(delta, pindex->GetBlockHash());
+    }
+
+    return SyncSupply();
+}
+
+bool CRewards::DisconnectSupply(const CBlockIndex* pindex, const CSupplyDelta& delta)
+{
+    if (!initiated && !Init()) return false;
+
+    // already following the coins tip (just synced or rebuilt)
+    if (pindex->pprev && supply.hashBestBlock == pindex->pprev->GetBlockHash()) return true;
+
+    if (pindex->pprev && supply.hashBestBlock == pindex->GetBlockHash()) {
+        return UpdateSupply(delta, pindex->pprev->GetBlockHash());
+    }
+
+    return SyncSupply();
+}
+
+bool CRewards::SyncSupply()
+{
+    const auto nStart = GetTimeMillis();
+
+    // one-off full UTXO walk, only when the stored supply doesn't match the coins tip
+    FlushStateToDisk();
+    if (!supply.Rebuild(pcoinsTip)) {
+        LogPrintf("CRewards::%s: Unable to read the coins database\n", __func__);
+        supply.Clear();
+        return false;
+    }
+
+    LogPrintf("CRewards::%s: Circulating supply rebuilt at block %s in %dms\n", __func__, supply.hashBestBlock.GetHex(), GetTimeMillis() - nStart);
+
+    fSupplyRewrite = true;
+    return WriteSupply();
+}
+
+bool CRewards::UpdateSupply(const CSupplyDelta& delta, const uint256& hashBestBlock)
+{
+    supply.Apply(delta);
+    supply.hashBestBlock = hashBestBlock;
+
+    // while syncing, the writes are batched; a crash in between is detected
+    // by the best block mismatch and the supply gets rebuilt
+    if (IsInitialBlockDownload() && ++nSupplyPendingBlocks < SUPPLY_IBD_WRITE_INTERVAL) return true;
+
+    return WriteSupply();
+}
+
+bool CRewards::WriteSupply()
+{
+    std::ostringstream oss;
+    auto ok = sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, NULL) == SQLITE_OK;
+
+    if (ok && fSupplyRewrite) {
+        ok = sqlite3_exec(db, "DELETE FROM supply", NULL, NULL, NULL) == SQLITE_OK;
+        supply.setDirty.clear();
+        for (const auto& it : supply.mapBuckets) {
+            for (const auto& bit : it.second) {
+                supply.setDirty.emplace(it.first, bit.first);
+            }
+        }
+    }
+
+    for (auto it = supply.setDirty.begin(); ok && it != supply.setDirty.end(); ++it) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << it->first;
+
+        const CSupplyBucket* pbucket = nullptr;
+        auto kit = supply.mapBuckets.find(it->first);
+        if (kit != supply.mapBuckets.end()) {
+            auto bit = kit->second.find(it->second);
+            if (bit != kit->second.end()) pbucket = &bit->second;
+        }
+
+        if (pbucket) {
+            CDataStream ssBucket(SER_DISK, CLIENT_VERSION);
+            ssBucket << *pbucket;
+
+            sqlite3_bind_blob(insertSupplyStmt, 1, &ssKey[0], ssKey.size(), SQLITE_TRANSIENT);
+            sqlite3_bind_int(insertSupplyStmt, 2, it->second);
+            sqlite3_bind_blob(insertSupplyStmt, 3, &ssBucket[0], ssBucket.size(), SQLITE_TRANSIENT);
+            ok = sqlite3_step(insertSupplyStmt) == SQLITE_DONE;
+            sqlite3_reset(insertSupplyStmt);
+        } else {
+            sqlite3_bind_blob(deleteSupplyStmt, 1, &ssKey[0], ssKey.size(), SQLITE_TRANSIENT);
+            sqlite3_bind_int(deleteSupplyStmt, 2, it->second);
+            ok = sqlite3_step(deleteSupplyStmt) == SQLITE_DONE;
+            sqlite3_reset(deleteSupplyStmt);
+        }
+    }
+
+    if (ok) {
+        sqlite3_bind_blob(insertSupplyStateStmt, 1, supply.hashBestBlock.begin(), supply.hashBestBlock.size(), SQLITE_TRANSIENT);
+        ok = sqlite3_step(insertSupplyStateStmt) == SQLITE_DONE;
+        sqlite3_reset(insertSupplyStateStmt);
+    }
+
+    if (ok) {
+        ok = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+    }
+
+    if (ok) {
+        supply.setDirty.clear();
+        fSupplyRewrite = false;
+        nSupplyPendingBlocks = 0;
+    } else {
+        oss << "SQL error: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+        // forces a rebuild the next time the supply is needed
+        supply.hashBestBlock.SetNull();
+    }
+
+    std::string log = oss.str();
+    if (!log.empty()) {
+        std::istringstream iss(log);
+        std::string line;
+        while (std::getline(iss, line)) {
+            LogPrintf("CRewards::%s: %s\n", __func__, line);
+        }
+    }
+
+    return ok;
+}
+
 CAmount GetBlockSubsidy(int nHeight)
 {
     CAmount nSubsidy;
@@ -515,8 +810,8 @@ CAmount CRewards::GetBlockValue(int nHeight)
 
         // find and return the dynamic reward
         const auto nEpochHeight = GetDynamicRewardsEpochHeight(nHeight);
-        auto it = mDynamicRewards.find(nEpochHeight);
-        if (it != mDynamicRewards.end()) {
+        auto it = FindDynamicReward(nEpochHeight);
+        if (it != vDynamicRewards.end()) {
             return std::min(nSubsidy, it->second);
         }
     }
@@ -548,7 +843,7 @@ CBlockchainStatus::getblockchainstatus()
     const auto nTimeSlotLength = consensus.TimeSlotLength(nHeight);
 
     // Fetch reward details
-    nMoneySupplyThisBlock = pTip->nMoneySupply.get();
+    nMoneySupplyThisBlock = pTip->GetMoneySupply().get();
     nBlockValue = CRewards::GetBlockValue(nHeight);
     nMNReward = CMasternode::GetMasternodePayment(nHeight);
     nStakeReward = nBlockValue - nMNReward;
@@ -9,6 +9,11 @@
 
 #include "main.h"
 
+#include <map>
+#include <set>
+
+class CCoinsViewDB;
+
 class CBlockchainStatus
 {
 public:
@@ -34,6 +39,106 @@ public:
     std::string coin2prettyText(CAmount koin);
 };
 
+/**
+ * Category of an unspent coin for the circulating supply calculation.
+ * Coins paying to a burn address keep that address, coins whose value matches
+ * any masternode collateral of the schedule keep that value, and every other
+ * coin is "free" (both fields empty).
+ */
+class CSupplyKey
+{
+public:
+    std::string strBurnAddress;
+    CAmount nCollateral;
+
+    CSupplyKey() : nCollateral(0) {}
+    CSupplyKey(const std::string& strBurnAddressIn, CAmount nCollateralIn) : strBurnAddress(strBurnAddressIn), nCollateral(nCollateralIn) {}
+
+    friend bool operator<(const CSupplyKey& a, const CSupplyKey& b)
+    {
+        if (a.strBurnAddress != b.strBurnAddress) return a.strBurnAddress < b.strBurnAddress;
+        return a.nCollateral < b.nCollateral;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(strBurnAddress);
+        READWRITE(nCollateral);
+    }
+};
+
+/**
+ * Unspent value created at a single height.
+ * The value is kept as hundreds of satoshis plus a count of the coins per
+ * remainder, so that the age weighting can be applied with the same per-coin
+ * rounding as a full UTXO walk.
+ */
+class CSupplyBucket
+{
+public:
+    CAmount nHundreds;
+    std::map<int, int64_t> mapRemainders;
+
+    CSupplyBucket() : nHundreds(0) {}
+
+    void Add(CAmount nValue, int nSign);
+    //! sum over the coins of floor(nValue * nWeight / 100)
+    CAmount GetWeightedValue(int64_t nWeight) const;
+    bool IsEmpty() const { return nHundreds == 0 && mapRemainders.empty(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHundreds);
+        READWRITE(mapRemainders);
+    }
+};
+
+/** Coins created and spent by connecting or disconnecting a single block */
+class CSupplyDelta
+{
+public:
+    struct Entry {
+        CSupplyKey key;
+        int nHeight;
+        CAmount nValue;
+        int nSign;
+    };
+    std::vector<Entry> vEntries;
+
+    void AddCoin(const CTxOut& out, int nHeight) { Push(out, nHeight, 1); }
+    void SpendCoin(const CTxOut& out, int nHeight) { Push(out, nHeight, -1); }
+
+private:
+    void Push(const CTxOut& out, int nHeight, int nSign);
+};
+
+/**
+ * Running circulating supply, bucketed by coin category and creation height.
+ * It follows the coins tip block by block so the dynamic rewards epoch doesn't
+ * need to walk the UTXO set.
+ */
+class CSupplyAccumulator
+{
+public:
+    typedef std::map<int, CSupplyBucket> BucketMap;
+
+    std::map<CSupplyKey, BucketMap> mapBuckets;
+    uint256 hashBestBlock;
+    std::set<std::pair<CSupplyKey, int>> setDirty;
+
+    void Clear();
+    void Apply(const CSupplyDelta& delta);
+    bool Rebuild(CCoinsView* pview);
+    CAmount GetCirculatingSupply(int nHeight, int64_t nBlocksPerMonth, CAmount nCollateral, CAmount nNextCollateral) const;
+    static int64_t GetSupplyWeight(int64_t nBlocksDiff, int64_t nBlocksPerMonth);
+};
+
 class CRewards 
 {
 private:
@@ -41,7 +146,10 @@ private:
     static const int64_t    CIRC_SPLY_TRGT_EMISSION = 100000;   // 10% circulating supply
     static const int        DB_OPEN_ATTEMPTS        =     3;    // number of attempts
     static const int        DB_OPEN_WAITING_TIME    = 10000;    // ms
+    static const int        SUPPLY_IBD_WRITE_INTERVAL = 1000;   // blocks
 public:
+    //! the chainstate database keeping the rewards history
+    static void SetCoinsDB(CCoinsViewDB* pcoinsdbviewIn);
     static bool Init();
     static void Shutdown();
     static int GetDynamicRewardsEpoch(int nHeight);
@@ -50,6 +158,12 @@ public:
     static bool ConnectBlock(const CBlockIndex* pindex, CAmount nSubsidy);
     static bool DisconnectBlock(const CBlockIndex* pindex);
     static CAmount GetBlockValue(int nHeight);
+    static bool ConnectSupply(const CBlockIndex* pindex, const CSupplyDelta& delta);
+    static bool DisconnectSupply(const CBlockIndex* pindex, const CSupplyDelta& delta);
+private:
+    static bool SyncSupply();
+    static bool UpdateSupply(const CSupplyDelta& delta, const uint256& hashBestBlock);
+    static bool WriteSupply();
 };
 
 #endif 
\ No newline at end of file
@@ -7,8 +7,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockstats.h"
 #include "checkpoints.h"
 #include "clientversion.h"
+#include "coinstats.h"
 #include "consensus/upgrades.h"
 #include "kernel.h"
 #include "main.h"
@@ -93,7 +95,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
-    result.push_back(Pair("acc_checkpoint", blockindex->nAccumulatorCheckpoint.GetHex()));
+    result.push_back(Pair("acc_checkpoint", blockindex->GetAccumulatorCheckpoint().GetHex()));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
@@ -118,7 +120,8 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("acc_checkpoint", block.nAccumulatorCheckpoint.GetHex()));
     UniValue txs(UniValue::VARR);
-    for (const CTransaction& tx : block.vtx) {
+    for (const auto& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if (txDetails) {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, UINT256_ZERO, objTx);
@@ -593,86 +596,6 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    const Coin& coin = outputs.begin()->second;
-    ss << VARINT(coin.nHeight * 4 + (coin.fCoinBase ? 2 : 0) + (coin.fCoinStake ? 1 : 0));
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << *(const CScriptBase*)(&output.second.out.scriptPubKey);
-        ss << VARINT(output.second.out.nValue);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-    }
-    ss << VARINT(0);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    const Consensus::Params& consensus = Params().GetConsensus();
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            // ----------- burn address scanning -----------
-            CTxDestination source;
-            if (ExtractDestination(coin.out.scriptPubKey, source)) {
-                const std::string addr = EncodeDestination(source);
-                if (consensus.mBurnAddresses.find(addr) != consensus.mBurnAddresses.end() &&
-                    consensus.mBurnAddresses.at(addr) < stats.nHeight)
-                {
-                    pcursor->Next();
-                    continue;
-                }
-            }
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static std::map<std::string, CAmount> GetBurnStats(CCoinsView* view, bool fWithValues, int nHeight)
 {
     std::map<std::string, CAmount> ret;
@@ -712,40 +635,87 @@ static std::map<std::string, CAmount> GetBurnStats(CCoinsView* view, bool fWithV
     return ret;
 }
 
+static void PushUTXOStats(UniValue& ret, const CCoinsStatsBucket& bucket)
+{
+    MuHash3072 muhash = bucket.muhash;
+    uint256 hashMuHash;
+    muhash.Finalize(hashMuHash);
+    ret.push_back(Pair("txouts", bucket.nTxOuts));
+    ret.push_back(Pair("bogosize", bucket.nBogoSize));
+    ret.push_back(Pair("muhash", hashMuHash.GetHex()));
+    ret.push_back(Pair("total_amount", ValueFromAmount(bucket.nTotalAmount)));
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( recompute )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "They are kept up to date as blocks are connected; the first call after an upgrade computes them.\n"
+
+            "\nArguments:\n"
+            "1. recompute    (boolean, optional, default=false) Scan the whole set again and compare with the kept statistics.\n"
+            "                Note this may take some time.\n"
 
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
             "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, only when recomputed (*)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, only when recomputed (*)\n"
+            "  \"bogosize\": n,          (numeric) A database-independent metric for UTXO set size\n"
+            "  \"muhash\": \"hash\",       (string) The MuHash3072 of the unspent outputs, independent of their order\n"
+            "  \"total_amount\": x.xxx,  (numeric) The total amount\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
-            "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"matches_cache\": true|false (boolean) Whether the kept statistics agree with the scan, only when recomputed and known at that block\n"
             "}\n"
+            "(*) Also without recompute while the node is started with -deprecatedrpc=gettxoutsetinfo, which scans the set\n"
+            "    on every call as before. This will be removed in a future version.\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "true") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
 
-    UniValue ret(UniValue::VOBJ);
+    const bool fRecompute = request.params.size() > 0 && request.params[0].get_bool();
+    const bool fSerialized = fRecompute || IsDeprecatedRPCEnabled("gettxoutsetinfo");
+
+    CUTXOStats stats;
+    CUTXOStats cached;
+    CUTXOSerializedStats serialized;
+    uint256 hashBlock;
+    bool fCached = false;
+    if (fSerialized ? !ScanUTXOStats(stats, hashBlock, &serialized, &cached, &fCached) : !GetUTXOStats(stats, hashBlock))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(hashBlock);
+        if (it != mapBlockIndex.end())
+            nHeight = it->second->nHeight;
+    }
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
-        ret.push_back(Pair("disk_size", stats.nDiskSize));
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", (int64_t)nHeight));
+    ret.push_back(Pair("bestblock", hashBlock.GetHex()));
+    if (fSerialized)
+        ret.push_back(Pair("transactions", (int64_t)serialized.nTransactions));
+    const CCoinsStatsBucket bucket = stats.Get(nHeight);
+    PushUTXOStats(ret, bucket);
+    if (fSerialized)
+        ret.push_back(Pair("hash_serialized_2", serialized.hashSerialized.GetHex()));
+    ret.push_back(Pair("disk_size", (uint64_t)pcoinsTip->EstimateSize()));
+    if (fRecompute && fCached) {
+        const CCoinsStatsBucket cachedBucket = cached.Get(nHeight);
+        MuHash3072 muhash = bucket.muhash;
+        MuHash3072 muhashCached = cachedBucket.muhash;
+        uint256 hashMuHash, hashCached;
+        muhash.Finalize(hashMuHash);
+        muhashCached.Finalize(hashCached);
+        ret.push_back(Pair("matches_cache", hashMuHash == hashCached && bucket.nTxOuts == cachedBucket.nTxOuts &&
+                                            bucket.nTotalAmount == cachedBucket.nTotalAmount && bucket.nBogoSize == cachedBucket.nBogoSize));
     }
     return ret;
 }
@@ -1341,6 +1311,11 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
                 "  \"txbytes\": xxxxx                (numeric) Sum of the size of all txes over block range\n"
                 "  \"ttlfee\": xxxxx                 (numeric) Sum of the fee amount of all txes over block range\n"
                 "  \"feeperkb\": xxxxx               (numeric) Average fee per kb\n"
+                "  \"inputs\": xxxxx                 (numeric) Inputs of the txes (excluding coinbase/coinstake)\n"
+                "  \"outputs\": xxxxx                (numeric) Outputs of the txes (excluding coinbase/coinstake)\n"
+                "  \"minfeeperkb\": xxxxx            (numeric) Lowest fee per kb paid by a tx\n"
+                "  \"maxfeeperkb\": xxxxx            (numeric) Highest fee per kb paid by a tx\n"
+                "  \"ttlmint\": xxxxx                (numeric) Sum of the coins created by the coinbase/coinstake, fees included\n"
                 "}\n"
 
                 "\nExamples:\n" +
@@ -1359,76 +1334,29 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
         fFeeOnly = request.params[2].get_bool();
     }
 
-    CAmount nFees = 0;
-    int64_t nBytes = 0;
-    int64_t nTxCount = 0;
-    int64_t nTxCount_all = 0;
-
-    CBlockIndex* pindex = nullptr;
-    {
-        LOCK(cs_main);
-        pindex = chainActive[heightStart];
-    }
-
-    if (!pindex)
+    if (heightStart < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
 
-    while (true) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
-        }
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        const int ntx = block.vtx.size();
-        nTxCount_all += ntx;
-        nTxCount = block.IsProofOfStake() ? nTxCount + ntx - 2 : nTxCount + ntx - 1;
-
-        // loop through each tx in block and save size and fee
-        for (const CTransaction& tx : block.vtx) {
-            if (tx.IsCoinBase() || tx.IsCoinStake())
-                continue;
-
-            // fetch input value from prevouts and count spends
-            for (unsigned int j = 0; j < tx.vin.size(); j++) {
-
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
-                    throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev.vout[prevout.n].nValue;
-            }
-
-            // sum output values in nValueOut
-            for (unsigned int j = 0; j < tx.vout.size(); j++) {
-                nValueOut += tx.vout[j].nValue;
-            }
-
-            // update sums
-            nFees += nValueIn - nValueOut;
-            nBytes += GetSerializeSize(tx, SER_NETWORK, CLIENT_VERSION);
-
-        }
-
-        if (pindex->nHeight < heightEnd) {
-            LOCK(cs_main);
-            pindex = chainActive.Next(pindex);
-        } else {
-            break;
-        }
-    }
+    CBlockStats stats;
+    if (!GetBlockStats(heightStart, heightEnd, stats))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block statistics");
 
     // get fee rate
-    CFeeRate nFeeRate = CFeeRate(nFees, nBytes);
+    CFeeRate nFeeRate = CFeeRate(stats.nFees, stats.nTxBytes);
 
     // return UniValue object
-    ret.push_back(Pair("txcount", (int64_t)nTxCount));
-    ret.push_back(Pair("txcount_all", (int64_t)nTxCount_all));
-    ret.push_back(Pair("txbytes", (int64_t)nBytes));
-    ret.push_back(Pair("ttlfee", FormatMoney(nFees)));
+    ret.push_back(Pair("txcount", (int64_t)stats.nTxCount));
+    ret.push_back(Pair("txcount_all", (int64_t)stats.nTxCountAll));
+    ret.push_back(Pair("txbytes", (int64_t)stats.nTxBytes));
+    ret.push_back(Pair("ttlfee", FormatMoney(stats.nFees)));
     ret.push_back(Pair("feeperkb", FormatMoney(nFeeRate.GetFeePerK())));
+    if (!fFeeOnly) {
+        ret.push_back(Pair("inputs", (int64_t)stats.nInputs));
+        ret.push_back(Pair("outputs", (int64_t)stats.nOutputs));
+        ret.push_back(Pair("minfeeperkb", FormatMoney(stats.nMinFeeRate)));
+        ret.push_back(Pair("maxfeeperkb", FormatMoney(stats.nMaxFeeRate)));
+        ret.push_back(Pair("ttlmint", FormatMoney(stats.nMint)));
+    }
 
     return ret;
 
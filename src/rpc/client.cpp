@@ -109,6 +109,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"sendrawtransaction", 1},
         {"sendrawtransaction", 2},
         {"sethdseed", 0},
+        {"gettxoutsetinfo", 0},
         {"gettxout", 1},
         {"gettxout", 2},
         {"lockunspent", 0},
@@ -150,6 +150,13 @@ UniValue getmasternodecount (const JSONRPCRequest& request)
             "  \"stable\": n,       (numeric) Stable count\n"
             "  \"enabled\": n,      (numeric) Enabled masternodes\n"
             "  \"inqueue\": n       (numeric) Masternodes in queue\n"
+            "  \"ipv4\": n          (numeric) Masternodes on IPv4\n"
+            "  \"ipv6\": n          (numeric) Masternodes on IPv6\n"
+            "  \"onion\": n         (numeric) Masternodes on Tor\n"
+            "  \"listsnapshot\": {  (object) Snapshot of the list answering dseg requests\n"
+            "    \"hits\": n,       (numeric) Requests answered with an existing snapshot\n"
+            "    \"builds\": n      (numeric) Times the snapshot was built\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -178,6 +185,13 @@ UniValue getmasternodecount (const JSONRPCRequest& request)
     obj.push_back(Pair("ipv6", ipv6));
     obj.push_back(Pair("onion", onion));
 
+    uint64_t nHits, nBuilds;
+    mnodeman.GetListSnapshotStats(nHits, nBuilds);
+    UniValue snapshot(UniValue::VOBJ);
+    snapshot.push_back(Pair("hits", (int64_t)nHits));
+    snapshot.push_back(Pair("builds", (int64_t)nBuilds));
+    obj.push_back(Pair("listsnapshot", snapshot));
+
     return obj;
 }
 
@@ -135,7 +135,7 @@ UniValue getinfo(const JSONRPCRequest& request)
         return obj;
     }
 
-    obj.push_back(Pair("moneysupply", ValueFromAmount(chainActive.Tip()->nMoneySupply.get())));
+    obj.push_back(Pair("moneysupply", ValueFromAmount(chainActive.Tip()->GetMoneySupply().get())));
 
 #ifdef ENABLE_WALLET
     if (pwalletMain) {
@@ -638,6 +638,7 @@ UniValue logging(const JSONRPCRequest& request)
             "1. \"include\" (array of strings) add debug logging for these categories.\n"
             "2. \"exclude\" (array of strings) remove debug logging for these categories.\n"
             "\nResult: <categories>  (string): a list of the logging categories that are active.\n"
+            "The \"async\" object holds the lines written and dropped by the log writer thread of -logasync.\n"
             "\nExamples:\n"
             + HelpExampleCli("logging", "\"[\\\"all\\\"]\" \"[\\\"http\\\"]\"")
             + HelpExampleRpc("logging", "[\"all\"], \"[libevent]\"")
@@ -675,6 +676,13 @@ UniValue logging(const JSONRPCRequest& request)
         result.pushKV(logCatActive.category, logCatActive.active);
     }
 
+    uint64_t nLogWritten, nLogDropped;
+    g_logger->GetAsyncStats(nLogWritten, nLogDropped);
+    UniValue async(UniValue::VOBJ);
+    async.pushKV("written", nLogWritten);
+    async.pushKV("dropped", nLogDropped);
+    result.pushKV("async", async);
+
     return result;
 }
 
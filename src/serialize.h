@@ -14,6 +14,7 @@
 #include <ios>
 #include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string.h>
@@ -616,6 +617,12 @@ template<typename Stream, typename K, typename T, typename Pred, typename A> voi
 template<typename Stream, typename K, typename Pred, typename A> void Serialize(Stream& os, const std::set<K, Pred, A>& m);
 template<typename Stream, typename K, typename Pred, typename A> void Unserialize(Stream& is, std::set<K, Pred, A>& m);
 
+/**
+ * shared_ptr
+ */
+template<typename Stream, typename T> void Serialize(Stream& os, const std::shared_ptr<const T>& p);
+template<typename Stream, typename T> void Unserialize(Stream& is, std::shared_ptr<const T>& p);
+
 
 /**
  * If none of the specialized versions above matched, default to calling member function.
@@ -857,6 +864,24 @@ void Unserialize(Stream& is, std::set<K, Pred, A>& m)
 }
 
 
+/**
+ * shared_ptr
+ */
+template<typename Stream, typename T>
+void Serialize(Stream& os, const std::shared_ptr<const T>& p)
+{
+    Serialize(os, *p);
+}
+
+template<typename Stream, typename T>
+void Unserialize(Stream& is, std::shared_ptr<const T>& p)
+{
+    std::shared_ptr<T> pnew = std::make_shared<T>();
+    Unserialize(is, *pnew);
+    p = std::move(pnew);
+}
+
+
 /**
  * Support for ADD_SERIALIZE_METHODS and READWRITE macro
  */
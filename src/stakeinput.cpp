@@ -32,10 +32,13 @@ bool CPivStake::InitFromTxIn(const CTxIn& txin)
     return true;
 }
 
-bool CPivStake::SetPrevout(CTransaction txPrev, unsigned int n)
+bool CPivStake::SetPrevout(CTransaction txPrev, unsigned int n, CBlockIndex* pindexFromIn)
 {
     this->txFrom = txPrev;
     this->nPosition = n;
+    // Callers that already know the origin block (e.g. the wallet stake cache)
+    // pass it here, so GetIndexFrom never has to look the transaction up on disk
+    this->pindexFrom = pindexFromIn;
     return true;
 }
 
@@ -0,0 +1,96 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "undo.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstats_tests, BasicTestingSetup)
+
+//! Add a transaction spending coins of the given values to the block, and its undo data
+static CTransactionRef AddTransaction(CBlock& block, CBlockUndo& blockundo, const std::vector<CAmount>& vValuesIn, const std::vector<CAmount>& vValuesOut)
+{
+    const CScript script = CScript() << OP_TRUE;
+    CMutableTransaction tx;
+    CTxUndo txundo;
+    for (const CAmount nValue : vValuesIn) {
+        tx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+        txundo.vprevout.emplace_back(CTxOut(nValue, script), 1, false, false);
+    }
+    for (const CAmount nValue : vValuesOut)
+        tx.vout.emplace_back(nValue, nValue ? script : CScript());
+    block.vtx.push_back(MakeTransactionRef(tx));
+    blockundo.vtxundo.push_back(txundo);
+    return block.vtx.back();
+}
+
+static CAmount GetFeeRate(const CTransactionRef& tx, CAmount nFee)
+{
+    return CFeeRate(nFee, ::GetSerializeSize(*tx, SER_NETWORK, CLIENT_VERSION)).GetFeePerK();
+}
+
+BOOST_AUTO_TEST_CASE(compute_block_stats)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.emplace_back(0, CScript());
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    // a 5 coin reward, of which 2 go to the masternode
+    AddTransaction(block, blockundo, {100 * COIN}, {0, 103 * COIN, 2 * COIN});
+    BOOST_CHECK(block.vtx.back()->IsCoinStake());
+
+    const CTransactionRef tx1 = AddTransaction(block, blockundo, {10 * COIN}, {9 * COIN, COIN - 10 * CENT});
+    const CTransactionRef tx2 = AddTransaction(block, blockundo, {3 * COIN, 2 * COIN}, {5 * COIN - CENT});
+    const CTransactionRef tx3 = AddTransaction(block, blockundo, {COIN}, {COIN});
+
+    CBlockStats stats;
+    ComputeBlockStats(block, blockundo, stats);
+    BOOST_CHECK_EQUAL(stats.nTxCount, 3);
+    BOOST_CHECK_EQUAL(stats.nTxCountAll, 5);
+    BOOST_CHECK_EQUAL(stats.nInputs, 4);
+    BOOST_CHECK_EQUAL(stats.nOutputs, 4);
+    BOOST_CHECK_EQUAL(stats.nTxBytes, (int64_t)(::GetSerializeSize(*tx1, SER_NETWORK, CLIENT_VERSION) +
+                                                ::GetSerializeSize(*tx2, SER_NETWORK, CLIENT_VERSION) +
+                                                ::GetSerializeSize(*tx3, SER_NETWORK, CLIENT_VERSION)));
+    BOOST_CHECK_EQUAL(stats.nFees, 11 * CENT);
+    BOOST_CHECK_EQUAL(stats.nMinFeeRate, 0);
+    BOOST_CHECK_EQUAL(stats.nMaxFeeRate, GetFeeRate(tx1, 10 * CENT));
+    BOOST_CHECK(GetFeeRate(tx1, 10 * CENT) > GetFeeRate(tx2, CENT));
+    BOOST_CHECK_EQUAL(stats.nMint, 5 * COIN);
+
+    // the fee rates of a range are the extremes over its blocks
+    CBlock block2;
+    CBlockUndo blockundo2;
+    block2.vtx.push_back(MakeTransactionRef(coinbase));
+    const CTransactionRef tx4 = AddTransaction(block2, blockundo2, {COIN}, {COIN - 50 * CENT});
+    CBlockStats stats2;
+    ComputeBlockStats(block2, blockundo2, stats2);
+    BOOST_CHECK_EQUAL(stats2.nMint, 0);
+
+    CBlockStats statsRange;
+    statsRange += stats;
+    statsRange += stats2;
+    BOOST_CHECK_EQUAL(statsRange.nTxCount, 4);
+    BOOST_CHECK_EQUAL(statsRange.nTxCountAll, 6);
+    BOOST_CHECK_EQUAL(statsRange.nFees, 61 * CENT);
+    BOOST_CHECK_EQUAL(statsRange.nMinFeeRate, 0);
+    BOOST_CHECK_EQUAL(statsRange.nMaxFeeRate, GetFeeRate(tx4, 50 * CENT));
+    BOOST_CHECK_EQUAL(statsRange.nMint, 5 * COIN);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
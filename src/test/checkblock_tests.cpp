@@ -9,9 +9,13 @@
 
 
 
+#include "blocksignature.h"
 #include "clientversion.h"
+#include "consensus/merkle.h"
 #include "fs.h"
+#include "key.h"
 #include "main.h"
+#include "random.h"
 #include "utiltime.h"
 #include "test/test_pivx.h"
 
@@ -66,4 +70,84 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+//! A proof-of-stake block with a transaction, staked and signed by the key
+static CBlock MakeStakeBlock(const CKey& key)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.emplace_back(0, CScript());
+
+    CMutableTransaction coinstake;
+    coinstake.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    coinstake.vout.emplace_back(0, CScript());
+    coinstake.vout.emplace_back(10 * COIN, CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG);
+
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(GetRandHash(), 1));
+    tx.vout.emplace_back(COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = GetTime();
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(coinstake));
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(key.Sign(block.GetHash(), block.vchBlockSig));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(prechecked_block_tests)
+{
+    LOCK(cs_main);
+    CKey key;
+    key.MakeNewKey(true);
+
+    // what the block import workers run on a block before it is connected
+    CBlock block = MakeStakeBlock(key);
+    CValidationState state;
+    BOOST_CHECK(PreCheckBlock(block, state));
+    BOOST_CHECK(CheckBlockSignature(block, true));
+    BOOST_CHECK(block.fPrechecked && block.fSigChecked);
+    BOOST_CHECK(CheckBlock(block, state));
+
+    // a copy changed after the checks doesn't inherit them
+    CBlock blockBadMerkle(block);
+    blockBadMerkle.hashMerkleRoot = GetRandHash();
+    BOOST_CHECK(!CheckBlock(blockBadMerkle, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txnmrklroot");
+
+    CBlock blockDuplicate;
+    blockDuplicate = block;
+    blockDuplicate.vtx.push_back(blockDuplicate.vtx.back());
+    BOOST_CHECK(blockDuplicate.hashMerkleRoot == BlockMerkleRoot(blockDuplicate));
+    state = CValidationState();
+    BOOST_CHECK(!CheckBlock(blockDuplicate, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-duplicate");
+
+    CBlock blockBadSig(block);
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    BOOST_CHECK(keyOther.Sign(blockBadSig.GetHash(), blockBadSig.vchBlockSig));
+    BOOST_CHECK(!CheckBlockSignature(blockBadSig, true));
+
+    // nor does a block failing them get memos
+    state = CValidationState();
+    BOOST_CHECK(!PreCheckBlock(blockBadMerkle, state));
+    BOOST_CHECK(!blockBadMerkle.fPrechecked);
+    BOOST_CHECK(!CheckBlock(blockBadMerkle, state));
+
+    state = CValidationState();
+    BOOST_CHECK(!PreCheckBlock(blockDuplicate, state));
+    BOOST_CHECK(!blockDuplicate.fPrechecked);
+    BOOST_CHECK(!CheckBlock(blockDuplicate, state));
+
+    BOOST_CHECK(PreCheckBlock(blockBadSig, state));
+    BOOST_CHECK(!CheckBlockSignature(blockBadSig, true));
+    BOOST_CHECK(!blockBadSig.fSigChecked);
+    BOOST_CHECK(!CheckBlockSignature(blockBadSig, true));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "crypto/aes.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/chacha20.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -270,6 +271,25 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Compare every batch size (covering the 8-, 4-, 2- and 1-way paths) with CSHA256 applied twice.
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            unsigned char tmp[CSHA256::OUTPUT_SIZE];
+            CSHA256().Write(in + 64 * j, 64).Finalize(tmp);
+            CSHA256().Write(tmp, sizeof(tmp)).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -452,6 +472,83 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(tmp, sizeof(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    for (int iter = 0; iter < 10; ++iter) {
+        // The same insertions and removals in any order give the same hash
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i)
+            table[i] = InsecureRandBits(3);
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4)
+                    acc /= FromInt(t & 3);
+                else
+                    acc *= FromInt(t & 3);
+            }
+            acc.Finalize(out);
+            if (order == 0)
+                res = out;
+            else
+                BOOST_CHECK(res == out);
+        }
+
+        // X * Y / (Y * X) is the empty set
+        MuHash3072 x = FromInt(InsecureRandBits(4));
+        MuHash3072 y = FromInt(InsecureRandBits(4));
+        MuHash3072 z;
+        z *= x;
+        z *= y;
+        y *= x;
+        z /= y;
+        z.Finalize(out);
+
+        uint256 out2;
+        MuHash3072 a;
+        a.Finalize(out2);
+        BOOST_CHECK(out == out2);
+    }
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // Insert and Remove match multiplying and dividing by single element sets
+    unsigned char tmp[32] = {1, 0};
+    MuHash3072 muhash = FromInt(0);
+    muhash.Insert(tmp, sizeof(tmp));
+    tmp[0] = 2;
+    muhash.Remove(tmp, sizeof(tmp));
+    muhash.Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // Serialization keeps the pending division
+    MuHash3072 serchk = FromInt(1);
+    serchk /= FromInt(2);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << serchk;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 deserialized;
+    ss >> deserialized;
+    uint256 outDeserialized;
+    serchk.Finalize(out);
+    deserialized.Finalize(outDeserialized);
+    BOOST_CHECK(out == outDeserialized);
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
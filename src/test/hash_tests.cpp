@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
 #include "utilstrencodings.h"
 #include "test/test_pivx.h"
 
@@ -145,4 +146,29 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(quark_batch)
+{
+    // the batch must match the single header hash whatever branches the lanes take,
+    // over more lanes than fit in one group
+    std::vector<unsigned char> vHeaders(80 * (2 * QUARK_BATCH_LANES + 3));
+    for (size_t i = 0; i < vHeaders.size(); i++) vHeaders[i] = (unsigned char)(i * 7 + 3);
+
+    std::vector<uint256> vHashes(2 * QUARK_BATCH_LANES + 3);
+    HashQuarkBatch(vHeaders.data(), 80, vHashes.size(), vHashes.data());
+    for (size_t n = 0; n < vHashes.size(); n++)
+        BOOST_CHECK(vHashes[n] == HashQuark(vHeaders.begin() + n * 80, vHeaders.begin() + (n + 1) * 80));
+
+    // and the miner's nonce range the hashes of the header
+    CBlockHeader header;
+    header.nVersion = 3;
+    header.hashPrevBlock = uint256S("0x1234");
+    header.nTime = 1700000000;
+    header.nBits = 0x1e0ffff0;
+    header.GetNonceHashes(0xfffffff8, vHashes.size(), vHashes.data());
+    for (size_t n = 0; n < vHashes.size(); n++) {
+        header.nNonce = 0xfffffff8 + n;
+        BOOST_CHECK(vHashes[n] == header.GetHash());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
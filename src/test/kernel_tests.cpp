@@ -0,0 +1,51 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "kernel.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+class TestStakeKernel
+{
+public:
+    //! Check the kernel hash against the whole kernel message hashed at once, for several block times
+    template <typename T>
+    static void CheckHash(const T& modifier)
+    {
+        const int nTimeBlockFrom = 1600000000;
+        CDataStream uniqueness(SER_NETWORK, 0);
+        uniqueness << (unsigned int)1 << GetRandHash();
+
+        CStakeKernel kernel;
+        kernel.stakeModifier << modifier;
+        kernel.nTimeBlockFrom = nTimeBlockFrom;
+        kernel.stakeUniqueness = uniqueness;
+        kernel.HashPrefix();
+
+        for (int nTime : {0, 1, nTimeBlockFrom + 60, nTimeBlockFrom + 3600 * 24 * 30, 0x7fffffff}) {
+            CDataStream ss(SER_GETHASH, 0);
+            ss << modifier << nTimeBlockFrom << uniqueness << nTime;
+            kernel.SetTime(nTime);
+            BOOST_CHECK(kernel.GetHash() == Hash(ss.begin(), ss.end()));
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(kernel_hash_tests)
+{
+    // modifier v1
+    TestStakeKernel::CheckHash((uint64_t)0x0123456789abcdefULL);
+    TestStakeKernel::CheckHash((uint64_t)0);
+    // modifier v2
+    TestStakeKernel::CheckHash(GetRandHash());
+    TestStakeKernel::CheckHash(UINT256_ZERO);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
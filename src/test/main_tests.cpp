@@ -64,8 +64,8 @@ CBlock CreateDummyBlockWithSignature(CKey stakingKey, BlockSignatureType type, b
 
     // Now the block.
     CBlock block;
-    block.vtx.emplace_back(CTransaction()); // dummy first tx
-    block.vtx.emplace_back(txCoinStake);
+    block.vtx.emplace_back(MakeTransactionRef()); // dummy first tx
+    block.vtx.emplace_back(MakeTransactionRef(txCoinStake));
     SignBlockWithKey(block, stakingKey);
 
     return block;
@@ -156,6 +156,32 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     // BOOST_CHECK(uint8_t(nSum) == uint8_t(4109975100000000ULL));
 }
 
+BOOST_AUTO_TEST_CASE(supply_bucket_test)
+{
+    // the bucket must round every coin on its own, like the UTXO walk does
+    const std::vector<CAmount> vValues = {1, 99, 100, 101, 12345678, 50 * COIN, 50 * COIN + 37, 199999999};
+
+    CSupplyBucket bucket;
+    for (const CAmount nValue : vValues) bucket.Add(nValue, 1);
+
+    for (int64_t nWeight = 0; nWeight <= 100; nWeight++) {
+        CAmount nExpected = 0;
+        for (const CAmount nValue : vValues) nExpected += nValue * nWeight / 100;
+        BOOST_CHECK_EQUAL(bucket.GetWeightedValue(nWeight), nExpected);
+    }
+
+    for (const CAmount nValue : vValues) bucket.Add(nValue, -1);
+    BOOST_CHECK(bucket.IsEmpty());
+
+    // weight is 100% up to 3 months old, then decreases down to 0% at 12 months
+    const int64_t nBlocksPerMonth = 43200;
+    BOOST_CHECK_EQUAL(CSupplyAccumulator::GetSupplyWeight(0, nBlocksPerMonth), 100);
+    BOOST_CHECK_EQUAL(CSupplyAccumulator::GetSupplyWeight(3 * nBlocksPerMonth, nBlocksPerMonth), 100);
+    BOOST_CHECK(CSupplyAccumulator::GetSupplyWeight(6 * nBlocksPerMonth, nBlocksPerMonth) < 100);
+    BOOST_CHECK_EQUAL(CSupplyAccumulator::GetSupplyWeight(12 * nBlocksPerMonth, nBlocksPerMonth), 0);
+    BOOST_CHECK_EQUAL(CSupplyAccumulator::GetSupplyWeight(24 * nBlocksPerMonth, nBlocksPerMonth), 0);
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
@@ -0,0 +1,170 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "main.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "utiltime.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(masternode_tests, TestingSetup)
+
+class TestMasternodeMan
+{
+public:
+    //! Elect the next payee by walking the payment queue and by the full scan, and check they agree
+    static CMasternode* CheckPaymentQueue(const CBlockIndex* pindexPrev)
+    {
+        BOOST_REQUIRE(mnodeman.pindexPaymentQueue == pindexPrev);
+
+        int nCountQueue = 0;
+        int nCountScan = 0;
+        std::vector<CTxIn> vQueue;
+        std::vector<CTxIn> vScan;
+        std::vector<CTxIn> vCount;
+        CMasternode* pmnQueue = mnodeman.GetNextMasternodeInQueueForPayment(pindexPrev, true, nCountQueue, vQueue, false);
+        mnodeman.GetNextMasternodeInQueueForPayment(pindexPrev, true, nCountQueue, vCount, true);
+
+        // any other block than the one the queue is at gets the full scan
+        mnodeman.pindexPaymentQueue = nullptr;
+        CMasternode* pmnScan = mnodeman.GetNextMasternodeInQueueForPayment(pindexPrev, true, nCountScan, vScan, false);
+        mnodeman.GetNextMasternodeInQueueForPayment(pindexPrev, true, nCountScan, vCount, true);
+        mnodeman.pindexPaymentQueue = pindexPrev;
+
+        BOOST_CHECK(pmnQueue != nullptr);
+        BOOST_CHECK(pmnQueue == pmnScan);
+        BOOST_CHECK(vQueue == vScan);
+        BOOST_CHECK_EQUAL(nCountQueue, nCountScan);
+        return pmnQueue;
+    }
+};
+
+static const int64_t nNow = 1700000000;
+
+//! Connect a block paying the payee to the masternode manager, the block index is kept until the next run
+static const CBlockIndex* ConnectPaymentBlock(int nHeight, int64_t nTime, const CScript& payee)
+{
+    static uint256 vHashes[64];
+    static CBlockIndex vIndex[64];
+
+    vHashes[nHeight] = GetRandHash();
+    CBlockIndex* pindex = &vIndex[nHeight];
+    pindex->phashBlock = &vHashes[nHeight];
+    pindex->pprev = nHeight > 1 ? &vIndex[nHeight - 1] : nullptr;
+    pindex->nHeight = nHeight;
+    pindex->nTime = nTime;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    tx.vin[0].scriptSig = CScript() << nHeight;
+    tx.vout.emplace_back(COIN, payee);
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    BOOST_CHECK(mnodeman.ConnectBlock(pindex, block));
+    return pindex;
+}
+
+static CMasternode MakeMasternode(const CKey& key, int64_t nSigTime, int64_t nPingTime)
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mn.pubKeyCollateralAddress = key.GetPubKey();
+    mn.pubKeyMasternode = key.GetPubKey();
+    mn.sigTime = nSigTime;
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.blockHash = GetRandHash();
+    mn.lastPing.sigTime = nPingTime;
+    return mn;
+}
+
+static void AddMasternode(CMasternode& mn, int nCoinHeight)
+{
+    BOOST_CHECK(mnodeman.Add(mn));
+    if (nCoinHeight >= 0) {
+        const CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+        pcoinsTip->AddCoin(mn.vin.prevout, Coin(CTxOut(COIN, payee), nCoinHeight, false, false), false);
+    }
+}
+
+static CScript GetPayee(const CMasternode& mn)
+{
+    return GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+}
+
+BOOST_AUTO_TEST_CASE(payment_queue_tests)
+{
+    LOCK(cs_main);
+    SetMockTime(nNow);
+    mnodeman.Clear();
+    mnodeman.SetCoinsDB(pcoinsdbview);
+
+    std::vector<CKey> vKeys(31);
+    for (CKey& key : vKeys)
+        key.MakeNewKey(true);
+
+    // 0-1 were paid more than a month ago, 2-21 were paid in order, 22-23 were never paid
+    // and sort between them, 24 was announced again after its payment, 25 is too new,
+    // 26 expired, 27 isn't enabled yet, the collateral of 28 is missing and 29's is too recent
+    std::vector<CMasternode> vMasternodes;
+    for (int i = 0; i < 30; i++) {
+        int64_t nSigTime = nNow - 50 * DAY_IN_SECONDS;
+        if (i < 2) nSigTime = nNow - 60 * DAY_IN_SECONDS;
+        if (i == 22) nSigTime = nNow - 30 * 600 - 300;
+        if (i == 23) nSigTime = nNow - 25 * 600 - 300;
+        if (i == 24) nSigTime = nNow - 17 * 600 + 100;
+        if (i == 25) nSigTime = nNow - 600;
+        if (i == 27) nSigTime = nNow - 300;
+        int64_t nPingTime = i < 10 ? nNow - 1800 : nNow;
+        if (i == 26) nPingTime = nNow - 3 * HOUR_IN_SECONDS;
+        vMasternodes.push_back(MakeMasternode(vKeys[i], nSigTime, nPingTime));
+        AddMasternode(vMasternodes.back(), i == 28 ? -1 : (i == 29 ? 35 : 0));
+    }
+
+    const CScript scriptOther = CScript() << OP_TRUE;
+    const CBlockIndex* pindexTip = nullptr;
+    for (int nHeight = 1; nHeight <= 40; nHeight++) {
+        CScript payee = scriptOther;
+        if (nHeight <= 22) payee = GetPayee(vMasternodes[nHeight - 1]);
+        if (nHeight == 23) payee = GetPayee(vMasternodes[24]);
+        const int64_t nTime = nHeight <= 2 ? nNow - 45 * DAY_IN_SECONDS + nHeight * 60 : nNow - (40 - nHeight) * 600;
+        pindexTip = ConnectPaymentBlock(nHeight, nTime, payee);
+    }
+    CMasternode* pmnPaid = TestMasternodeMan::CheckPaymentQueue(pindexTip);
+
+    // the payee moves to the back of the queue
+    BOOST_REQUIRE(pmnPaid != nullptr);
+    pindexTip = ConnectPaymentBlock(41, nNow + 60, GetPayee(*pmnPaid));
+    BOOST_CHECK(TestMasternodeMan::CheckPaymentQueue(pindexTip) != pmnPaid);
+
+    // a new ping enables the expired one again
+    CMasternode* pmnExpired = mnodeman.Find(vMasternodes[26].vin);
+    BOOST_REQUIRE(pmnExpired != nullptr);
+    pmnExpired->lastPing.sigTime = nNow;
+    mnodeman.UpdatedMasternodePing(pmnExpired);
+    TestMasternodeMan::CheckPaymentQueue(pindexTip);
+
+    // the pings of 0-9 expire as time goes by
+    SetMockTime(nNow + 100 * 60);
+    TestMasternodeMan::CheckPaymentQueue(pindexTip);
+
+    // and a masternode joins the list
+    CMasternode mnNew = MakeMasternode(vKeys[30], nNow - 50 * DAY_IN_SECONDS, nNow + 100 * 60);
+    AddMasternode(mnNew, 0);
+    TestMasternodeMan::CheckPaymentQueue(pindexTip);
+
+    mnodeman.Clear();
+    mnodeman.SetCoinsDB(nullptr);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -101,4 +101,67 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+    CBlockIndex* pindex = arena.Allocate();
+    const uint256 nModifier = GetRandHash();
+    pindex->nVersion = 7;
+    pindex->SetStakeModifierBytes(nModifier.begin(), nModifier.end());
+    pindex->SetMoneySupply(1234567);
+
+    // the cold fields go to disk and back
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(pindex);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.GetStakeModifierBytes() == std::vector<unsigned char>(nModifier.begin(), nModifier.end()));
+    BOOST_CHECK(diskindex.GetMoneySupply() == Optional<CAmount>(1234567));
+
+    // copies do not share them
+    CBlockIndex copy(*pindex);
+    copy.SetMoneySupply(nullopt);
+    BOOST_CHECK(pindex->GetMoneySupply() == Optional<CAmount>(1234567));
+    *pindex = copy;
+    BOOST_CHECK(!pindex->GetMoneySupply());
+
+    // freed entries come back reset
+    arena.Free(pindex);
+    CBlockIndex* pindexReused = arena.Allocate();
+    BOOST_CHECK(pindexReused == pindex);
+    BOOST_CHECK(pindexReused->GetStakeModifierBytes().empty());
+    BOOST_CHECK(pindexReused->GetMoneySupply() == Optional<CAmount>(0));
+
+    // a reservation is served from a single chunk
+    arena.Reserve(10000);
+    CBlockIndex* pindexFirst = arena.Allocate();
+    for (int i = 1; i < 10000; i++)
+        BOOST_CHECK(arena.Allocate() == pindexFirst + i);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_paid_payee_test)
+{
+    CBlockIndex index;
+    index.nVersion = 7;
+    const CScript payee = CScript() << OP_TRUE;
+    index.SetPaidPayee(payee);
+
+    // the payee is appended to the entry on disk
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    const std::string strEntry = ss.str();
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(diskindex.HasPaidPayee());
+    BOOST_CHECK(diskindex.hashPaidPayee == Hash160(payee.begin(), payee.end()));
+
+    // an entry rewritten by an older version lost it but kept the flag
+    CDataStream ssOld(strEntry.data(), strEntry.data() + strEntry.size() - 1 - 20, SER_DISK, CLIENT_VERSION);
+    CDiskBlockIndex diskindexOld;
+    ssOld >> diskindexOld;
+    BOOST_CHECK(!diskindexOld.HasPaidPayee());
+    BOOST_CHECK(diskindexOld.hashPaidPayee.IsNull());
+    BOOST_CHECK_EQUAL(diskindexOld.nVersion, 7);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
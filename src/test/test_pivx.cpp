@@ -8,6 +8,7 @@
 
 #include "test_pivx.h"
 
+#include "crypto/sha256.h"
 #include "main.h"
 #include "random.h"
 #include "script/sigcache.h"
@@ -28,10 +29,12 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup()
 {
+        SHA256AutoDetect();
         RandomInit();
         ECC_Start();
         SetupEnvironment();
         InitSignatureCache();
+        InitScriptExecutionCache();
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::MAIN);
 }
@@ -77,10 +80,10 @@ TestingSetup::~TestingSetup()
 }
 
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(CMutableTransaction &tx, CTxMemPool *pool) {
-    CTransaction txn(tx);
+    CTransactionRef txn = MakeTransactionRef(tx);
     bool hasNoDependencies = pool ? pool->HasNoInputsOf(tx) : hadNoDependencies;
     // Hack to assume either its completely dependent on other mempool txs or not at all
-    CAmount inChainValue = hasNoDependencies ? txn.GetValueOut() : 0;
+    CAmount inChainValue = hasNoDependencies ? txn->GetValueOut() : 0;
 
     return CTxMemPoolEntry(txn, nFee, nTime, dPriority, nHeight,
                            hasNoDependencies, inChainValue, spendsCoinbaseOrCoinstake, sigOpCount);
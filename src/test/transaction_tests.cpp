@@ -407,6 +407,41 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(script_execution_cache)
+{
+    LOCK(cs_main);
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    mtx.vout.emplace_back(1000, CScript() << OP_1);
+    const CTransaction tx(mtx);
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+
+    // The same outpoint, spendable by anyone in one view and by no one in the other
+    CCoinsViewCache viewTrue(pcoinsTip);
+    viewTrue.AddCoin(tx.vin[0].prevout, Coin(CTxOut(1000, CScript() << OP_TRUE), 1, false, false), false);
+    CCoinsViewCache viewFalse(pcoinsTip);
+    viewFalse.AddCoin(tx.vin[0].prevout, Coin(CTxOut(1000, CScript() << OP_FALSE), 1, false, false), false);
+
+    CValidationState state;
+    PrecomputedTransactionData precomTxData(tx);
+    BOOST_CHECK(!CheckInputs(tx, state, viewFalse, true, flags, false, true, precomTxData));
+    BOOST_CHECK(CheckInputs(tx, state, viewTrue, true, flags, false, true, precomTxData));
+
+    // Scripts that passed with these flags aren't run again
+    BOOST_CHECK(CheckInputs(tx, state, viewFalse, true, flags, false, false, precomTxData));
+    // but they are with other flags
+    BOOST_CHECK(!CheckInputs(tx, state, viewFalse, true, flags | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false, false, precomTxData));
+
+    // Deferred checks have no result yet, so they aren't stored
+    mtx.nLockTime = 1;
+    const CTransaction txDeferred(mtx);
+    PrecomputedTransactionData precomTxDataDeferred(txDeferred);
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(txDeferred, state, viewTrue, true, flags, false, true, precomTxDataDeferred, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    BOOST_CHECK(!CheckInputs(txDeferred, state, viewFalse, true, flags, false, false, precomTxDataDeferred));
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard)
 {
     LOCK(cs_main);
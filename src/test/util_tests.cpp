@@ -13,7 +13,9 @@
 #include "utilmoneystr.h"
 #include "test/test_pivx.h"
 
+#include <set>
 #include <stdint.h>
+#include <thread>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -491,4 +493,54 @@ BOOST_AUTO_TEST_CASE(test_ParseFixedPoint)
     BOOST_CHECK(!ParseFixedPoint("1.", 8, &amount));
 }
 
+BOOST_AUTO_TEST_CASE(test_LogRing)
+{
+    BCLog::LogRing ring(4);
+    std::string str;
+    BOOST_CHECK(!ring.Pop(str));
+
+    // Fills up, then refuses lines until some are read, in order
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(ring.Push(strprintf("line %d\n", i)));
+    BOOST_CHECK(!ring.Push("dropped\n"));
+    BOOST_CHECK(ring.Pop(str));
+    BOOST_CHECK_EQUAL(str, "line 0\n");
+    BOOST_CHECK(ring.Push("line 4\n"));
+    for (int i = 1; i <= 4; i++) {
+        BOOST_CHECK(ring.Pop(str));
+        BOOST_CHECK_EQUAL(str, strprintf("line %d\n", i));
+    }
+    BOOST_CHECK(!ring.Pop(str));
+
+    // Many producers, every line they got in read once
+    BCLog::LogRing shared(1 << 10);
+    std::atomic<int> nPushed{0};
+    std::atomic<int> nDone{0};
+    std::vector<std::thread> vProducers;
+    for (int t = 0; t < 4; t++) {
+        vProducers.emplace_back([&shared, &nPushed, &nDone, t]() {
+            for (int i = 0; i < 1000; i++) {
+                if (shared.Push(strprintf("%d %d\n", t, i)))
+                    nPushed++;
+            }
+            nDone++;
+        });
+    }
+    int nPopped = 0;
+    std::set<std::string> setLines;
+    while (nDone < 4) {
+        if (shared.Pop(str)) {
+            BOOST_CHECK(setLines.insert(str).second);
+            nPopped++;
+        }
+    }
+    for (std::thread& producer : vProducers)
+        producer.join();
+    while (shared.Pop(str)) {
+        BOOST_CHECK(setLines.insert(str).second);
+        nPopped++;
+    }
+    BOOST_CHECK_EQUAL(nPopped, nPushed);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "txdb.h"
 
 #include "main.h"
+#include "masternode.h"
 #include "pow.h"
 #include "uint256.h"
 
@@ -19,9 +20,14 @@ static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_BLOCK_STATS = 's';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_DYNAMIC_REWARDS = 'D';
+static const char DB_UTXO_STATS = 'S';
+static const char DB_COLLATERAL = 'M';
+static const char DB_COLLATERALS_INDEXED = 'm';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
@@ -32,7 +38,7 @@ struct CoinEntry
 {
     COutPoint* outpoint;
     char key;
-    explicit CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+    explicit CoinEntry(const COutPoint* ptr, char keyIn = DB_COIN) : outpoint(const_cast<COutPoint*>(ptr)), key(keyIn)  {}
 
     template<typename Stream>
     void Serialize(Stream &s) const {
@@ -54,6 +60,16 @@ struct CoinEntry
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
+    if (fWipe || db.IsEmpty()) {
+        // the index follows the coins from the start
+        db.Write(DB_COLLATERALS_INDEXED, '1');
+        return;
+    }
+
+    std::vector<std::pair<COutPoint, Coin>> vCollaterals;
+    GetCollaterals(vCollaterals);
+    for (const auto& collateral : vCollaterals)
+        setCollaterals.insert(collateral.first);
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
@@ -82,10 +98,18 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
+            CoinEntry collateralEntry(&it->first, DB_COLLATERAL);
+            if (it->second.coin.IsSpent()) {
                 batch.Erase(entry);
-            else
+                if (setCollaterals.erase(it->first))
+                    batch.Erase(collateralEntry);
+            } else {
                 batch.Write(entry, it->second.coin);
+                if (CMasternode::IsMasternodeCollateralAmount(it->second.coin.out.nValue)) {
+                    batch.Write(collateralEntry, it->second.coin);
+                    setCollaterals.insert(it->first);
+                }
+            }
             changed++;
         }
         count++;
@@ -94,12 +118,78 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (pDynamicRewards)
+        batch.Write(DB_DYNAMIC_REWARDS, *pDynamicRewards);
+    if (pUTXOStats)
+        batch.Write(DB_UTXO_STATS, *pUTXOStats);
 
     bool ret = db.WriteBatch(batch);
+    if (ret) {
+        pDynamicRewards.reset();
+        pUTXOStats.reset();
+    }
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
+bool CCoinsViewDB::ReadDynamicRewards(std::vector<std::pair<int, CAmount>>& vRewards) const
+{
+    if (pDynamicRewards) {
+        vRewards = *pDynamicRewards;
+        return true;
+    }
+    vRewards.clear();
+    if (!db.Exists(DB_DYNAMIC_REWARDS))
+        return true;
+    return db.Read(DB_DYNAMIC_REWARDS, vRewards);
+}
+
+bool CCoinsViewDB::ReadUTXOStats(uint256& hashBlock, CUTXOStats& stats) const
+{
+    if (pUTXOStats) {
+        hashBlock = pUTXOStats->first;
+        stats = pUTXOStats->second;
+        return true;
+    }
+    std::pair<uint256, CUTXOStats> record;
+    if (!db.Read(DB_UTXO_STATS, record))
+        return false;
+    hashBlock = record.first;
+    stats = record.second;
+    return true;
+}
+
+void CCoinsViewDB::WriteUTXOStats(const uint256& hashBlock, const CUTXOStats& stats)
+{
+    pUTXOStats.reset(new std::pair<uint256, CUTXOStats>(hashBlock, stats));
+}
+
+bool CCoinsViewDB::GetCollaterals(std::vector<std::pair<COutPoint, Coin>>& vCollaterals) const
+{
+    vCollaterals.clear();
+
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
+    pcursor->Seek(DB_COLLATERAL);
+
+    while (pcursor->Valid()) {
+        COutPoint outpoint;
+        CoinEntry entry(&outpoint, DB_COLLATERAL);
+        if (!pcursor->GetKey(entry) || entry.key != DB_COLLATERAL)
+            break;
+        Coin coin;
+        if (!pcursor->GetValue(coin))
+            return error("%s: unable to read collateral %s", __func__, outpoint.ToString());
+        vCollaterals.emplace_back(outpoint, std::move(coin));
+        pcursor->Next();
+    }
+    return true;
+}
+
+void CCoinsViewDB::WriteDynamicRewards(const std::vector<std::pair<int, CAmount>>& vRewards)
+{
+    pDynamicRewards.reset(new std::vector<std::pair<int, CAmount>>(vRewards));
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -157,6 +247,38 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     return i;
 }
 
+std::unique_ptr<CDBSnapshot> CCoinsViewDB::GetSnapshot()
+{
+    return std::unique_ptr<CDBSnapshot>(new CDBSnapshot(db));
+}
+
+uint256 CCoinsViewDB::GetBestBlock(const CDBSnapshot& snapshot) const
+{
+    std::unique_ptr<CDBIterator> pcursor(snapshot.NewIterator());
+    pcursor->Seek(DB_BEST_BLOCK);
+    char chKey;
+    uint256 hashBestChain;
+    if (!pcursor->Valid() || pcursor->GetKeySize() != 1 || !pcursor->GetKey(chKey) || chKey != DB_BEST_BLOCK ||
+        !pcursor->GetValue(hashBestChain))
+        return UINT256_ZERO;
+    return hashBestChain;
+}
+
+CCoinsViewCursor* CCoinsViewDB::Cursor(const CDBSnapshot& snapshot, const uint256& hashBegin) const
+{
+    CCoinsViewDBCursor* i = new CCoinsViewDBCursor(snapshot.NewIterator(), GetBestBlock(snapshot));
+    const COutPoint outpointBegin(hashBegin, 0);
+    i->pcursor->Seek(CoinEntry(&outpointBegin));
+    if (i->pcursor->Valid()) {
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
+    } else {
+        i->keyTmp.first = 0;
+    }
+    return i;
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
@@ -226,6 +348,16 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadBlockStats(const uint256& hashBlock, CBlockStats& stats)
+{
+    return Read(std::make_pair(DB_BLOCK_STATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats)
+{
+    return Write(std::make_pair(DB_BLOCK_STATS, hashBlock), stats);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -281,14 +413,16 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
                 //Proof Of Stake
                 pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->vStakeModifier = diskindex.vStakeModifier;
+                const std::vector<unsigned char> vStakeModifier = diskindex.GetStakeModifierBytes();
+                pindexNew->SetStakeModifierBytes(vStakeModifier.data(), vStakeModifier.data() + vStakeModifier.size());
 
                 // if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_POS)) {
                 //     if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
                 //         return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
                 // }
 
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
+                pindexNew->SetMoneySupply(diskindex.GetMoneySupply());
+                pindexNew->hashPaidPayee = diskindex.hashPaidPayee;
 
                 pcursor->Next();
             } else {
@@ -366,7 +500,7 @@ bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
     pcursor->Seek(std::make_pair(DB_COINS, uint256()));
     if (!pcursor->Valid()) {
-        return true;
+        return IndexCollaterals();
     }
 
     LogPrintf("Upgrading database...\n");
@@ -400,5 +534,34 @@ bool CCoinsViewDB::Upgrade() {
         }
     }
     db.WriteBatch(batch);
-    return true;
+    return IndexCollaterals();
+}
+
+bool CCoinsViewDB::IndexCollaterals()
+{
+    if (db.Exists(DB_COLLATERALS_INDEXED))
+        return true;
+
+    LogPrintf("Indexing masternode collaterals...\n");
+    size_t batch_size = 1 << 24;
+    CDBBatch batch;
+    std::unique_ptr<CCoinsViewCursor> pcursor(Cursor());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin))
+            return error("%s: unable to read coin", __func__);
+        if (CMasternode::IsMasternodeCollateralAmount(coin.out.nValue)) {
+            batch.Write(CoinEntry(&outpoint, DB_COLLATERAL), coin);
+            setCollaterals.insert(outpoint);
+        }
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    batch.Write(DB_COLLATERALS_INDEXED, '1');
+    return db.WriteBatch(batch);
 }
@@ -8,11 +8,15 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockstats.h"
 #include "coins.h"
+#include "coinstats.h"
 #include "chain.h"
 #include "dbwrapper.h"
 
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -68,6 +72,15 @@ class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! dynamic rewards history waiting for the next BatchWrite
+    std::unique_ptr<std::vector<std::pair<int, CAmount>>> pDynamicRewards;
+    //! statistics of the coins at a block, waiting for the next BatchWrite
+    std::unique_ptr<std::pair<uint256, CUTXOStats>> pUTXOStats;
+    //! outpoints in the collateral index, so spent coins are only looked up there when needed
+    std::set<COutPoint> setCollaterals;
+
+    //! Index the collateral-sized coins of a chainstate written before the index existed
+    bool IndexCollaterals();
 
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
@@ -78,6 +91,24 @@ public:
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override;
     CCoinsViewCursor* Cursor() const override;
 
+    //! Snapshot of the database, to read the coins at a single block while the tip moves on
+    std::unique_ptr<CDBSnapshot> GetSnapshot();
+    //! Best block as of the snapshot
+    uint256 GetBestBlock(const CDBSnapshot& snapshot) const;
+    //! Cursor over the coins of the snapshot, from the first txid not below hashBegin
+    CCoinsViewCursor* Cursor(const CDBSnapshot& snapshot, const uint256& hashBegin) const;
+
+    //! Dynamic rewards history as (epoch height, amount), sorted by height
+    bool ReadDynamicRewards(std::vector<std::pair<int, CAmount>>& vRewards) const;
+    //! Stage the dynamic rewards history, so that it's committed atomically with the coins
+    void WriteDynamicRewards(const std::vector<std::pair<int, CAmount>>& vRewards);
+    //! Statistics of the coins as of hashBlock, if any were stored
+    bool ReadUTXOStats(uint256& hashBlock, CUTXOStats& stats) const;
+    //! Stage the statistics of the coins at hashBlock, so that they're committed atomically with the coins
+    void WriteUTXOStats(const uint256& hashBlock, const CUTXOStats& stats);
+    //! Unspent coins worth any masternode collateral of the schedule, as of the best block on disk
+    bool GetCollaterals(std::vector<std::pair<COutPoint, Coin>>& vCollaterals) const;
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -125,6 +156,8 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool ReadBlockStats(const uint256& hashBlock, CBlockStats& stats);
+    bool WriteBlockStats(const uint256& hashBlock, const CBlockStats& stats);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -41,6 +41,7 @@
 
 #include <algorithm>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
 
@@ -559,6 +560,49 @@ void AllocateFileRange(FILE* file, unsigned int offset, unsigned int length)
 #endif
 }
 
+CMappedFile::CMappedFile(const fs::path& path)
+{
+#ifdef WIN32
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file)
+        return;
+    char buf[65536];
+    size_t nRead;
+    while ((nRead = fread(buf, 1, sizeof(buf), file)) > 0)
+        vData.insert(vData.end(), buf, buf + nRead);
+    const bool fError = ferror(file);
+    fclose(file);
+    if (fError || vData.empty())
+        return;
+    pdata = vData.data();
+    nSize = vData.size();
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* pmap = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (pmap != MAP_FAILED) {
+            // the whole file is read front to back
+            posix_madvise(pmap, st.st_size, POSIX_MADV_SEQUENTIAL);
+            pdata = static_cast<const unsigned char*>(pmap);
+            nSize = st.st_size;
+        }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap(const_cast<unsigned char*>(pdata), nSize);
+#endif
+}
+
 #ifdef WIN32
 fs::path GetSpecialFolderPath(int nFolder, bool fCreate)
 {
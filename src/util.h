@@ -75,6 +75,29 @@ void FileCommit(FILE* fileout);
 bool TruncateFile(FILE* file, unsigned int length);
 int RaiseFileDescriptorLimit(int nMinFD);
 void AllocateFileRange(FILE* file, unsigned int offset, unsigned int length);
+
+/** Read-only view of a whole file, memory mapped where the platform supports it (read into memory otherwise) */
+class CMappedFile
+{
+private:
+    const unsigned char* pdata{nullptr};
+    size_t nSize{0};
+#ifdef WIN32
+    std::vector<unsigned char> vData;
+#endif
+
+public:
+    explicit CMappedFile(const fs::path& path);
+    ~CMappedFile();
+
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    bool IsNull() const { return pdata == nullptr; }
+    const unsigned char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
 bool RenameOver(fs::path src, fs::path dest);
 bool TryCreateDirectory(const fs::path& p);
 bool IsDirectory(const std::string& path);
@@ -4,6 +4,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "wallet/txlog.h"
 #include "wallet/wallet.h"
 #include "consensus/merkle.h"
 
@@ -321,10 +322,11 @@ void removeTxFromMempool(CWalletTx& wtx)
 CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CBlockIndex* pprev = nullptr)
 {
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = BlockMerkleRoot(block);
     if (pprev) block.hashPrevBlock = pprev->GetBlockHash();
-    CBlockIndex* fakeIndex = new CBlockIndex(block);
+    CBlockIndex* fakeIndex = blockIndexArena.Allocate();
+    *fakeIndex = CBlockIndex(block);
     fakeIndex->pprev = pprev;
     mapBlockIndex.insert(std::make_pair(block.GetHash(), fakeIndex));
     fakeIndex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
@@ -337,7 +339,7 @@ CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CBlockIndex* pprev = nullptr)
 
 void fakeMempoolInsertion(const CWalletTx& wtxCredit)
 {
-    CTxMemPoolEntry entry(wtxCredit, 0, 0, 0, 0, false, 0, false, 0);
+    CTxMemPoolEntry entry(MakeTransactionRef(wtxCredit), 0, 0, 0, 0, false, 0, false, 0);
     LOCK(mempool.cs);
     mempool.mapTx.insert(entry);
 }
@@ -471,4 +473,310 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
 
 }
 
+class TestWalletBalances
+{
+public:
+    //! The kept totals must be what a pass over the whole wallet sums
+    static void Check(const CWallet& wallet)
+    {
+        const CWallet::CWalletBalances kept = wallet.GetBalances();
+        const CWallet::CWalletBalances summed = wallet.SumBalances();
+        BOOST_CHECK_EQUAL(kept.nAvailable, summed.nAvailable);
+        BOOST_CHECK_EQUAL(kept.nUnconfirmed, summed.nUnconfirmed);
+        BOOST_CHECK_EQUAL(kept.nImmature, summed.nImmature);
+        BOOST_CHECK_EQUAL(kept.nWatchOnly, summed.nWatchOnly);
+        BOOST_CHECK_EQUAL(kept.nUnconfirmedWatchOnly, summed.nUnconfirmedWatchOnly);
+        BOOST_CHECK_EQUAL(kept.nImmatureWatchOnly, summed.nImmatureWatchOnly);
+        BOOST_CHECK_EQUAL(kept.nStaking, summed.nStaking);
+        BOOST_CHECK_EQUAL(kept.nLocked, summed.nLocked);
+    }
+};
+
+/**
+ * Mimic the connection of a block holding the transactions on top of the tip.
+ */
+static CBlockIndex* FakeConnectBlock(const std::vector<CWalletTx*>& vwtx)
+{
+    static uint32_t nTime = 1;
+    CBlock block;
+    for (const CWalletTx* pwtx : vwtx)
+        block.vtx.push_back(MakeTransactionRef(*pwtx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    block.nTime = nTime++;
+    CBlockIndex* fakeIndex = blockIndexArena.Allocate();
+    *fakeIndex = CBlockIndex(block);
+    fakeIndex->pprev = chainActive.Tip();
+    fakeIndex->nHeight = fakeIndex->pprev->nHeight + 1;
+    fakeIndex->BuildSkip();
+    mapBlockIndex.insert(std::make_pair(block.GetHash(), fakeIndex));
+    fakeIndex->phashBlock = &mapBlockIndex.find(block.GetHash())->first;
+    chainActive.SetTip(fakeIndex);
+    for (unsigned int i = 0; i < vwtx.size(); i++) {
+        vwtx[i]->SetMerkleBranch(fakeIndex, i);
+        removeTxFromMempool(*vwtx[i]);
+    }
+    mempool.AddTransactionsUpdated(1);
+    return fakeIndex;
+}
+
+BOOST_AUTO_TEST_CASE(wallet_balances_tests)
+{
+    CWallet& wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+    TestWalletBalances::Check(wallet);
+
+    CTxDestination dest;
+    BOOST_ASSERT(wallet.getNewAddress(dest, "balances").result);
+    const CTxOut out(10 * COIN, GetScriptForDestination(dest));
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptOther = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // A payment to us enters the wallet and the mempool, then a block
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    mtx.vout = {out, out};
+    BOOST_CHECK(wallet.AddToWallet(CWalletTx(&wallet, CTransaction(mtx))));
+    CWalletTx& wtxPay = wallet.mapWallet[mtx.GetHash()];
+    TestWalletBalances::Check(wallet);
+    fakeMempoolInsertion(wtxPay);
+    mempool.AddTransactionsUpdated(1);
+    TestWalletBalances::Check(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), 20 * COIN);
+    FakeConnectBlock({&wtxPay});
+    TestWalletBalances::Check(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 20 * COIN);
+
+    // A coinbase paying us is immature
+    CMutableTransaction mtxCoinbase;
+    mtxCoinbase.vin.resize(1);
+    mtxCoinbase.vin[0].prevout.SetNull();
+    mtxCoinbase.vin[0].scriptSig = CScript() << 1;
+    mtxCoinbase.vout = {out};
+    CWalletTx wtxCoinbase(&wallet, CTransaction(mtxCoinbase));
+    FakeConnectBlock({&wtxCoinbase});
+    wallet.SyncTransaction(wtxCoinbase, chainActive.Tip(), 0);
+    TestWalletBalances::Check(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 10 * COIN);
+
+    // Locking a coin, then the blocks that make the coins stakeable and the coinbase mature
+    wallet.LockCoin(COutPoint(wtxPay.GetHash(), 1));
+    TestWalletBalances::Check(wallet);
+    for (int i = 0; i < Params().GetConsensus().nCoinbaseMaturity + 10; i++) {
+        FakeConnectBlock({});
+        TestWalletBalances::Check(wallet);
+    }
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 0);
+    BOOST_CHECK_EQUAL(wallet.GetAvailableBalance(), 30 * COIN);
+
+    // Spending a coin, and unlocking the other one
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.emplace_back(COutPoint(wtxPay.GetHash(), 0));
+    mtxSpend.vout.emplace_back(10 * COIN, scriptOther);
+    const CTransaction txSpend(mtxSpend);
+    wallet.SyncTransaction(txSpend, nullptr, -1);
+    TestWalletBalances::Check(wallet);
+    wallet.UnlockAllCoins();
+    TestWalletBalances::Check(wallet);
+
+    // A reorg back below the maturity of the coinbase, without telling the wallet, then new blocks
+    CBlockIndex* pindex = chainActive.Tip();
+    for (int i = 0; i < Params().GetConsensus().nCoinbaseMaturity + 5; i++)
+        pindex = pindex->pprev;
+    chainActive.SetTip(pindex);
+    TestWalletBalances::Check(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), 10 * COIN);
+    for (int i = 0; i < 10; i++) {
+        FakeConnectBlock({});
+        TestWalletBalances::Check(wallet);
+    }
+
+    // Abandoning the spend gives its coin back, erasing the payment drops both
+    BOOST_CHECK(wallet.AbandonTransaction(txSpend.GetHash()));
+    TestWalletBalances::Check(wallet);
+    wallet.EraseFromWallet(wtxPay.GetHash());
+    TestWalletBalances::Check(wallet);
+}
+
+static CWalletTx MakeLogTx(uint32_t nLockTime)
+{
+    CMutableTransaction tx;
+    tx.nLockTime = nLockTime;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nLockTime * COIN;
+    return CWalletTx(nullptr, tx);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_txlog_tests)
+{
+    const fs::path path = GetDataDir() / "wallet_txlog_test.txlog";
+    CWalletTx wtx1 = MakeLogTx(1);
+    CWalletTx wtx2 = MakeLogTx(2);
+    CWalletTx wtx3 = MakeLogTx(3);
+
+    // Build, then append: a replaced record, an erase and a new transaction
+    CWalletTxLogSeal seal;
+    {
+        CWalletTxLog log(path);
+        BOOST_CHECK(log.Rewrite({&wtx1, &wtx2}));
+        wtx1.mapValue["comment"] = "updated";
+        BOOST_CHECK(log.AppendTx(wtx1));
+        BOOST_CHECK(log.AppendErase(wtx2.GetHash()));
+        BOOST_CHECK(log.AppendTx(wtx3));
+        BOOST_CHECK(log.Close(seal));
+        BOOST_CHECK_EQUAL(seal.nSize, fs::file_size(path));
+    }
+
+    // Only the last record of each live transaction is loaded
+    {
+        CWalletTxLog log(path);
+        std::vector<CWalletTx> vWtx;
+        BOOST_CHECK(log.Open(seal));
+        BOOST_CHECK(log.ReadAll(vWtx));
+        BOOST_CHECK_EQUAL(vWtx.size(), 2U);
+        std::map<uint256, CWalletTx> mapLoaded;
+        for (const CWalletTx& wtx : vWtx)
+            mapLoaded.emplace(wtx.GetHash(), wtx);
+        BOOST_CHECK(mapLoaded.count(wtx1.GetHash()) && mapLoaded.count(wtx3.GetHash()));
+        BOOST_CHECK_EQUAL(mapLoaded[wtx1.GetHash()].mapValue["comment"], "updated");
+    }
+
+    // A seal that does not match the log is rejected
+    {
+        CWalletTxLog log(path);
+        CWalletTxLogSeal sealStale = seal;
+        sealStale.nNonce++;
+        BOOST_CHECK(!log.Open(sealStale));
+        sealStale = seal;
+        sealStale.nSize--;
+        BOOST_CHECK(!log.Open(sealStale));
+    }
+
+    // So is a log whose records were damaged
+    {
+        FILE* file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, seal.nSize - 1, SEEK_SET);
+        const int ch = fgetc(file);
+        fseek(file, seal.nSize - 1, SEEK_SET);
+        fputc(ch ^ 0xff, file);
+        fclose(file);
+        CWalletTxLog log(path);
+        BOOST_CHECK(!log.Open(seal));
+    }
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(wallet_txlog_zap_tests)
+{
+    const std::string strFile = "wallet_txlog_zap.dat";
+    mapArgs["-wallettxlog"] = "1";
+    CWalletTx wtx = MakeLogTx(1);
+
+    // First load builds the log, the transaction is appended to it and the log is sealed
+    {
+        bool fFirstRun;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(CWalletDB(strFile).WriteTx(wtx));
+        CloseWalletTxLog(strFile);
+    }
+
+    // The next load takes it from the log
+    {
+        bool fFirstRun;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.count(wtx.GetHash()), 1U);
+        CloseWalletTxLog(strFile);
+    }
+
+    // -zapwallettxes erases the transactions before the wallet is loaded, with the log closed
+    {
+        std::vector<CWalletTx> vWtx;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.ZapWalletTx(vWtx), DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(vWtx.size(), 1U);
+    }
+
+    // so the log is not trusted anymore and the transaction stays zapped
+    {
+        bool fFirstRun;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(wallet.mapWallet.empty());
+        CloseWalletTxLog(strFile);
+    }
+
+    mapArgs.erase("-wallettxlog");
+    fs::remove(GetDataDir() / (strFile + ".txlog"));
+}
+
+//! Load the wallet with its transaction log and seal it again, returning the nonce of the log
+static uint64_t LoadWithTxLog(const std::string& strFile, size_t nTxs)
+{
+    {
+        bool fFirstRun;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), nTxs);
+        CloseWalletTxLog(strFile);
+    }
+    CWalletTxLogSeal seal;
+    BOOST_CHECK(CWalletDB(strFile).ReadTxLogSeal(seal));
+    return seal.nNonce;
+}
+
+BOOST_AUTO_TEST_CASE(wallet_txlog_seal_tests)
+{
+    const std::string strFile = "wallet_txlog_seal.dat";
+    mapArgs["-wallettxlog"] = "1";
+    CWalletTx wtx1 = MakeLogTx(1);
+    CWalletTx wtx2 = MakeLogTx(2);
+
+    {
+        bool fFirstRun;
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(wallet.LoadWallet(fFirstRun), DB_LOAD_OK);
+        BOOST_CHECK(CWalletDB(strFile).WriteTx(wtx1));
+        CloseWalletTxLog(strFile);
+    }
+    CWalletTxLogSeal seal;
+    BOOST_CHECK(CWalletDB(strFile).ReadTxLogSeal(seal));
+
+    // A clean load trusts the log and keeps it
+    uint64_t nNonce = LoadWithTxLog(strFile, 1);
+    BOOST_CHECK_EQUAL(nNonce, seal.nNonce);
+
+    // A transaction written with the log closed leaves the seal stale, the log is rebuilt
+    BOOST_CHECK(CWalletDB(strFile).WriteTx(wtx2));
+    uint64_t nNonceRebuilt = LoadWithTxLog(strFile, 2);
+    BOOST_CHECK(nNonceRebuilt != nNonce);
+
+    // So does a new order position, as a version without the counter writes with each transaction
+    BOOST_CHECK(CWalletDB(strFile).WriteOrderPosNext(100));
+    nNonce = LoadWithTxLog(strFile, 2);
+    BOOST_CHECK(nNonce != nNonceRebuilt);
+
+    // and a tampered seal
+    BOOST_CHECK(CWalletDB(strFile).ReadTxLogSeal(seal));
+    seal.nTxCounter++;
+    BOOST_CHECK(CWalletDB(strFile).WriteTxLogSeal(seal));
+    nNonceRebuilt = LoadWithTxLog(strFile, 2);
+    BOOST_CHECK(nNonceRebuilt != nNonce);
+
+    // -wallettxlog=2 rebuilds the log whatever the seal
+    mapArgs["-wallettxlog"] = "2";
+    nNonce = LoadWithTxLog(strFile, 2);
+    BOOST_CHECK(nNonce != nNonceRebuilt);
+    mapArgs["-wallettxlog"] = "1";
+    BOOST_CHECK_EQUAL(LoadWithTxLog(strFile, 2), nNonce);
+
+    mapArgs.erase("-wallettxlog");
+    fs::remove(GetDataDir() / (strFile + ".txlog"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
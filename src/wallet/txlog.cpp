@@ -0,0 +1,263 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/txlog.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+#include "wallet/wallet.h"
+
+#include <atomic>
+#include <thread>
+
+std::unique_ptr<CWalletTxLog> pwalletTxLog;
+
+/**
+ * Layout: a 16 byte header (magic, version, nonce) followed by records of
+ * type (1), transaction hash (32), payload length (4), payload and the first
+ * four bytes of the double SHA256 of everything before them in the record.
+ * Payloads are CWalletTx serialized as in the wallet database.
+ */
+static const uint32_t WALLET_TXLOG_MAGIC = 0x6c787477; // "wtxl"
+static const uint32_t WALLET_TXLOG_VERSION = 1;
+static const size_t WALLET_TXLOG_HEADER_SIZE = 16;
+static const size_t WALLET_TXLOG_RECORD_HEADER_SIZE = 37;
+static const size_t WALLET_TXLOG_CHECKSUM_SIZE = 4;
+static const unsigned char WALLET_TXLOG_TX = 't';
+static const unsigned char WALLET_TXLOG_ERASE = 'e';
+
+CWalletTxLog::CWalletTxLog(const fs::path& pathIn) : path(pathIn)
+{
+}
+
+CWalletTxLog::~CWalletTxLog()
+{
+    if (file)
+        fclose(file);
+}
+
+bool CWalletTxLog::Open(const CWalletTxLogSeal& seal)
+{
+    LOCK(cs);
+    boost::system::error_code ec;
+    if (fs::file_size(path, ec) != seal.nSize || ec)
+        return false;
+
+    pmap.reset(new CMappedFile(path));
+    const unsigned char* pdata = pmap->data();
+    const size_t nFileSize = pmap->size();
+    if (pmap->IsNull() || nFileSize != seal.nSize || nFileSize < WALLET_TXLOG_HEADER_SIZE ||
+        ReadLE32(pdata) != WALLET_TXLOG_MAGIC || ReadLE32(pdata + 4) != WALLET_TXLOG_VERSION ||
+        ReadLE64(pdata + 8) != seal.nNonce) {
+        pmap.reset();
+        return false;
+    }
+
+    mapLive.clear();
+    nRecords = 0;
+    size_t nPos = WALLET_TXLOG_HEADER_SIZE;
+    while (nPos < nFileSize) {
+        if (nFileSize - nPos < WALLET_TXLOG_RECORD_HEADER_SIZE + WALLET_TXLOG_CHECKSUM_SIZE)
+            break;
+        const unsigned char* p = pdata + nPos;
+        const uint32_t nLen = ReadLE32(p + 33);
+        if (nFileSize - nPos - WALLET_TXLOG_RECORD_HEADER_SIZE - WALLET_TXLOG_CHECKSUM_SIZE < nLen)
+            break;
+        const unsigned char* pend = p + WALLET_TXLOG_RECORD_HEADER_SIZE + nLen;
+        if (ReadLE32(Hash(p, pend).begin()) != ReadLE32(pend))
+            break;
+
+        uint256 hash;
+        memcpy(hash.begin(), p + 1, 32);
+        if (p[0] == WALLET_TXLOG_TX)
+            mapLive[hash] = std::make_pair(nPos + WALLET_TXLOG_RECORD_HEADER_SIZE, nLen);
+        else if (p[0] == WALLET_TXLOG_ERASE)
+            mapLive.erase(hash);
+        else
+            break;
+        nRecords++;
+        nPos += WALLET_TXLOG_RECORD_HEADER_SIZE + nLen + WALLET_TXLOG_CHECKSUM_SIZE;
+    }
+    if (nPos != nFileSize) {
+        LogPrintf("%s: %s damaged at offset %u\n", __func__, path.string(), nPos);
+        mapLive.clear();
+        pmap.reset();
+        return false;
+    }
+
+    file = fsbridge::fopen(path, "ab");
+    if (!file) {
+        mapLive.clear();
+        pmap.reset();
+        return false;
+    }
+    nNonce = seal.nNonce;
+    nSize = nFileSize;
+    fFailed = false;
+    return true;
+}
+
+bool CWalletTxLog::ReadAll(std::vector<CWalletTx>& vWtx)
+{
+    LOCK(cs);
+    if (!pmap)
+        return false;
+
+    std::vector<std::pair<uint256, std::pair<size_t, uint32_t> > > vLive(mapLive.begin(), mapLive.end());
+    mapLive.clear();
+    vWtx.clear();
+    vWtx.resize(vLive.size());
+
+    // Decode contiguous bands of records, one per core
+    static const size_t MIN_BAND_SIZE = 1000;
+    const size_t nCount = vLive.size();
+    const size_t nBands = std::min((size_t) std::max(GetNumCores(), 1), std::max(nCount / MIN_BAND_SIZE, (size_t) 1));
+    const size_t nBandSize = (nCount + nBands - 1) / nBands;
+    const unsigned char* pdata = pmap->data();
+    std::atomic<bool> fOk{true};
+    auto decode = [&](size_t nBegin, size_t nEnd) {
+        try {
+            for (size_t i = nBegin; i < nEnd && fOk; i++) {
+                const char* p = (const char*) pdata + vLive[i].second.first;
+                CDataStream ss(p, p + vLive[i].second.second, SER_DISK, CLIENT_VERSION);
+                ss >> vWtx[i];
+                if (vWtx[i].GetHash() != vLive[i].first)
+                    fOk = false;
+            }
+        } catch (const std::exception&) {
+            fOk = false;
+        }
+    };
+    std::vector<std::thread> vWorkers;
+    for (size_t nBegin = nBandSize; nBegin < nCount; nBegin += nBandSize)
+        vWorkers.emplace_back(decode, nBegin, std::min(nBegin + nBandSize, nCount));
+    decode(0, std::min(nBandSize, nCount));
+    for (std::thread& worker : vWorkers)
+        worker.join();
+
+    pmap.reset();
+    if (!fOk) {
+        vWtx.clear();
+        return error("%s: undecodable transaction in %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool CWalletTxLog::Rewrite(const std::vector<const CWalletTx*>& vWtx)
+{
+    LOCK(cs);
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    pmap.reset();
+    mapLive.clear();
+
+    const fs::path pathTmp = path.string() + ".new";
+    file = fsbridge::fopen(pathTmp, "wb");
+    if (!file) {
+        fFailed = true;
+        return error("%s: cannot create %s", __func__, pathTmp.string());
+    }
+    fFailed = false;
+    nNonce = GetRand();
+    nSize = 0;
+    nRecords = 0;
+    unsigned char header[WALLET_TXLOG_HEADER_SIZE];
+    WriteLE32(header, WALLET_TXLOG_MAGIC);
+    WriteLE32(header + 4, WALLET_TXLOG_VERSION);
+    WriteLE64(header + 8, nNonce);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+        fFailed = true;
+    nSize = sizeof(header);
+
+    for (const CWalletTx* pwtx : vWtx) {
+        if (fFailed)
+            break;
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << *pwtx;
+        Append(WALLET_TXLOG_TX, pwtx->GetHash(), (const unsigned char*) &ss[0], (const unsigned char*) &ss[0] + ss.size());
+    }
+    if (!fFailed && fflush(file) != 0)
+        fFailed = true;
+    if (!fFailed)
+        FileCommit(file);
+    fclose(file);
+    file = nullptr;
+
+    if (fFailed || !RenameOver(pathTmp, path)) {
+        fFailed = true;
+        fs::remove(pathTmp);
+        return error("%s: cannot write %s", __func__, path.string());
+    }
+    file = fsbridge::fopen(path, "ab");
+    if (!file) {
+        fFailed = true;
+        return error("%s: cannot open %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool CWalletTxLog::NeedsCompaction(size_t nLive) const
+{
+    LOCK(cs);
+    return nRecords > 2 * nLive + 1000;
+}
+
+bool CWalletTxLog::Append(unsigned char chType, const uint256& hash, const unsigned char* pbegin, const unsigned char* pend)
+{
+    AssertLockHeld(cs);
+    if (!file || fFailed)
+        return false;
+
+    std::vector<unsigned char> vRecord(WALLET_TXLOG_RECORD_HEADER_SIZE + (pend - pbegin) + WALLET_TXLOG_CHECKSUM_SIZE);
+    vRecord[0] = chType;
+    memcpy(&vRecord[1], hash.begin(), 32);
+    WriteLE32(&vRecord[33], pend - pbegin);
+    if (pend != pbegin)
+        memcpy(&vRecord[WALLET_TXLOG_RECORD_HEADER_SIZE], pbegin, pend - pbegin);
+    unsigned char* pchecksum = &vRecord[vRecord.size() - WALLET_TXLOG_CHECKSUM_SIZE];
+    WriteLE32(pchecksum, ReadLE32(Hash(vRecord.data(), pchecksum).begin()));
+
+    if (fwrite(vRecord.data(), 1, vRecord.size(), file) != vRecord.size()) {
+        // The log no longer matches the wallet; it will not be sealed
+        fFailed = true;
+        return error("%s: cannot write %s", __func__, path.string());
+    }
+    nSize += vRecord.size();
+    nRecords++;
+    return true;
+}
+
+bool CWalletTxLog::AppendTx(const CWalletTx& wtx)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << wtx;
+    LOCK(cs);
+    return Append(WALLET_TXLOG_TX, wtx.GetHash(), (const unsigned char*) &ss[0], (const unsigned char*) &ss[0] + ss.size());
+}
+
+bool CWalletTxLog::AppendErase(const uint256& hash)
+{
+    LOCK(cs);
+    return Append(WALLET_TXLOG_ERASE, hash, nullptr, nullptr);
+}
+
+bool CWalletTxLog::Close(CWalletTxLogSeal& seal)
+{
+    LOCK(cs);
+    if (!file || fFailed)
+        return false;
+    if (fflush(file) != 0)
+        return false;
+    FileCommit(file);
+    fclose(file);
+    file = nullptr;
+    seal.nNonce = nNonce;
+    seal.nSize = nSize;
+    return true;
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2021-2022 The DECENOMY Core Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_TXLOG_H
+#define BITCOIN_WALLET_TXLOG_H
+
+#include "fs.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+class CMappedFile;
+class CWalletTx;
+
+static const bool DEFAULT_WALLET_TXLOG = false;
+
+/**
+ * Stamp stored in the wallet database ("txlogseal") when the log is closed
+ * cleanly. Besides the log it names the database state it matches: the
+ * "txcounter" record, which every transaction write bumps in the same
+ * database transaction, and a hash of the order position and best block
+ * records, which versions without the counter rewrite with each new
+ * transaction and block. The next load trusts the log only if all of them
+ * still match, and erases the stamp straight away, so after a crash the
+ * transactions are read from the wallet database again and the log is
+ * rebuilt.
+ */
+struct CWalletTxLogSeal
+{
+    uint64_t nNonce{0};
+    uint64_t nSize{0};
+    uint64_t nTxCounter{0};
+    uint256 hashState{};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nNonce);
+        READWRITE(nSize);
+        READWRITE(nTxCounter);
+        READWRITE(hashState);
+    }
+};
+
+/**
+ * Append-only copy of the wallet transactions (<wallet>.txlog), kept when
+ * -wallettxlog is set. Every WriteTx and EraseTx appends one checksummed
+ * record and the last record of a transaction wins. The wallet database
+ * stays the authoritative copy; the log only spares the load from
+ * deserializing every transaction record out of the Berkeley DB cursor.
+ */
+class CWalletTxLog
+{
+public:
+    explicit CWalletTxLog(const fs::path& pathIn);
+    ~CWalletTxLog();
+
+    CWalletTxLog(const CWalletTxLog&) = delete;
+    CWalletTxLog& operator=(const CWalletTxLog&) = delete;
+
+    //! Map the log if it matches the seal, checking and indexing every record
+    bool Open(const CWalletTxLogSeal& seal);
+    //! Decode the live transactions of an opened log, in parallel
+    bool ReadAll(std::vector<CWalletTx>& vWtx);
+    //! Replace the log by one record per transaction, under a new nonce
+    bool Rewrite(const std::vector<const CWalletTx*>& vWtx);
+    //! Whether dead records outweigh the live ones
+    bool NeedsCompaction(size_t nLive) const;
+
+    bool AppendTx(const CWalletTx& wtx);
+    bool AppendErase(const uint256& hash);
+
+    //! Commit the log to disk and return the seal matching it
+    bool Close(CWalletTxLogSeal& seal);
+
+private:
+    mutable RecursiveMutex cs;
+    const fs::path path;
+    FILE* file{nullptr};
+    bool fFailed{false};
+    uint64_t nNonce{0};
+    uint64_t nSize{0};
+    uint64_t nRecords{0};
+
+    //! Mapping and payload offset/length of the live records, only while loading
+    std::unique_ptr<CMappedFile> pmap;
+    std::map<uint256, std::pair<size_t, uint32_t> > mapLive;
+
+    bool Append(unsigned char chType, const uint256& hash, const unsigned char* pbegin, const unsigned char* pend);
+};
+
+extern std::unique_ptr<CWalletTxLog> pwalletTxLog;
+
+#endif // BITCOIN_WALLET_TXLOG_H
@@ -8,6 +8,7 @@
 
 #include "wallet/wallet.h"
 
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "init.h"
 #include "guiinterfaceutil.h"
@@ -20,10 +21,13 @@
 #include "spork.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "wallet/txlog.h"
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#include <functional>
+
 CWallet* pwalletMain = nullptr;
 /**
  * Settings
@@ -35,6 +39,7 @@ bool bdisableSystemnotifications = false; // Those bubbles can be annoying and s
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
+int nStakingThreads = 0;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 
@@ -812,6 +817,7 @@ void CWallet::MarkDirty()
 {
     {
         LOCK(cs_wallet);
+        fBalancesRebuild = true;
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
     }
@@ -829,6 +835,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     if(ret.second) { // if it is a newly inserted transaction
         setWallet.insert(hash);
     }
+    AddToUnspentIndex(hash, wtx);
     wtx.BindWallet(this);
     bool fInsertedNew = ret.second;
     if (fInsertedNew) {
@@ -894,6 +901,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     mapWallet[hash] = wtxIn;
     setWallet.insert(hash);
     CWalletTx& wtx = mapWallet[hash];
+    AddToUnspentIndex(hash, wtx);
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
     AddToSpends(hash);
@@ -903,6 +911,8 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
             if (prevtx.nIndex == -1 && !prevtx.hashUnset()) {
                 MarkConflicted(prevtx.hashBlock, wtx.GetHash());
             }
+            // its output is spent now
+            prevtx.MarkDirty();
         }
     }
     return true;
@@ -1077,6 +1087,14 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
 void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock)
 {
     LOCK(cs_wallet);
+    // The outputs of tx changed block (or left the chain), and the coins it
+    // spends are gone: their cached stake inputs are stale either way.
+    if (!mapStakeCache.empty()) {
+        EraseStakeCache(tx.GetHash());
+        for (const CTxIn& txin : tx.vin)
+            mapStakeCache.erase(txin.prevout);
+    }
+
     if (!AddToWalletIfInvolvingMe(tx, pindex, posInBlock, true))
         return; // Not one of ours
 
@@ -1089,15 +1107,83 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
     }
 }
 
+void CWallet::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    LOCK(cs_wallet);
+    // A plain extension of the last seen tip can't disconnect any cached origin block
+    if (pindexStakeCacheTip && pindex->pprev != pindexStakeCacheTip) {
+        for (auto it = mapStakeCache.begin(); it != mapStakeCache.end();) {
+            const CBlockIndex* pindexFrom = it->second.pindexFrom;
+            if (pindex->GetAncestor(pindexFrom->nHeight) != pindexFrom) {
+                it = mapStakeCache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    pindexStakeCacheTip = pindex;
+}
+
+void CWallet::EraseStakeCache(const uint256& hashTx)
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapStakeCache.lower_bound(COutPoint(hashTx, 0));
+    while (it != mapStakeCache.end() && it->first.hash == hashTx) {
+        it = mapStakeCache.erase(it);
+    }
+}
+
+void CWallet::AddToUnspentIndex(const uint256& hash, const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (CMasternode::IsMasternodeCollateralAmount(wtx.vout[i].nValue))
+            setUnspentCollaterals.emplace(hash, i);
+        else
+            setUnspentOutputs.emplace(hash, i);
+    }
+}
+
+void CWallet::EraseFromUnspentIndex(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    for (std::set<COutPoint>* pset : {&setUnspentOutputs, &setUnspentCollaterals}) {
+        auto it = pset->lower_bound(COutPoint(hash, 0));
+        while (it != pset->end() && it->hash == hash)
+            it = pset->erase(it);
+    }
+}
+
+bool CWallet::HasUnspentIndexEntries(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    for (const std::set<COutPoint>* pset : {&setUnspentOutputs, &setUnspentCollaterals}) {
+        auto it = pset->lower_bound(COutPoint(hash, 0));
+        if (it != pset->end() && it->hash == hash)
+            return true;
+    }
+    return false;
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     if (!fFileBacked)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash)) {
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            // the outputs it spent are available again
+            const std::vector<CTxIn> vin = it->second.vin;
+            mapWallet.erase(it);
             setWallet.erase(hash);
+            EraseFromUnspentIndex(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkBalancesDirty(hash);
+            for (const CTxIn& txin : vin) {
+                if (mapWallet.count(txin.prevout.hash))
+                    mapWallet[txin.prevout.hash].MarkDirty();
+            }
         }
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
@@ -1442,7 +1528,7 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
             ReadBlockFromDisk(block, pindex);
             int posInBlock;
             for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
-                if (AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate))
+                if (AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate))
                     ret++;
             }
 
@@ -1644,10 +1730,181 @@ CAmount CWallet::loopTxsBalance(std::function<void(const uint256&, const CWallet
     return nTotal;
 }
 
+CWallet::CWalletBalances& CWallet::CWalletBalances::operator+=(const CWalletBalances& other)
+{
+    nAvailable += other.nAvailable;
+    nUnconfirmed += other.nUnconfirmed;
+    nImmature += other.nImmature;
+    nWatchOnly += other.nWatchOnly;
+    nUnconfirmedWatchOnly += other.nUnconfirmedWatchOnly;
+    nImmatureWatchOnly += other.nImmatureWatchOnly;
+    nStaking += other.nStaking;
+    nLocked += other.nLocked;
+    return *this;
+}
+
+CWallet::CWalletBalances& CWallet::CWalletBalances::operator-=(const CWalletBalances& other)
+{
+    nAvailable -= other.nAvailable;
+    nUnconfirmed -= other.nUnconfirmed;
+    nImmature -= other.nImmature;
+    nWatchOnly -= other.nWatchOnly;
+    nUnconfirmedWatchOnly -= other.nUnconfirmedWatchOnly;
+    nImmatureWatchOnly -= other.nImmatureWatchOnly;
+    nStaking -= other.nStaking;
+    nLocked -= other.nLocked;
+    return *this;
+}
+
+static int GetStakeMinDepth(int nHeight)
+{
+    const auto& consensus = Params().GetConsensus();
+    return consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MIN_DEPTH_V2) ?
+        consensus.nStakeMinDepthV2 :
+        consensus.nStakeMinDepth;
+}
+
+CWallet::CWalletBalances CWallet::GetTxBalances(const CWalletTx& pcoin, int nStakeMinDepth, int& nDepth) const
+{
+    CWalletBalances balances;
+    nDepth = pcoin.GetDepthInMainChain();
+
+    bool fConflicted;
+    int nTrustedDepth = 0;
+    if (pcoin.IsTrusted(nTrustedDepth, fConflicted)) {
+        const CAmount nAvailable = pcoin.GetAvailableCredit();
+        const CAmount nLocked = pcoin.GetLockedCredit();
+        balances.nAvailable = nAvailable;
+        balances.nWatchOnly = pcoin.GetAvailableWatchOnlyCredit();
+        if (nTrustedDepth >= nStakeMinDepth)
+            balances.nStaking = nAvailable - nLocked;  // available coins minus locked coins, if any
+        if (nTrustedDepth > 0 && !fLiteMode)
+            balances.nLocked = nLocked;
+    } else if (nDepth == 0 && pcoin.InMempool()) {
+        balances.nUnconfirmed = pcoin.GetAvailableCredit();
+        balances.nUnconfirmedWatchOnly = pcoin.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = pcoin.GetImmatureCredit(false);
+    balances.nImmatureWatchOnly = pcoin.GetImmatureWatchOnlyCredit();
+    return balances;
+}
+
+void CWallet::UpdateTxBalances(const uint256& hash, int nStakeMinDepth, int nSettleDepth) const
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapBalancesShares.find(hash);
+    if (it != mapBalancesShares.end()) {
+        balancesTotal -= it->second.balances;
+        if (it->second.nSettledHeight < 0) {
+            setBalancesPending.erase(hash);
+        } else {
+            auto range = mapBalancesSettled.equal_range(it->second.nSettledHeight);
+            for (auto itSettled = range.first; itSettled != range.second; ++itSettled) {
+                if (itSettled->second == hash) {
+                    mapBalancesSettled.erase(itSettled);
+                    break;
+                }
+            }
+        }
+        mapBalancesShares.erase(it);
+    }
+
+    auto itTx = mapWallet.find(hash);
+    if (itTx == mapWallet.end())
+        return;
+
+    int nDepth;
+    CBalancesShare& share = mapBalancesShares[hash];
+    share.balances = GetTxBalances(itTx->second, nStakeMinDepth, nDepth);
+    balancesTotal += share.balances;
+    // Past every depth rule (or as deep in conflict) the share only changes
+    // with the transaction itself, or with a reorg down to its block
+    if (std::abs(nDepth) >= nSettleDepth) {
+        share.nSettledHeight = chainActive.Height() - std::abs(nDepth) + 1;
+        mapBalancesSettled.emplace(share.nSettledHeight, hash);
+    } else {
+        setBalancesPending.insert(hash);
+    }
+}
+
+void CWallet::MarkBalancesDirty(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    if (!fBalancesRebuild)
+        setBalancesDirty.insert(hash);
+}
+
+CWallet::CWalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    const int nStakeMinDepth = GetStakeMinDepth(chainActive.Height());
+    const CAmount nCollateral = fMasterNode ? CMasternode::GetMasternodeNodeCollateral(chainActive.Height()) : 0;
+    // no depth rule looks deeper than the maturity and the stake depth
+    const int nSettleDepth = std::max(Params().GetConsensus().nCoinbaseMaturity + 1, nStakeMinDepth);
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+
+    if (fBalancesRebuild || !pindexBalances || nStakeMinDepth != nBalancesStakeMinDepth || nCollateral != nBalancesCollateral) {
+        // first read, or the rules moved under every share
+        balancesTotal = CWalletBalances();
+        mapBalancesShares.clear();
+        setBalancesPending.clear();
+        mapBalancesSettled.clear();
+        setBalancesDirty.clear();
+        setBalancesDirty.insert(setWallet.begin(), setWallet.end());
+        fBalancesRebuild = false;
+    } else if (pindexTip != pindexBalances) {
+        // the transactions down to the fork are back at the depths where their share moves
+        const CBlockIndex* pindexFork = chainActive.FindFork(pindexBalances);
+        const int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+        auto it = mapBalancesSettled.lower_bound(nForkHeight - nSettleDepth + 1);
+        while (it != mapBalancesSettled.end()) {
+            mapBalancesShares[it->second].nSettledHeight = -1;
+            setBalancesPending.insert(it->second);
+            it = mapBalancesSettled.erase(it);
+        }
+        setBalancesDirty.insert(setBalancesPending.begin(), setBalancesPending.end());
+    } else if (nMempoolUpdated != nBalancesMempoolUpdated) {
+        // only the share of the unconfirmed ones depends on the mempool
+        for (const uint256& hash : setBalancesPending) {
+            auto it = mapWallet.find(hash);
+            if (it != mapWallet.end() && it->second.GetDepthInMainChain() == 0)
+                setBalancesDirty.insert(hash);
+        }
+    }
+
+    for (const uint256& hash : setBalancesDirty)
+        UpdateTxBalances(hash, nStakeMinDepth, nSettleDepth);
+    setBalancesDirty.clear();
+    pindexBalances = pindexTip;
+    nBalancesMempoolUpdated = nMempoolUpdated;
+    nBalancesStakeMinDepth = nStakeMinDepth;
+    nBalancesCollateral = nCollateral;
+
+    CWalletBalances balances = balancesTotal;
+    balances.nStaking = std::max(CAmount(0), balances.nStaking);
+    return balances;
+}
+
+CWallet::CWalletBalances CWallet::SumBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+    const int nStakeMinDepth = GetStakeMinDepth(chainActive.Height());
+
+    CWalletBalances balances;
+    for (const auto& it : setWallet) {
+        auto it2 = mapWallet.find(it);
+        if (it2 == mapWallet.end()) continue;
+        int nDepth;
+        balances += GetTxBalances(it2->second, nStakeMinDepth, nDepth);
+    }
+    balances.nStaking = std::max(CAmount(0), balances.nStaking);
+    return balances;
+}
+
 CAmount CWallet::GetAvailableBalance() const
 {
-    isminefilter filter = ISMINE_SPENDABLE;
-    return GetAvailableBalance(filter, true, 0);
+    return GetBalances().nAvailable;
 }
 
 CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int minDepth) const
@@ -1663,76 +1920,37 @@ CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int mi
 
 CAmount CWallet::GetStakingBalance() const
 {
-    const auto nHeight = chainActive.Height();
-    const auto& params = Params();
-    const auto& consensus = params.GetConsensus();
-    const auto nStakeMinDepth = 
-        consensus.NetworkUpgradeActive(nHeight, Consensus::UPGRADE_STAKE_MIN_DEPTH_V2) ?
-        consensus.nStakeMinDepthV2 : 
-        consensus.nStakeMinDepth;
- 
-    return 
-        std::max(
-            CAmount(0), 
-            loopTxsBalance(
-                [nStakeMinDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) 
-                {
-                    if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= nStakeMinDepth) 
-                    {
-                        nTotal += pcoin.GetAvailableCredit();       // available coins
-                        nTotal -= pcoin.GetLockedCredit();          // minus locked coins, if any
-                    }
-                }
-            )
-        );
+    return GetBalances().nStaking;
 }
 
 CAmount CWallet::GetLockedCoins() const
 {
-    if (fLiteMode) return 0;
-
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() > 0)
-                nTotal += pcoin.GetLockedCredit();
-    });
+    return GetBalances().nLocked;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableCredit();
-    });
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureCredit(false);
-    });
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (pcoin.IsTrusted())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nWatchOnly;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
-                nTotal += pcoin.GetAvailableWatchOnlyCredit();
-    });
+    return GetBalances().nUnconfirmedWatchOnly;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
-            nTotal += pcoin.GetImmatureWatchOnlyCredit();
-    });
+    return GetBalances().nImmatureWatchOnly;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -1901,41 +2119,45 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
 
     std::vector<uint256> vErase;
 
-    for (auto it = setWallet.begin(); it != setWallet.end(); ++it) {
+    // Collateral amounts are walked first; ONLY_10000 stops there.
+    for (std::set<COutPoint>* pset : {&setUnspentCollaterals, &setUnspentOutputs}) {
+        if (nCoinType == ONLY_10000 && pset == &setUnspentOutputs) break;
 
-        const uint256& wtxid = *it;
+        auto it = pset->begin();
+        while (it != pset->end()) {
 
-        auto it2 = mapWallet.find(wtxid);
-        if(it2 != mapWallet.end()) {
-            const CWalletTx* pcoin = &(*it2).second;
+            const uint256 wtxid = it->hash;
 
-            // Check if the tx is selectable
+            // Check if the tx is selectable, and the min depth requirement for stake inputs
             int nDepth;
-            if (!CheckTXAvailability(pcoin, fOnlyConfirmed, nDepth))
+            auto it2 = mapWallet.find(wtxid);
+            if (it2 == mapWallet.end() ||
+                !CheckTXAvailability(&it2->second, fOnlyConfirmed, nDepth) ||
+                (nCoinType == STAKEABLE_COINS && nDepth < nStakeMinDepth)) {
+                while (it != pset->end() && it->hash == wtxid) ++it;
                 continue;
+            }
+            const CWalletTx* pcoin = &(*it2).second;
 
-            // Check min depth requirement for stake inputs
-            if (nCoinType == STAKEABLE_COINS && nDepth < nStakeMinDepth) continue;
-
-            int nMine = 0;
-            int nMineSpent = 0;
+            while (it != pset->end() && it->hash == wtxid) {
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
-
-                int nSpendDepth;
-                bool spent = IsSpent(wtxid, i, nSpendDepth);
+                const COutPoint outpoint = *it;
+                const unsigned int i = outpoint.n;
                 isminetype mine = IsMine(pcoin->vout[i]);
 
-                // Check If not mine
-                if (mine == ISMINE_NO) continue;
-
-                nMine++;
+                // Check If not mine, forgetting it once the tx is past a reorg
+                if (mine == ISMINE_NO) {
+                    it = nDepth > nMaxReorgDepth ? pset->erase(it) : std::next(it);
+                    continue;
+                }
 
-                // Check if the utxo was spent.
-                if (spent) {
-                    if(nSpendDepth > nMaxReorgDepth) nMineSpent++;
+                // Check if the utxo was spent, forgetting it once the spend is past a reorg
+                int nSpendDepth;
+                if (IsSpent(wtxid, i, nSpendDepth)) {
+                    it = nSpendDepth > nMaxReorgDepth ? pset->erase(it) : std::next(it);
                     continue;
                 }
+                ++it;
 
                 // Check for only 10k utxo
                 if (nCoinType == ONLY_10000 && !CMasternode::CheckMasternodeCollateral(pcoin->vout[i].nValue)) continue;
@@ -1947,12 +2169,12 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
                 if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000) continue;
 
                 // Skip configured masternode collaterals
-                if (masternodeConfig.contains(COutPoint(wtxid, i)) && nCoinType != ONLY_10000) continue;
+                if (masternodeConfig.contains(outpoint) && nCoinType != ONLY_10000) continue;
 
                 // Check if we should include zero value utxo
                 if (pcoin->vout[i].nValue <= 0) continue;
 
-                if (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
+                if (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(outpoint))
                     continue;
 
                 bool solvable = IsSolvable(*this, pcoin->vout[i].scriptPubKey);
@@ -1965,7 +2187,7 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
                 pCoins->emplace_back(COutput(pcoin, i, nDepth, spendable, solvable));
             }
 
-            if(nDepth > 0 && nMine > 0 && nMine == nMineSpent) {
+            if (nDepth > 0 && !HasUnspentIndexEntries(wtxid)) {
                 vErase.push_back(wtxid);
             }
         }
@@ -2052,6 +2274,38 @@ bool CWallet::StakeableCoins(std::vector<COutput>* pCoins)
             STAKEABLE_COINS);  // coin type
 }
 
+void CWallet::GetStakeCacheEntries(const std::vector<COutput>& vCoins, std::vector<CStakeCacheEntry>& vEntriesRet)
+{
+    vEntriesRet.assign(vCoins.size(), CStakeCacheEntry());
+    std::vector<size_t> vMissing;
+    {
+        LOCK(cs_wallet);
+        for (size_t i = 0; i < vCoins.size(); i++) {
+            auto it = mapStakeCache.find(COutPoint(vCoins[i].tx->GetHash(), vCoins[i].i));
+            if (it != mapStakeCache.end()) {
+                vEntriesRet[i] = it->second;
+            } else {
+                vMissing.push_back(i);
+            }
+        }
+    }
+    if (vMissing.empty())
+        return;
+
+    // The wallet already knows the block of each of its transactions, so new
+    // entries only need a block index lookup, never a disk read.
+    LOCK2(cs_main, cs_wallet);
+    for (const size_t i : vMissing) {
+        const COutput& out = vCoins[i];
+        BlockMap::const_iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+            continue;
+        CStakeCacheEntry& entry = vEntriesRet[i];
+        entry.pindexFrom = mi->second;
+        mapStakeCache.emplace(COutPoint(out.tx->GetHash(), out.i), entry);
+    }
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
@@ -2516,6 +2770,34 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CWa
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosInOut, strFailReason, coinControl, coin_type, true, nFeePay);
 }
 
+/** One of the workers searching for a stake kernel, they share the coins to try */
+class CStakeKernelSearch
+{
+private:
+    std::function<void()>* psearch{nullptr};
+
+public:
+    CStakeKernelSearch() {}
+    explicit CStakeKernelSearch(std::function<void()>* psearchIn) : psearch(psearchIn) {}
+
+    bool operator()()
+    {
+        (*psearch)();
+        return true;
+    }
+
+    void swap(CStakeKernelSearch& search) { std::swap(psearch, search.psearch); }
+};
+
+static CCheckQueue<CStakeKernelSearch> stakekernelqueue(1);
+static Mutex cs_stakekernelqueue;
+
+void ThreadStakeKernelSearch()
+{
+    util::ThreadRename("pivx-stakesrch");
+    stakekernelqueue.Thread();
+}
+
 bool CWallet::CreateCoinStake(
         const CKeyStore& keystore,
         const CBlockIndex* pindexPrev,
@@ -2552,77 +2834,144 @@ bool CWallet::CreateCoinStake(
     }
     pStakerStatus->SetLastValue(nStakedValue);
 
-    for (const COutput &out : *availableCoins) {
-        CPivStake stakeInput;
-        stakeInput.SetPrevout((CTransaction) *out.tx, out.i);
-
-        //new block came in, move on
-        if (WITH_LOCK(cs_main, return chainActive.Height()) != pindexPrev->nHeight) return false;
-
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested()) return false;
-
-        nCredit = 0;
+    std::vector<CStakeCacheEntry> vStakeCache;
+    GetStakeCacheEntries(*availableCoins, vStakeCache);
+
+    const int nThreads = std::max(1, std::min(nStakingThreads, (int) availableCoins->size()));
+
+    // The coins are handed out to the workers through a shared counter, and
+    // every worker stops at its next coin as soon as one of them hits. The
+    // coins handed out were all tried by then, more than one may have hit.
+    std::atomic<size_t> nNextCoin{0};
+    std::atomic<int> nSearchAttempts{0};
+    std::atomic<int64_t> nLastTime{0};
+    std::atomic<bool> fStop{false};
+    std::atomic<bool> fAbort{false};
+    Mutex cs_kernel;
+    std::vector<std::pair<size_t, int64_t>> vKernels;
+
+    std::function<void()> searchKernel = [&]() {
+        while (!fStop) {
+            const size_t nCoin = nNextCoin++;
+            if (nCoin >= availableCoins->size()) break;
+            // Skip coins whose origin block is not in the active chain
+            if (!vStakeCache[nCoin].pindexFrom) continue;
+
+            //new block came in, move on
+            // Make sure the wallet is unlocked and shutdown hasn't been requested
+            if (WITH_LOCK(cs_main, return chainActive.Height()) != pindexPrev->nHeight ||
+                    IsLocked() || ShutdownRequested()) {
+                fAbort = true;
+                fStop = true;
+                break;
+            }
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+            const COutput& out = (*availableCoins)[nCoin];
+            CPivStake stakeInput;
+            stakeInput.SetPrevout((CTransaction) *out.tx, out.i, vStakeCache[nCoin].pindexFrom);
+
+            int64_t nTime = 0;
+            nSearchAttempts++;
+            const bool fHit = Stake(pindexPrev, &stakeInput, nBits, nTime);
+            nLastTime = nTime;
+            if (fHit) {
+                LOCK(cs_kernel);
+                vKernels.emplace_back(nCoin, nTime);
+                fStop = true;
+            }
+        }
+    };
+
+    size_t nSearchFrom = 0;
+    while (!fKernelFound && nSearchFrom < availableCoins->size()) {
+        // a search goes on past the coins of the previous one, kernels included
+        nNextCoin = nSearchFrom;
+        fStop = false;
+        vKernels.clear();
+        if (nThreads > 1) {
+            LOCK(cs_stakekernelqueue);
+            CCheckQueueControl<CStakeKernelSearch> control(&stakekernelqueue);
+            std::vector<CStakeKernelSearch> vSearches(nThreads, CStakeKernelSearch(&searchKernel));
+            control.Add(vSearches);
+            control.Wait();
+        } else {
+            searchKernel();
+        }
+        nSearchFrom = std::min<size_t>(nNextCoin, availableCoins->size());
+        nAttempts = nSearchAttempts;
 
         // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
-
-        if (!fKernelFound) continue;
-
-        // Found a kernel
-        LogPrintf("CreateCoinStake : kernel found\n");
-        nCredit += stakeInput.GetValue();
+        if (nAttempts > 0) {
+            nTxNewTime = nLastTime;
+            pStakerStatus->SetLastTime(nTxNewTime);
+            pStakerStatus->SetLastTries(nAttempts);
+        }
 
-        // Add block reward to the credit
-        nCredit += CRewards::GetBlockValue(pindexPrev->nHeight + 1);
-        CAmount nMasternodeCredit = CMasternode::GetMasternodePayment(pindexPrev->nHeight + 1);
+        if (fAbort) return false;
 
-        // Create the output transaction(s)
-        std::vector<CTxOut> vout;
-        if (!stakeInput.CreateTxOuts(this, vout, nCredit - nMasternodeCredit, onlyP2PK)) {
-            LogPrintf("%s : failed to create output\n", __func__);
-            continue;
-        }
-        txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
-
-        // Set output amount
-        int outputs = (int) txNew.vout.size() - 1;
-        CAmount nRemaining = nCredit;
-        if (outputs > 1) {
-            // Split the stake across the outputs
-            CAmount nShare = nRemaining / outputs;
-            for (int i = 1; i < outputs; i++) {
-                // loop through all but the last one.
-                txNew.vout[i].nValue = nShare;
-                nRemaining -= nShare;
+        // the hits are tried in coin order, the first one a coinstake is made with wins
+        std::sort(vKernels.begin(), vKernels.end());
+        for (const auto& kernel : vKernels) {
+            txNew.vin.clear();
+            txNew.vout.clear();
+            txNew.vout.emplace_back(CTxOut(0, CScript()));
+
+            const COutput& out = (*availableCoins)[kernel.first];
+            CPivStake stakeInput;
+            stakeInput.SetPrevout((CTransaction) *out.tx, out.i, vStakeCache[kernel.first].pindexFrom);
+            nTxNewTime = kernel.second;
+            nCredit = 0;
+
+            // Found a kernel
+            LogPrintf("CreateCoinStake : kernel found\n");
+            nCredit += stakeInput.GetValue();
+
+            // Add block reward to the credit
+            nCredit += CRewards::GetBlockValue(pindexPrev->nHeight + 1);
+            CAmount nMasternodeCredit = CMasternode::GetMasternodePayment(pindexPrev->nHeight + 1);
+
+            // Create the output transaction(s)
+            std::vector<CTxOut> vout;
+            if (!stakeInput.CreateTxOuts(this, vout, nCredit - nMasternodeCredit, onlyP2PK)) {
+                LogPrintf("%s : failed to create output\n", __func__);
+                continue;
             }
-        }
-        // put the remaining on the last output (which all into the first if only one output)
-        txNew.vout[outputs].nValue += nRemaining;
+            txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
+
+            // Set output amount
+            int outputs = (int) txNew.vout.size() - 1;
+            CAmount nRemaining = nCredit;
+            if (outputs > 1) {
+                // Split the stake across the outputs
+                CAmount nShare = nRemaining / outputs;
+                for (int i = 1; i < outputs; i++) {
+                    // loop through all but the last one.
+                    txNew.vout[i].nValue = nShare;
+                    nRemaining -= nShare;
+                }
+            }
+            // put the remaining on the last output (which all into the first if only one output)
+            txNew.vout[outputs].nValue += nRemaining;
 
-        // Limit size
-        unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
-        if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
-            return error("%s : exceeded coinstake size limit", __func__);
+            // Limit size
+            unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
+            if (nBytes >= DEFAULT_BLOCK_MAX_SIZE / 5)
+                return error("%s : exceeded coinstake size limit", __func__);
 
-        // Masternode payment
-        FillBlockPayee(txNew, pindexPrev, true);
+            // Masternode payment
+            FillBlockPayee(txNew, pindexPrev, true);
 
-        const uint256& hashTxOut = txNew.GetHash();
-        CTxIn in;
-        if (!stakeInput.CreateTxIn(this, in, hashTxOut)) {
-            LogPrintf("%s : failed to create TxIn\n", __func__);
-            txNew.vin.clear();
-            txNew.vout.clear();
-            continue;
-        }
-        txNew.vin.emplace_back(in);
+            const uint256& hashTxOut = txNew.GetHash();
+            CTxIn in;
+            if (!stakeInput.CreateTxIn(this, in, hashTxOut)) {
+                LogPrintf("%s : failed to create TxIn\n", __func__);
+                continue;
+            }
+            txNew.vin.emplace_back(in);
 
-        break;
+            fKernelFound = true;
+            break;
+        }
     }
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
 
@@ -2697,7 +3046,7 @@ CWallet::CommitResult CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey&
 
         // Try ATMP. This must not fail. The transaction has already been signed and recorded.
         CValidationState state;
-        if (!AcceptToMemoryPool(mempool, state, wtxNew, false, nullptr, false, true, false)) {
+        if (!AcceptToMemoryPool(mempool, state, MakeTransactionRef(wtxNew), false, nullptr, false, true, false)) {
             res.state = state;
             // Abandon the transaction
             if (AbandonTransaction(res.hashTx)) {
@@ -3130,17 +3479,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalancesDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    for (const COutPoint& output : setLockedCoins)
+        MarkBalancesDirty(output.hash);
     setLockedCoins.clear();
 }
 
@@ -3534,6 +3887,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), 1));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-wallettxlog=<mode>", strprintf(_("Keep wallet transactions in an append-only log next to the wallet file for faster loading (default: %u)"), DEFAULT_WALLET_TXLOG) +
+        " " + _("(1 = keep the log, 2 = rebuild it from the wallet file on startup)"));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
         " " + _("(1 = keep tx meta data e.g. account owner and payment request information, 2 = drop tx meta data)"));
@@ -3542,6 +3897,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_PROCLIMIT));
     strUsage += HelpMessageOpt("-minstakesplit=<amt>", strprintf(_("Minimum positive amount (in SAPP) allowed by GUI and RPC for the stake split threshold (default: %s)"), FormatMoney(DEFAULT_MIN_STAKE_SPLIT_THRESHOLD)));
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), DEFAULT_STAKING));
+    strUsage += HelpMessageOpt("-stakingthreads=<n>", strprintf(_("Set the number of threads searching for stake kernels (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_STAKING_THREADS, DEFAULT_STAKING_THREADS));
     if (showDebug) {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), DEFAULT_WALLET_DBLOGSIZE));
@@ -3850,7 +4206,7 @@ bool CMerkleTx::IsInMainChainImmature() const
 bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree, bool fRejectInsaneFee, bool ignoreFees)
 {
     CValidationState state;
-    bool fAccepted = ::AcceptToMemoryPool(mempool, state, *this, fLimitFree, nullptr, false, fRejectInsaneFee, ignoreFees);
+    bool fAccepted = ::AcceptToMemoryPool(mempool, state, MakeTransactionRef(*this), fLimitFree, nullptr, false, fRejectInsaneFee, ignoreFees);
     if (!fAccepted)
         LogPrintf("%s : %s\n", __func__, state.GetRejectReason());
     return fAccepted;
@@ -4125,6 +4481,9 @@ void CWalletTx::MarkDirty()
     m_amounts[AVAILABLE_CREDIT].Reset();
     nChangeCached = 0;
     fChangeCached = false;
+    // the wallet totals include this transaction
+    if (pwallet)
+        pwallet->MarkBalancesDirty(GetHash());
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -54,6 +54,8 @@ extern bool bSpendZeroConfChange;
 extern bool bdisableSystemnotifications;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
+//! threads searching for stake kernels, the staking thread included (0 = not started)
+extern int nStakingThreads;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -75,6 +77,9 @@ static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 static const bool DEFAULT_SEND_FREE_TRANSACTIONS = false;
 //! Default for -staking
 static const bool DEFAULT_STAKING = true;
+//! -stakingthreads default (0 = one per core) and maximum
+static const int DEFAULT_STAKING_THREADS = 0;
+static const int MAX_STAKING_THREADS = 16;
 //! Defaults for -gen and -genproclimit
 static const bool DEFAULT_GENERATE = false;
 static const unsigned int DEFAULT_GENERATE_PROCLIMIT = 1;
@@ -85,11 +90,19 @@ static const bool DEFAULT_DISABLE_WALLET = false;
 
 extern const char * DEFAULT_WALLET_DAT;
 
+/** Run a stake kernel search worker, -stakingthreads minus one of them are started with the staking thread */
+void ThreadStakeKernelSearch();
+
 // Maximum amount of loaded records in ram in the first load.
 // If the user has more and want to load them:
 // TODO, add load on demand in pages (not every tx loaded all the time into the records list).
 #define MAX_AMOUNT_LOADED_RECORDS 100000
 
+namespace wallet_tests
+{
+class TestWalletBalances;
+}
+
 class CAccountingEntry;
 class CCoinControl;
 class COutput;
@@ -215,6 +228,15 @@ public:
     bool IsActive() const { return (nTime + 30) >= GetTime(); }
 };
 
+/** Kernel inputs of a stakeable output that only change when the block containing it does. */
+class CStakeCacheEntry
+{
+public:
+    // Block that contains the output: its time enters the kernel hash and it
+    // anchors the old (v1) stake modifier lookup.
+    CBlockIndex* pindexFrom{nullptr};
+};
+
 struct CRecipient
 {
     CScript scriptPubKey;
@@ -270,6 +292,80 @@ private:
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
+    /**
+     * Origin block of every output the staker has tried, so that each time
+     * slot can test all kernels without reading transactions from disk.
+     * Entries are dropped by SyncTransaction when the transaction that creates
+     * or spends the output changes, and by UpdatedBlockTip when a reorg
+     * disconnects their block. Guarded by cs_wallet.
+     */
+    std::map<COutPoint, CStakeCacheEntry> mapStakeCache;
+    const CBlockIndex* pindexStakeCacheTip{nullptr};
+    void EraseStakeCache(const uint256& hashTx);
+
+    /**
+     * Outputs of the wallet transactions that AvailableCoins still has to look
+     * at, ordered by outpoint so the outputs of one transaction sit together.
+     * Masternode collateral amounts get their own bucket, so ONLY_10000 never
+     * walks the rest. Outputs are added with their transaction and dropped by
+     * AvailableCoins once they are spent, or are not ours, deeper than
+     * -maxreorg. Guarded by cs_wallet.
+     */
+    mutable std::set<COutPoint> setUnspentOutputs;
+    mutable std::set<COutPoint> setUnspentCollaterals;
+    void AddToUnspentIndex(const uint256& hash, const CWalletTx& wtx);
+    void EraseFromUnspentIndex(const uint256& hash);
+    bool HasUnspentIndexEntries(const uint256& hash) const;
+
+    /**
+     * Totals behind the balance getters, kept as the wallet changes instead
+     * of summed over it on every read. The share of each transaction is kept
+     * too, so a change only swaps the shares of the transactions it touches:
+     * the ones marked dirty (added, updated, spent, abandoned, conflicted, or
+     * with a coin locked), and, when the tip or the mempool moves, the
+     * pending ones whose share still depends on their depth or on the
+     * mempool. A transaction as deep as every depth rule is settled, indexed
+     * by the height of its block so that a reorg can take it back. Tip and
+     * mempool moves are folded in on the next read. Guarded by cs_wallet.
+     */
+    struct CWalletBalances
+    {
+        CAmount nAvailable{0};
+        CAmount nUnconfirmed{0};
+        CAmount nImmature{0};
+        CAmount nWatchOnly{0};
+        CAmount nUnconfirmedWatchOnly{0};
+        CAmount nImmatureWatchOnly{0};
+        CAmount nStaking{0};
+        CAmount nLocked{0};
+
+        CWalletBalances& operator+=(const CWalletBalances& other);
+        CWalletBalances& operator-=(const CWalletBalances& other);
+    };
+    struct CBalancesShare
+    {
+        CWalletBalances balances;
+        //! height of the block the transaction was settled at, or -1 while pending
+        int nSettledHeight{-1};
+    };
+    mutable CWalletBalances balancesTotal;
+    mutable std::map<uint256, CBalancesShare> mapBalancesShares;
+    mutable std::set<uint256> setBalancesDirty;
+    mutable std::set<uint256> setBalancesPending;
+    mutable std::multimap<int, uint256> mapBalancesSettled;
+    mutable bool fBalancesRebuild{true};
+    mutable const CBlockIndex* pindexBalances{nullptr};
+    mutable unsigned int nBalancesMempoolUpdated{0};
+    mutable int nBalancesStakeMinDepth{0};
+    mutable CAmount nBalancesCollateral{0};
+    CWalletBalances GetBalances() const;
+    //! The share of one transaction, with the depth deciding whether it may still change
+    CWalletBalances GetTxBalances(const CWalletTx& wtx, int nStakeMinDepth, int& nDepth) const;
+    void UpdateTxBalances(const uint256& hash, int nStakeMinDepth, int nSettleDepth) const;
+    //! The totals summed over the whole wallet, as the kept ones must be
+    CWalletBalances SumBalances() const;
+    friend class wallet_tests::TestWalletBalances; // for test access to the kept totals
+
 
 public:
 
@@ -380,6 +476,8 @@ public:
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     //! >> Available coins (staking)
     bool StakeableCoins(std::vector<COutput>* pCoins = nullptr);
+    //! Get the cached kernel inputs of each coin (index-aligned), resolving the missing ones in a single cs_main pass
+    void GetStakeCacheEntries(const std::vector<COutput>& vCoins, std::vector<CStakeCacheEntry>& vEntriesRet);
 
     std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed = true, CAmount maxCoinValue = 0);
 
@@ -456,9 +554,12 @@ public:
 
     bool GetLabelDestination(CTxDestination& dest, const std::string& label, bool bForceNew = false);
     void MarkDirty();
+    //! Have the next balance getter take the share of a transaction again
+    void MarkBalancesDirty(const uint256& hash) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
+    void UpdatedBlockTip(const CBlockIndex *pindex);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
 
@@ -11,12 +11,14 @@
 #include "fs.h"
 
 #include "base58.h"
+#include "hash.h"
 #include "protocol.h"
 #include "serialize.h"
 #include "sync.h"
 #include "txdb.h"
 #include "util.h"
 #include "utiltime.h"
+#include "wallet/txlog.h"
 #include "wallet/wallet.h"
 
 #include <atomic>
@@ -62,13 +64,67 @@ bool CWalletDB::ErasePurpose(const std::string& strPurpose)
 bool CWalletDB::WriteTx(const CWalletTx& wtx)
 {
     nWalletDBUpdateCounter++;
-    return Write(std::make_pair(std::string("tx"), wtx.GetHash()), wtx);
+    // The counter moves with the record, in the same database transaction
+    // (or in the caller's), so that a log sealed before no longer matches
+    const bool fTxn = TxnBegin();
+    if (!Write(std::make_pair(std::string("tx"), wtx.GetHash()), wtx) || !BumpTxCounter()) {
+        if (fTxn)
+            TxnAbort();
+        return false;
+    }
+    if (fTxn && !TxnCommit())
+        return false;
+    if (pwalletTxLog)
+        pwalletTxLog->AppendTx(wtx);
+    return true;
 }
 
 bool CWalletDB::EraseTx(uint256 hash)
 {
     nWalletDBUpdateCounter++;
-    return Erase(std::make_pair(std::string("tx"), hash));
+    const bool fTxn = TxnBegin();
+    if (!Erase(std::make_pair(std::string("tx"), hash)) || !BumpTxCounter()) {
+        if (fTxn)
+            TxnAbort();
+        return false;
+    }
+    if (fTxn && !TxnCommit())
+        return false;
+    if (pwalletTxLog)
+        pwalletTxLog->AppendErase(hash);
+    return true;
+}
+
+bool CWalletDB::BumpTxCounter()
+{
+    uint64_t nTxCounter = 0;
+    Read(std::string("txcounter"), nTxCounter);
+    return Write(std::string("txcounter"), nTxCounter + 1);
+}
+
+bool CWalletDB::ReadTxLogSeal(CWalletTxLogSeal& seal)
+{
+    return Read(std::string("txlogseal"), seal);
+}
+
+bool CWalletDB::WriteTxLogSeal(const CWalletTxLogSeal& seal)
+{
+    nWalletDBUpdateCounter++;
+    return Write(std::string("txlogseal"), seal);
+}
+
+void CWalletDB::ReadTxLogState(CWalletTxLogSeal& seal)
+{
+    seal.nTxCounter = 0;
+    Read(std::string("txcounter"), seal.nTxCounter);
+
+    CBlockLocator locator;
+    int64_t nOrderPosNext = 0;
+    ReadBestBlock(locator);
+    Read(std::string("orderposnext"), nOrderPosNext);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << locator.vHave << nOrderPosNext;
+    seal.hashState = ss.GetHash();
 }
 
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
@@ -456,6 +512,7 @@ public:
     unsigned int nSapZAddrs;
     bool fIsEncrypted;
     bool fAnyUnordered;
+    bool fTxFromLog;
     int nFileVersion;
     std::vector<uint256> vWalletUpgrade;
 
@@ -464,6 +521,7 @@ public:
         nKeys = nCKeys = nKeyMeta = nZKeys = nZKeyMeta = nSapZAddrs = 0;
         fIsEncrypted = false;
         fAnyUnordered = false;
+        fTxFromLog = false;
         nFileVersion = 0;
     }
 };
@@ -739,6 +797,29 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             pwallet->LoadMinVersion(nMinVersion);
         }
 
+        // The transactions come from the log only if it was sealed by the last
+        // clean close, over the database as it still is. The seal is dropped
+        // right away, so that after a crash they are read from the database
+        // again and the log is rebuilt.
+        std::vector<CWalletTx> vLogWtx;
+        CWalletTxLogSeal seal;
+        bool fSealed = ReadTxLogSeal(seal);
+        Erase(std::string("txlogseal"));
+        if (fSealed) {
+            CWalletTxLogSeal sealState;
+            ReadTxLogState(sealState);
+            fSealed = seal.nTxCounter == sealState.nTxCounter && seal.hashState == sealState.hashState;
+            if (!fSealed)
+                LogPrintf("%s.txlog is stale, the wallet was written without it\n", strFile);
+        }
+        pwalletTxLog.reset();
+        if (GetBoolArg("-wallettxlog", DEFAULT_WALLET_TXLOG)) {
+            // -wallettxlog=2 rebuilds the log from the database whatever the seal
+            const bool fRebuild = GetArg("-wallettxlog", "1") == "2";
+            pwalletTxLog.reset(new CWalletTxLog(GetDataDir() / (strFile + ".txlog")));
+            wss.fTxFromLog = fSealed && !fRebuild && pwalletTxLog->Open(seal) && pwalletTxLog->ReadAll(vLogWtx);
+        }
+
         // Get cursor
         Dbc* pcursor = GetCursor();
         if (!pcursor) {
@@ -746,17 +827,29 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        // The transaction records sort together under their type, the cursor
+        // jumps over them when the transactions come from the log
+        CDataStream ssTxType(SER_DISK, CLIENT_VERSION);
+        ssTxType << std::string("tx");
+        unsigned int fFlags = DB_NEXT;
         while (true) {
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = ReadAtCursor(pcursor, ssKey, ssValue);
+            if (fFlags == DB_SET_RANGE)
+                ssKey << std::string("ty");
+            int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
+            fFlags = DB_NEXT;
             if (ret == DB_NOTFOUND)
                 break;
             else if (ret != 0) {
                 LogPrintf("Error reading next record from wallet database\n");
                 return DB_CORRUPT;
             }
+            if (wss.fTxFromLog && ssKey.size() > ssTxType.size() && std::equal(ssTxType.begin(), ssTxType.end(), ssKey.begin())) {
+                fFlags = DB_SET_RANGE;
+                continue;
+            }
 
             // Try to be tolerant of single corrupt records:
             std::string strType, strErr;
@@ -778,6 +871,14 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        for (const CWalletTx& wtx : vLogWtx) {
+            if (wtx.nOrderPos == -1)
+                wss.fAnyUnordered = true;
+            pwallet->LoadToWallet(wtx);
+        }
+        if (wss.fTxFromLog)
+            LogPrintf("Loaded %u transactions from %s.txlog\n", vLogWtx.size(), strFile);
     } catch (const boost::thread_interrupted&) {
         throw;
     } catch (...) {
@@ -823,9 +924,36 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         pwallet->wtxOrdered.insert(std::make_pair(entry.nOrderPos, CWallet::TxPair((CWalletTx*)0, &entry)));
     }
 
+    // Build the log from the database on first use or after an unclean close,
+    // and compact it once dead records outweigh the live ones
+    if (pwalletTxLog && (!wss.fTxFromLog || pwalletTxLog->NeedsCompaction(pwallet->mapWallet.size()))) {
+        std::vector<const CWalletTx*> vWtx;
+        vWtx.reserve(pwallet->mapWallet.size());
+        for (const auto& it : pwallet->mapWallet)
+            vWtx.push_back(&it.second);
+        if (pwalletTxLog->Rewrite(vWtx))
+            LogPrintf("Wrote %u transactions to %s.txlog\n", vWtx.size(), strFile);
+        else
+            pwalletTxLog.reset();
+    }
+
     return result;
 }
 
+void CloseWalletTxLog(const std::string& strWalletFile)
+{
+    if (!pwalletTxLog)
+        return;
+    // The state is taken first: a transaction written after it, whether or
+    // not it still made it into the log, leaves the seal stale
+    CWalletDB walletdb(strWalletFile);
+    CWalletTxLogSeal seal;
+    walletdb.ReadTxLogState(seal);
+    if (pwalletTxLog->Close(seal) && !walletdb.WriteTxLogSeal(seal))
+        LogPrintf("%s: cannot seal %s.txlog\n", __func__, strWalletFile);
+    pwalletTxLog.reset();
+}
+
 DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, std::vector<uint256>& vTxHash, std::vector<CWalletTx>& vWtx)
 {
     bool fNoncriticalErrors = false;
@@ -899,6 +1027,10 @@ DBErrors CWalletDB::ZapWalletTx(CWallet* pwallet, std::vector<CWalletTx>& vWtx)
             return DB_CORRUPT;
     }
 
+    // without the log open the erasures are not in it, so it must not be trusted again
+    if (!pwalletTxLog && !Erase(std::string("txlogseal")))
+        return DB_CORRUPT;
+
     return DB_LOAD_OK;
 }
 
@@ -1150,6 +1282,9 @@ bool CWalletDB::Recover(CDBEnv& dbenv, std::string filename, bool fOnlyKeys)
 
     DbTxn* ptxn = dbenv.TxnBegin();
     for (CDBEnv::KeyValPair& row : salvagedData) {
+        // Salvaged transactions may no longer match the transaction log
+        if (row.first.size() == 10 && memcmp(&row.first[1], "txlogseal", 9) == 0)
+            continue;
         if (fOnlyKeys) {
             CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
@@ -31,6 +31,7 @@ class CMasterKey;
 class CScript;
 class CWallet;
 class CWalletTx;
+struct CWalletTxLogSeal;
 class uint160;
 class uint256;
 
@@ -111,6 +112,10 @@ public:
 
     bool WriteTx(const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
+    bool ReadTxLogSeal(CWalletTxLogSeal& seal);
+    bool WriteTxLogSeal(const CWalletTxLogSeal& seal);
+    //! Fill in the database state a seal taken now would match
+    void ReadTxLogState(CWalletTxLogSeal& seal);
 
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta);
     bool WriteKeyMetadata(const CPubKey& vchPubKey, const CKeyMetadata& keyMeta);
@@ -180,6 +185,7 @@ private:
     void operator=(const CWalletDB&);
 
     bool WriteAccountingEntry(const uint64_t nAccEntryNum, const CAccountingEntry& acentry);
+    bool BumpTxCounter();
 };
 
 void NotifyBacked(const CWallet& wallet, bool fSuccess, std::string strMessage);
@@ -187,5 +193,6 @@ bool BackupWallet(const CWallet& wallet, const fs::path& strDest, bool fEnableCu
 bool AttemptBackupWallet(const CWallet& wallet, const fs::path& pathSrc, const fs::path& pathDest);
 
 void ThreadFlushWalletDB();
+void CloseWalletTxLog(const std::string& strWalletFile);
 
 #endif // BITCOIN_WALLETDB_H
@@ -9,6 +9,7 @@
 import os
 
 from test_framework.test_framework import PivxTestFramework
+from test_framework.util import assert_equal, wait_until
 
 class LoggingTest(PivxTestFramework):
     def set_test_params(self):
@@ -61,6 +62,12 @@ class LoggingTest(PivxTestFramework):
         assert os.path.isfile(os.path.join(invdir, "foo.log"))
         self.log.info("Absolute filename ok when path exists")
 
+        # the log writer thread reports the lines it wrote and dropped
+        self.restart_node(0, ["-logasync"])
+        wait_until(lambda: self.nodes[0].logging()["async"]["written"] > 0, timeout=10)
+        assert_equal(self.nodes[0].logging()["async"]["dropped"], 0)
+        self.log.info("Asynchronous logging stats ok")
+
 
 if __name__ == '__main__':
     LoggingTest().main()
\ No newline at end of file
@@ -66,7 +66,9 @@ class BlockchainTest(PivxTestFramework):
         res = node.gettxoutsetinfo()
 
         assert_equal(res['total_amount'], Decimal('50000.00000000'))
-        assert_equal(res['transactions'], 200)
+        # the legacy fields need a scan, they are only there when recomputing
+        assert 'transactions' not in res
+        assert 'hash_serialized_2' not in res
         assert_equal(res['height'], 200)
         assert_equal(res['txouts'], 200)
         assert_equal(res['bestblock'], node.getblockhash(200))
@@ -74,7 +76,25 @@ class BlockchainTest(PivxTestFramework):
         assert_greater_than_or_equal(size, 6400)
         assert_greater_than_or_equal(64000, size)
         assert_equal(len(res['bestblock']), 64)
-        assert_equal(len(res['hash_serialized_2']), 64)
+        assert_equal(len(res['muhash']), 64)
+
+        # a full rescan agrees with the statistics kept block by block
+        res2 = node.gettxoutsetinfo(True)
+        assert_equal(res2['transactions'], 200)
+        assert_equal(len(res2['hash_serialized_2']), 64)
+        assert_equal(res2['matches_cache'], True)
+        for key in ['height', 'bestblock', 'txouts', 'bogosize', 'muhash', 'total_amount']:
+            assert_equal(res2[key], res[key])
+
+        # or, during the deprecation period, on every call as before
+        self.restart_node(0, ["-deprecatedrpc=gettxoutsetinfo"])
+        res3 = node.gettxoutsetinfo()
+        assert_equal(res3['transactions'], 200)
+        assert_equal(res3['hash_serialized_2'], res2['hash_serialized_2'])
+        assert 'matches_cache' not in res3
+        for key in ['height', 'bestblock', 'txouts', 'bogosize', 'muhash', 'total_amount']:
+            assert_equal(res3[key], res[key])
+        self.restart_node(0)
 
     def _test_getblockheader(self):
         node = self.nodes[0]